@@ -6,7 +6,11 @@
 
 #include <websocketpp/config/asio_no_tls_client.hpp>
 #include <websocketpp/client.hpp>
+#include "endpoint_config.h"
 #include "command_types.h"
+#include "binary_header.h"
+#include "frame_codec.h"
+#include "frame_ring.h"
 #include <string>
 #include <memory>
 #include <mutex>
@@ -16,14 +20,23 @@
 #include <functional>
 
 // 使用asio作为底层网络库
-typedef websocketpp::client<websocketpp::config::asio_client> websocket_client;
+typedef websocketpp::client<DeviceClientConfig> websocket_client;
 
 // 消息处理回调函数的类型
-typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
+typedef DeviceClientConfig::message_type::ptr message_ptr;
 
 // 连接句柄类型
 typedef websocketpp::connection_hdl connection_hdl;
 
+// 客户端运行参数
+struct DeviceClientOptions {
+    SocketOptions socket;       // 连接建立后、WebSocket握手之前设置的套接字选项
+    size_t maxMessageSize = 0;  // 最大接收消息字节数，0为endpoint配置的默认值
+    // 等待响应超时后以同一requestId重发请求的次数，每次重发后再等待一个超时时间
+    // 服务器对有副作用的命令返回已有结果（或处理中），不会重复测量
+    int retries = 0;
+};
+
 class DeviceClient {
 private:
     // 请求结构体，用于存储请求信息
@@ -33,13 +46,23 @@ private:
         std::shared_ptr<CommandResult> result;        // 命令执行结果
         bool isBlocking = false;                      // 是否为阻塞模式
         bool pendingReceived = false;                 // 是否已收到pending响应
+        bool finalReceived = false;  // 是否已收到最终响应，重发后原请求与重发的响应可能都到达
     };
 
     // 迭代器类型定义
     using PendingRequestsIterator = std::map<std::string, PendingRequest>::iterator;
 
 public:
-    DeviceClient();
+    static constexpr size_t kDefaultChunkSize = 256 * 1024;
+
+    // 二进制帧回调：数据头与原始数据（不含数据头）
+    typedef std::function<void(const BinaryHeader &header, const uint8_t *data, size_t size)>
+        FrameHandler;
+    // 设备事件回调：主题、事件序号与内容
+    typedef std::function<void(const std::string &topic, uint64_t sequence, const json &data)>
+        EventHandler;
+
+    explicit DeviceClient(const DeviceClientOptions &options = DeviceClientOptions());
     ~DeviceClient();
 
     // 连接到服务器
@@ -51,21 +74,44 @@ public:
     CommandResult setAlignViewMode(const std::string &mode);
     // 获取视频流模式
     CommandResult getAlignViewMode();
-    // 开始视频流
-    CommandResult startStream();
+    // 开始视频流，params可指定format（raw/gray8/gray16/rgb24）、encoding（none/delta）等
+    // transport为shm时通过共享内存接收图像（仅限与服务器在同一主机），打不开共享内存时
+    // 自动改用WebSocket传输，帧回调不变
+    CommandResult startStream(const json &params = json());
+    // 请求视频流关键帧（差分编码时重新同步）
+    CommandResult requestKeyframe();
+    // 获取单帧快照，图像在响应之后通过帧回调送达（contexId为0x01000000）
+    // params可指定format/roi/decimation；未指定chunkSize时按kDefaultChunkSize分段接收
+    CommandResult getSnapshot(const json &params = json());
     // 停止视频流
     CommandResult stopStream();
     // 开始测量
     // isBlocking:
     //   - true: 函数会等待测量完成，直到收到success或error响应后返回
     //   - false: 函数在收到pending响应后立即返回，可以通过getMeasureStatus检查测量状态
-    CommandResult executeMeasurement(bool isBlocking = true);
+    // params: 测量参数，如averageCount（多次测量取平均）与variance（保留逐像素方差）
+    CommandResult executeMeasurement(bool isBlocking = true, const json &params = json());
     // 停止测量
     CommandResult stopMeasure();
-    // 查询测量状态
-    CommandResult getMeasureStatus();
+    // 查询测量状态，params.ifVersionNewerThan为已有的状态版本，未变化时只返回unchanged
+    CommandResult getMeasureStatus(const json &params = json());
     // 获取面形数据
-    CommandResult getSurfaceData();
+    // params可指定金字塔层级level或progressive由粗到细接收，面形通过FrameHandler回调
+    // 未指定chunkSize时按kDefaultChunkSize分段接收（拼接后回调），接收期间其他命令的响应不必等待
+    CommandResult getSurfaceData(const json &params = json());
+    // 获取面形汇总（PV/RMS与Zernike系数），params可指定zernikeTerms、remove与datasetId
+    CommandResult getSurfaceSummary(const json &params = json());
+    // 获取服务器运行指标
+    CommandResult getServerMetrics();
+    // 订阅/取消订阅设备事件，params.topics为主题列表（status/progress/dataset），缺省为全部
+    CommandResult subscribe(const json &params = json());
+    CommandResult unsubscribe(const json &params = json());
+
+    // 设置视频流/测量结果二进制帧的回调，在IO线程中调用
+    // 差分编码的视频流在回调前已解码为完整图像（messageType为StreamImage）
+    void setFrameHandler(FrameHandler handler);
+    // 设置设备事件回调，在IO线程中调用
+    void setEventHandler(EventHandler handler);
 
     // 发送通用命令并等待响应
     CommandResult sendCommand(CommandType cmdType,
@@ -87,6 +133,21 @@ private:
     void onFail(connection_hdl hdl);
     void onMessage(connection_hdl hdl, message_ptr msg);
 
+    // 处理二进制帧
+    void handleBinaryMessage(const std::string &payload);
+    // 处理共享内存槽位通知：在共享内存中读取图像并回调，之后释放槽位
+    void handleSlotNotice(const BinaryHeader &header, const uint8_t *payload);
+    // startStream/stopStream成功后在IO线程中打开/关闭共享内存，先于随后的槽位通知处理
+    void updateFrameRing(const std::string &command, const json &data);
+    // 在IO线程中发送关键帧请求，不等待响应
+    void sendKeyframeRequest();
+
+    // 等待响应，超时后按m_retries以同一requestId重发请求（payload）并继续等待
+    std::future_status waitForResponse(const std::string &requestId,
+                                       const std::string &payload,
+                                       std::future<void> &future,
+                                       int timeout_sec);
+
     // 处理测量命令的响应
     void handleMeasureResponse(PendingRequestsIterator it, const json &message);
 
@@ -100,6 +161,8 @@ private:
     void handleGenericResponse(PendingRequestsIterator it, const json &message);
 
     websocket_client m_client;
+    SocketOptions m_socket_options;
+    int m_retries = 0;
     connection_hdl m_hdl;
     std::thread m_thread;
     bool m_connected = false;
@@ -108,6 +171,17 @@ private:
     // 请求映射表，存储每个请求ID对应的结果、promise和命令类型
     std::mutex m_pending_mutex;
     std::map<std::string, PendingRequest> m_pending_requests;
+
+    std::mutex m_frame_mutex;
+    FrameHandler m_frame_handler;
+    StreamDecoder m_stream_decoder;
+    // 分段消息的拼接缓冲，键为contexId（快照与面形的分段可能交错到达），由m_frame_mutex保护
+    std::map<uint32_t, ChunkAssembler> m_chunks;
+    bool m_keyframe_requested = false;  // 已请求关键帧，收到关键帧前不再重复请求
+    std::unique_ptr<FrameRing> m_frame_ring;  // 共享内存传输的环形缓冲，由m_frame_mutex保护
+
+    std::mutex m_event_mutex;
+    EventHandler m_event_handler;
 };
 
 #endif  // DEVICE_CLIENT_H
@@ -0,0 +1,66 @@
+#ifndef BINARY_HEADER_H
+#define BINARY_HEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 二进制消息类型
+enum class BinaryMessageType : uint8_t {
+    StreamImage = 0x01,    // 视频流图像
+    MeasureResult = 0x02,  // 测量结果
+    StreamKeyframe = 0x03, // 视频流关键帧（RLE压缩）
+    StreamDelta = 0x04,    // 视频流差分帧（与上一帧异或后RLE压缩）
+    StreamSlot = 0x05,     // 视频流帧已写入共享内存槽位（载荷为帧序号与槽位编号）
+    Chunk = 0x06,          // 大块二进制消息的一段，按顺序拼接后得到原消息
+};
+
+// 二进制数据格式
+enum class BinaryFormat : uint8_t {
+    Gray8 = 8,     // 8位灰度图像
+    Gray16 = 16,   // 16位灰度图像（小端）
+    Rgb24 = 24,    // 24位RGB图像
+    Double64 = 64  // 双精度浮点数据
+};
+
+// 二进制数据头，按小端字节序逐字段紧凑排列，共14字节
+struct BinaryHeader {
+    static constexpr size_t kEncodedSize = 14;
+
+    uint8_t messageType = 0;    // BinaryMessageType
+    uint32_t contexId = 0;      // streamID/datasetId
+    uint8_t format = 0;         // 针对stream 8/16-gray 24-rgb 针对dataset 64-double
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint32_t payloadLength = 0; // 原始数据总字节数
+};
+
+// 将数据头编码到out（至少kEncodedSize字节）
+void encodeBinaryHeader(const BinaryHeader& header, uint8_t* out);
+
+// 从data解析数据头，数据不足或载荷长度不匹配时返回false
+bool decodeBinaryHeader(const uint8_t* data, size_t size, BinaryHeader& header);
+
+// 分段消息：完整的二进制消息（含数据头）按段长切成多条Chunk消息，其他消息可以插在段与段之间发送
+// 数据头的contexId与原消息相同，format为原消息的messageType，宽高为0；
+// 载荷为偏移(uint32)、原消息总字节数(uint32)与该段数据。同一条原消息的各段按偏移顺序连续到达
+constexpr size_t kChunkPrefixSize = 8;
+
+// 把message切成每段不超过chunkSize字节数据的分段消息，chunkSize为0或消息不超过一段时不切分
+std::vector<std::string> splitIntoChunks(const std::string& message, size_t chunkSize);
+
+// 按顺序拼接分段消息，得到完整的原消息
+class ChunkAssembler {
+public:
+    // 加入一段（header为该段的数据头，payload为数据头之后的载荷）
+    // 返回true表示原消息已完整，通过take()取出；段不连续或格式错误时丢弃已拼接的内容
+    bool add(const BinaryHeader& header, const uint8_t* payload);
+    std::string take();
+
+private:
+    std::string m_message;
+    uint32_t m_total = 0;
+};
+
+#endif  // BINARY_HEADER_H
@@ -17,6 +17,12 @@ enum class CommandType {
     StopMeasure,        // 停止测量
     GetMeasureStatus,   // 获取测量状态
     GetSurfaceData,     // 获取面形数据
+    GetServerMetrics,   // 获取服务器运行指标
+    RequestKeyframe,    // 请求视频流关键帧
+    GetSnapshot,        // 获取单帧快照
+    GetSurfaceSummary,  // 获取面形统计与Zernike拟合结果
+    Subscribe,          // 订阅设备事件
+    Unsubscribe,        // 取消订阅设备事件
     Unknown             // 位置命令
 };
 
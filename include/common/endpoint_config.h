@@ -0,0 +1,140 @@
+#ifndef ENDPOINT_CONFIG_H
+#define ENDPOINT_CONFIG_H
+
+#define ASIO_STANDALONE
+#define _WEBSOCKETPP_CPP11_STL_
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include "message_pool.h"
+#include <cstddef>
+#include <string>
+
+// TCP套接字调优参数，server/client/bench_load的命令行参数
+struct SocketOptions {
+    bool noDelay = true;    // TCP_NODELAY：关闭Nagle算法，小响应不等待与后续数据合并
+    int sendBuffer = 0;     // SO_SNDBUF字节数，0为系统默认
+    int receiveBuffer = 0;  // SO_RCVBUF字节数，0为系统默认
+    int busyPollUs = 0;     // SO_BUSY_POLL微秒数（仅Linux），0为关闭
+};
+
+// 应用到已连接的套接字（或尚未绑定的监听套接字），返回第一个失败的选项的错误
+template <typename Socket>
+websocketpp::lib::asio::error_code applySocketOptions(Socket& socket,
+                                                      const SocketOptions& options) {
+    namespace asio = websocketpp::lib::asio;
+    asio::error_code ec;
+    if (options.noDelay) {
+        socket.set_option(asio::ip::tcp::no_delay(true), ec);
+    }
+    if (!ec && options.sendBuffer > 0) {
+        socket.set_option(asio::socket_base::send_buffer_size(options.sendBuffer), ec);
+    }
+    if (!ec && options.receiveBuffer > 0) {
+        socket.set_option(asio::socket_base::receive_buffer_size(options.receiveBuffer), ec);
+    }
+#ifdef SO_BUSY_POLL
+    if (!ec && options.busyPollUs > 0) {
+        socket.set_option(
+            asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>(options.busyPollUs),
+            ec);
+    }
+#endif
+    return ec;
+}
+
+// 解析套接字相关的命令行参数：--no-nodelay、--sndbuf <字节>、--rcvbuf <字节>、
+// --busy-poll <微秒>、--max-message-size <字节>
+// argv[i]是其中之一时消费参数（i指向最后一个被消费的参数）并返回true，参数值无效时error非空
+bool parseSocketOption(int argc,
+                       char* argv[],
+                       int& i,
+                       SocketOptions& options,
+                       size_t& maxMessageSize,
+                       std::string& error);
+// 上述参数的用法说明，用于各程序的用法提示
+extern const char* const kSocketOptionsUsage;
+
+// 把打开文件数的软限制提高到硬限制（仅POSIX），每个连接占用一个描述符，上万个连接时默认的1024不够
+void raiseOpenFileLimit();
+
+// 服务端endpoint配置，按上万个空闲监控连接的场景压缩每个连接的内存：
+// - 收到的只有JSON请求，读缓冲为1KB（websocketpp连接对象内的定长数组，每个连接一份），
+//   更大的请求分几次读取
+// - 消息对象在所有连接之间复用（PooledMessageManager）
+// - 只有一个线程运行io_service，其他线程的发送由websocketpp投递到该线程，
+//   不需要每个连接的asio strand（transport_config::enable_multithreading）
+// 最大消息限制为1MB，异常客户端无法让服务器为单条消息分配大量内存
+struct DeviceServerConfig : public websocketpp::config::asio {
+    typedef DeviceServerConfig type;
+    typedef websocketpp::config::asio base;
+
+    typedef base::concurrency_type concurrency_type;
+
+    typedef base::request_type request_type;
+    typedef base::response_type response_type;
+
+    typedef websocketpp::message_buffer::message<PooledMessageManager> message_type;
+    typedef PooledMessageManager<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type>
+        endpoint_msg_manager_type;
+
+    typedef base::alog_type alog_type;
+    typedef base::elog_type elog_type;
+
+    typedef base::rng_type rng_type;
+
+    struct transport_config : public base::transport_config {
+        typedef type::concurrency_type concurrency_type;
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
+        typedef type::request_type request_type;
+        typedef type::response_type response_type;
+        typedef websocketpp::transport::asio::basic_socket::endpoint socket_type;
+
+        static bool const enable_multithreading = false;
+    };
+
+    typedef websocketpp::transport::asio::endpoint<transport_config> transport_type;
+
+    static const size_t connection_read_buffer_size = 1024;
+    static const size_t max_message_size = 1024 * 1024;
+};
+
+// 客户端endpoint配置
+// 视频帧与面形数据为数MB的二进制消息，读缓冲加大到256KB，每帧的读取次数减少到原来的1/16；
+// 最大消息64MB，容纳最大尺寸的双精度面形
+struct DeviceClientConfig : public websocketpp::config::asio_client {
+    typedef DeviceClientConfig type;
+    typedef websocketpp::config::asio_client base;
+
+    typedef base::concurrency_type concurrency_type;
+
+    typedef base::request_type request_type;
+    typedef base::response_type response_type;
+
+    typedef base::message_type message_type;
+    typedef base::con_msg_manager_type con_msg_manager_type;
+    typedef base::endpoint_msg_manager_type endpoint_msg_manager_type;
+
+    typedef base::alog_type alog_type;
+    typedef base::elog_type elog_type;
+
+    typedef base::rng_type rng_type;
+
+    struct transport_config : public base::transport_config {
+        typedef type::concurrency_type concurrency_type;
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
+        typedef type::request_type request_type;
+        typedef type::response_type response_type;
+        typedef websocketpp::transport::asio::basic_socket::endpoint socket_type;
+    };
+
+    typedef websocketpp::transport::asio::endpoint<transport_config> transport_type;
+
+    static const size_t connection_read_buffer_size = 256 * 1024;
+    static const size_t max_message_size = 64 * 1024 * 1024;
+};
+
+#endif  // ENDPOINT_CONFIG_H
@@ -0,0 +1,86 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include "binary_header.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 视频流帧间差分编码
+// 关键帧为整幅图像的RLE压缩，差分帧为与上一帧逐字节异或后的RLE压缩
+// 数据头的format/width/height描述解码后的图像，payloadLength为压缩后的字节数
+
+// 游程编码：控制字节c < 0x80 表示其后c+1个字节原样复制；
+// c >= 0x80 表示重复，长度为(c & 0x7F)+3，低7位全1时后跟varint追加长度，最后是重复的字节值
+void rleCompress(const uint8_t* data, size_t size, std::string& out);
+// 解压到out（恰好outSize字节），数据损坏或长度不符时返回false
+bool rleDecompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize);
+
+// out = a ^ b，out可以与a或b相同
+void xorBytes(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t size);
+
+// 服务端编码器：一组订阅者（相同视图与帧率）共享，每帧最多压缩一次关键帧与差分帧
+class StreamEncoder {
+public:
+    // 每隔该帧数强制发送关键帧，便于新订阅者与异常的客户端尽快同步
+    static constexpr uint64_t kKeyframeInterval = 60;
+
+    // 输入新一帧原始图像（含数据头），index为生产帧序号
+    void push(const std::string& frame, uint64_t index);
+
+    bool hasFrame() const { return m_has_current; }
+    uint64_t currentIndex() const { return m_current_index; }
+    // 差分帧所参考的上一帧序号，没有上一帧时无法生成差分帧
+    bool hasPrevious() const { return m_has_previous; }
+    uint64_t previousIndex() const { return m_previous_index; }
+    // 当前帧是否为周期性关键帧
+    bool periodicKeyframe() const { return m_sequence % kKeyframeInterval == 0; }
+
+    // 编码后的帧（含数据头，contexId为0）
+    std::string& keyframe();
+    std::string& delta();
+
+private:
+    BinaryHeader m_header;
+    std::vector<uint8_t> m_current;
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_scratch;
+    bool m_has_current = false;
+    bool m_has_previous = false;
+    uint64_t m_current_index = 0;
+    uint64_t m_previous_index = 0;
+    uint64_t m_sequence = 0;
+
+    std::string m_keyframe;
+    std::string m_delta;
+    bool m_keyframe_valid = false;
+    bool m_delta_valid = false;
+};
+
+// 客户端解码器：按contexId(streamId)保存参考帧
+class StreamDecoder {
+public:
+    // 解码一帧视频流数据（payload不含数据头）
+    // StreamImage原样返回；关键帧/差分帧还原为完整图像，image的messageType为StreamImage
+    // 数据损坏或缺少参考帧时返回false，需要向服务器请求关键帧
+    bool decode(const BinaryHeader& header,
+                const uint8_t* payload,
+                BinaryHeader& image,
+                const uint8_t*& pixels);
+
+    // 丢弃参考帧
+    void reset() { m_streams.clear(); }
+
+private:
+    struct Reference {
+        BinaryHeader header;
+        std::vector<uint8_t> pixels;
+    };
+
+    std::map<uint32_t, Reference> m_streams;
+    std::vector<uint8_t> m_scratch;
+};
+
+#endif  // FRAME_CODEC_H
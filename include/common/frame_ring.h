@@ -0,0 +1,63 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// 同一主机上的视频流共享内存环形缓冲（startStream的transport为shm时使用）
+// 服务端把整帧（含数据头）写入一个槽位，WebSocket上只发送StreamSlot通知（数据头+序号+槽位）；
+// 客户端直接在共享内存中读取图像，处理完后释放，服务端不会覆盖尚未释放的槽位，
+// 槽位全部被占用时服务端丢弃新帧
+// 帧序号从1开始，第n帧写入第(n - 1) % slotCount个槽位；仅POSIX平台，其他平台create/open返回空指针
+class FrameRing {
+public:
+    static constexpr uint32_t kDefaultSlotCount = 4;
+    // StreamSlot通知的载荷：帧序号（8字节）与槽位编号（4字节），小端
+    static constexpr size_t kNoticeSize = 12;
+
+    // 服务端：创建名为name（以/开头）的共享内存对象，slotSize为一帧（含数据头）的最大字节数
+    // 对象已存在或创建失败时返回空指针，析构时删除该对象
+    static std::unique_ptr<FrameRing> create(const std::string& name,
+                                             uint32_t slotCount,
+                                             size_t slotSize);
+    // 客户端：打开服务端创建的对象，不存在（不在同一主机）或格式不符时返回空指针
+    static std::unique_ptr<FrameRing> open(const std::string& name);
+    ~FrameRing();
+
+    const std::string& name() const { return m_name; }
+    uint32_t slotCount() const { return m_slot_count; }
+    size_t slotSize() const { return m_slot_size; }
+
+    // 服务端：写入一帧，返回帧序号与槽位；槽位都未释放或帧超过槽位大小时返回false
+    bool write(const uint8_t* data, size_t size, uint64_t& sequence, uint32_t& slot);
+    // 客户端：取得第sequence帧，返回指向共享内存的指针，释放前内容不变；槽位内容不是该帧时返回空指针
+    const uint8_t* read(uint64_t sequence, uint32_t slot, size_t& size) const;
+    // 客户端：释放序号不大于sequence的帧
+    void release(uint64_t sequence);
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+private:
+    struct Control;
+    struct SlotHeader;
+
+    FrameRing(const std::string& name, void* memory, size_t bytes, bool owner);
+    SlotHeader& slotHeader(uint32_t slot) const;
+
+    std::string m_name;
+    void* m_memory;
+    size_t m_bytes;
+    bool m_owner;  // 创建者在析构时删除共享内存对象
+    uint32_t m_slot_count = 0;
+    size_t m_slot_size = 0;
+    size_t m_slot_stride = 0;
+};
+
+// StreamSlot通知的载荷编解码，out至少FrameRing::kNoticeSize字节
+void encodeSlotNotice(uint64_t sequence, uint32_t slot, uint8_t* out);
+bool decodeSlotNotice(const uint8_t* data, size_t size, uint64_t& sequence, uint32_t& slot);
+
+#endif  // FRAME_RING_H
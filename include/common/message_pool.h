@@ -0,0 +1,103 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#define ASIO_STANDALONE
+#define _WEBSOCKETPP_CPP11_STL_
+
+#include <websocketpp/frame.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// websocketpp的消息管理器（endpoint配置的con_msg_manager_type），消息对象在进程内复用
+// 默认的管理器每条收发的消息都新分配消息对象与载荷缓冲，释放时直接删除；
+// 这里消息释放后回到进程共享的池中，下次取出时保留载荷缓冲的容量，控制响应与请求不再反复分配内存
+// 每个连接仍创建一个管理器（websocketpp在连接构造时创建），但它只持有池的指针
+// 池中最多保留kMaxPooled个对象，载荷容量超过kMaxPooledCapacity的消息（视频帧、面形）直接释放
+template <typename message>
+class PooledMessageManager : public std::enable_shared_from_this<PooledMessageManager<message>> {
+public:
+    typedef PooledMessageManager<message> type;
+    typedef std::shared_ptr<type> ptr;
+    typedef std::weak_ptr<type> weak_ptr;
+    typedef typename message::ptr message_ptr;
+
+    static constexpr size_t kMaxPooled = 256;
+    static constexpr size_t kMaxPooledCapacity = 16 * 1024;
+
+    PooledMessageManager() : m_pool(sharedPool()) {}
+
+    // 空消息，由协议处理器填写
+    message_ptr get_message() { return acquire(nullptr, 0); }
+
+    // 指定操作码的消息，载荷预留size字节
+    message_ptr get_message(websocketpp::frame::opcode::value op, size_t size) {
+        return acquire(&op, size);
+    }
+
+    // 消息通过shared_ptr的删除器回收，不经过message::recycle
+    bool recycle(message*) { return false; }
+
+private:
+    struct Pool {
+        std::mutex mutex;
+        std::vector<message*> free;
+
+        ~Pool() {
+            for (message* msg : free) {
+                delete msg;
+            }
+        }
+    };
+
+    static std::shared_ptr<Pool> sharedPool() {
+        static std::shared_ptr<Pool> pool = std::make_shared<Pool>();
+        return pool;
+    }
+
+    message_ptr acquire(const websocketpp::frame::opcode::value* op, size_t size) {
+        message* msg = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_pool->mutex);
+            if (!m_pool->free.empty()) {
+                msg = m_pool->free.back();
+                m_pool->free.pop_back();
+            }
+        }
+        if (msg) {
+            // 恢复为新构造时的状态，载荷缓冲的容量保留
+            msg->set_prepared(false);
+            msg->set_fin(true);
+            msg->set_terminal(false);
+            msg->set_compressed(false);
+            msg->set_header("");
+            msg->get_raw_payload().clear();
+            if (op) {
+                msg->set_opcode(*op);
+            }
+            msg->get_raw_payload().reserve(size);
+        } else if (op) {
+            msg = new message(this->shared_from_this(), *op, size);
+        } else {
+            msg = new message(this->shared_from_this());
+        }
+
+        // 删除器持有池而不是管理器，连接关闭后仍在发送队列中的消息也能归还
+        std::shared_ptr<Pool> pool = m_pool;
+        return message_ptr(msg, [pool](message* released) {
+            if (released->get_payload().capacity() <= kMaxPooledCapacity) {
+                std::lock_guard<std::mutex> lock(pool->mutex);
+                if (pool->free.size() < kMaxPooled) {
+                    pool->free.push_back(released);
+                    return;
+                }
+            }
+            delete released;
+        });
+    }
+
+    std::shared_ptr<Pool> m_pool;
+};
+
+#endif  // MESSAGE_POOL_H
@@ -0,0 +1,16 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <cstddef>
+#include <functional>
+
+// 数据并行循环，使用进程内共享的工作线程池（线程数为CPU核数，调用线程也参与计算）
+// 将[0, count)按grain切成若干块，并行调用fn(begin, end)，返回时所有块都已完成
+// 每次调用恰好处理一块，begin总是grain的整数倍，调用方可按begin / grain保存每块的部分结果
+// 线程池正被其他调用占用（包括嵌套调用）时在调用线程中顺序执行，不会死锁
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+// 参与parallelFor计算的线程数（含调用线程）
+size_t parallelWorkerCount();
+
+#endif  // PARALLEL_FOR_H
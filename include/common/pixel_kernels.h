@@ -0,0 +1,52 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 视频流像素转换内核
+// x86上按CPU能力在运行时选择AVX2/SSE实现，其他平台使用标量实现，各实现的结果逐字节一致
+
+// 内核指令集
+enum class PixelKernelIsa {
+    Scalar,  // 标量实现
+    Sse,     // SSE2 + SSSE3（RGB通道重排使用pshufb）
+    Avx2     // AVX2
+};
+
+// 当前使用的指令集
+PixelKernelIsa activePixelKernelIsa();
+// 强制使用指定指令集（用于基准测试对比），超出CPU能力时退回到支持的最高指令集，返回实际生效的指令集
+PixelKernelIsa setPixelKernelIsa(PixelKernelIsa isa);
+const char* pixelKernelIsaName(PixelKernelIsa isa);
+
+// RGB24 -> 8位灰度，ITU-R BT.601权重: gray = (77*R + 150*G + 29*B + 128) >> 8
+void rgb24ToGray8(const uint8_t* rgb, uint8_t* gray, size_t pixelCount);
+
+// 8位灰度 -> RGB24（三个通道取相同值）
+void gray8ToRgb24(const uint8_t* gray, uint8_t* rgb, size_t pixelCount);
+
+// 8位灰度 -> 16位灰度（小端），value * 257 使 255 映射到 65535
+void gray8ToGray16(const uint8_t* gray8, uint8_t* gray16, size_t pixelCount);
+
+// 16位灰度（小端） -> 8位灰度，取高8位
+void gray16ToGray8(const uint8_t* gray16, uint8_t* gray8, size_t pixelCount);
+
+// 8位灰度按factor x factor区域取平均缩小（四舍五入），输出尺寸为 width/factor x height/factor
+// srcStride为源图像每行字节数，不能整除的边缘行列被丢弃；factor为2时使用向量化实现
+void downsampleBoxGray8(const uint8_t* src,
+                        size_t width,
+                        size_t height,
+                        size_t srcStride,
+                        size_t factor,
+                        uint8_t* dst);
+
+// RGB24按factor x factor区域取平均缩小，各通道独立计算，参数含义同downsampleBoxGray8（仅标量实现）
+void downsampleBoxRgb24(const uint8_t* src,
+                        size_t width,
+                        size_t height,
+                        size_t srcStride,
+                        size_t factor,
+                        uint8_t* dst);
+
+#endif  // PIXEL_KERNELS_H
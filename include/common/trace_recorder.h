@@ -0,0 +1,61 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+// 请求生命周期追踪，输出为Chrome/Perfetto trace-event格式（JSON数组格式）
+// 默认关闭，关闭时每个埋点只有一次原子读的开销
+// 时间戳使用steady_clock（单调时钟），同一主机上的客户端与服务端追踪文件可以对齐查看
+class TraceRecorder {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // 全局追踪器
+    static TraceRecorder& instance();
+
+    ~TraceRecorder();
+
+    // 开启追踪，事件写入path文件，processName用于在查看器中标识进程
+    bool enable(const std::string& path, const std::string& processName);
+    // 关闭追踪并补全文件结尾
+    void disable();
+
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // 记录请求的一个阶段，同时生成与上一阶段之间的区间事件
+    void mark(const std::string& requestId, const char* stage) {
+        if (enabled()) {
+            mark(requestId, stage, Clock::now());
+        }
+    }
+    void mark(const std::string& requestId, const char* stage, Clock::time_point time);
+
+    // 记录请求的最后一个阶段，生成整个请求的区间事件并结束该请求的追踪
+    void finish(const std::string& requestId, const char* stage);
+
+private:
+    TraceRecorder() = default;
+
+    struct LastStage {
+        std::string stage;
+        Clock::time_point time;
+        Clock::time_point start;
+    };
+
+    void record(const std::string& requestId, const char* stage, Clock::time_point time, bool last);
+    void writeEvent(const std::string& event);
+
+    std::atomic<bool> m_enabled{false};
+    std::mutex m_mutex;
+    std::ofstream m_out;
+    int m_pid = 0;
+    // 每个请求上一次记录的阶段
+    std::map<std::string, LastStage> m_last_stage;
+};
+
+#endif  // TRACE_RECORDER_H
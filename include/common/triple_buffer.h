@@ -0,0 +1,46 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// 无锁三缓冲：单生产者不断发布新数据，消费者总能拿到最新一份完整数据
+// 三块缓冲分别由生产者（写）、消费者（读）持有，第三块为中转，双方通过一次原子交换互换缓冲，
+// 生产者永不等待消费者，消费者读取期间其缓冲不会被覆盖
+// 只允许一个生产者线程；多个消费者线程需要自行串行化（它们之间互斥，但不会阻塞生产者）
+template <typename T>
+class TripleBuffer {
+public:
+    // 生产者当前的写缓冲
+    T& writeBuffer() { return m_slots[m_back]; }
+
+    // 生产者发布写缓冲，之后writeBuffer()指向另一块缓冲（内容为更早的数据，可直接覆盖）
+    void publish() {
+        uint8_t previous = m_middle.exchange(m_back | kDirty, std::memory_order_acq_rel);
+        m_back = previous & kIndexMask;
+    }
+
+    // 消费者切换到最新发布的缓冲，没有新数据时返回上次读取的缓冲
+    T& acquire() {
+        if (m_middle.load(std::memory_order_relaxed) & kDirty) {
+            uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = previous & kIndexMask;
+        }
+        return m_slots[m_front];
+    }
+
+    // 是否有消费者尚未读取的新数据
+    bool hasNew() const { return (m_middle.load(std::memory_order_acquire) & kDirty) != 0; }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x03;
+    static constexpr uint8_t kDirty = 0x04;
+
+    T m_slots[3];
+    // 生产者与消费者各自的索引与共享的中转索引分处不同缓存行，避免伪共享
+    alignas(64) uint8_t m_back = 0;
+    alignas(64) std::atomic<uint8_t> m_middle{1};
+    alignas(64) uint8_t m_front = 2;
+};
+
+#endif  // TRIPLE_BUFFER_H
@@ -0,0 +1,102 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include "surface_engine.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 视频流帧与测量数据集的录制文件（server --record/--replay）
+// 文件头16字节：magic "DEVCAP01"、版本(uint32)、保留(uint32)；之后依次为记录，全部为小端：
+//   记录头32字节：类型(uint32)、设备编号(uint32)、时间戳(uint64，距录制开始的微秒数)、
+//                 载荷字节数(uint64)、耗时(uint32，数据集的测量耗时微秒数)、保留(uint32)
+//   载荷按8字节对齐填充，映射到内存后可直接读取
+// 帧载荷为生产线程生成的原始帧（BinaryHeader+rawData），与取流模式、订阅者的视图无关
+// 数据集载荷：宽(uint16)、高(uint16)、标志(uint32，bit0表示含方差)、有效像素数(uint64)、
+//             方差有效像素数(uint64)，之后为宽x高个double面形高度，含方差时再跟同样大小的方差
+enum class CaptureRecordType : uint32_t {
+    Frame = 1,
+    Dataset = 2,
+};
+
+// 录制文件中的一条记录，data指向映射的文件内容
+struct CaptureRecord {
+    CaptureRecordType type = CaptureRecordType::Frame;
+    uint32_t device = 0;
+    uint64_t timestampUs = 0;
+    uint32_t durationUs = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// 写入录制文件，多个设备的生产线程与任务线程可以同时写入
+class CaptureWriter {
+public:
+    // 创建（覆盖）文件，失败时返回空指针
+    static std::shared_ptr<CaptureWriter> create(const std::string& path);
+    ~CaptureWriter();
+
+    void writeFrame(uint32_t device, const std::string& frame);
+    // variance为空指针时不写入方差
+    void writeDataset(uint32_t device,
+                      uint32_t durationUs,
+                      const SurfaceMap& map,
+                      const SurfaceMap* variance);
+
+    uint64_t records() const;
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+private:
+    explicit CaptureWriter(std::FILE* file);
+    // 调用时必须持有m_mutex
+    void writeRecord(CaptureRecordType type,
+                     uint32_t device,
+                     uint32_t durationUs,
+                     const void* const* parts,
+                     const size_t* sizes,
+                     size_t count);
+
+    mutable std::mutex m_mutex;
+    std::FILE* m_file;
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t m_records = 0;
+};
+
+// 只读打开录制文件，POSIX平台映射到内存，其他平台整体读入
+// 打开时建立按设备与类型分组的索引，之后只读，可被多个线程共享
+class CaptureReader {
+public:
+    // 文件不存在、格式不符或记录不完整时返回空指针并给出错误信息
+    static std::shared_ptr<const CaptureReader> open(const std::string& path, std::string& error);
+    ~CaptureReader();
+
+    // 文件中出现过的最大设备编号加1
+    size_t deviceCount() const { return m_frames.size(); }
+    // 设备的帧/数据集记录，按时间顺序；设备编号超出文件中的设备数时取模
+    const std::vector<CaptureRecord>& frames(uint32_t device) const;
+    const std::vector<CaptureRecord>& datasets(uint32_t device) const;
+
+    // 解码数据集记录，记录中没有方差时variance为空
+    static bool decodeDataset(const CaptureRecord& record, SurfaceMap& map, SurfaceMap& variance);
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+private:
+    CaptureReader() = default;
+
+    void* m_memory = nullptr;     // 映射的文件内容
+    size_t m_bytes = 0;
+    std::vector<uint8_t> m_copy;  // 不支持映射的平台上读入的文件内容
+    std::vector<std::vector<CaptureRecord>> m_frames;    // 按设备编号
+    std::vector<std::vector<CaptureRecord>> m_datasets;  // 按设备编号
+};
+
+#endif  // CAPTURE_FILE_H
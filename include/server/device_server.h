@@ -5,17 +5,41 @@
 #define _WEBSOCKETPP_CPP11_STL_
 
 #include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/core.hpp>
+#include "endpoint_config.h"
 #include <websocketpp/server.hpp>
 #include <nlohmann/json.hpp>
+#include "capture_file.h"
+#include "frame_ring.h"
+#include "response_cache.h"
+#include "send_scheduler.h"
+#include "server_metrics.h"
+#include "session_registry.h"
+#include "shared_device_state.h"
+#include "stream_view.h"
+#include "surface_analysis.h"
+#include "surface_engine.h"
+#include "triple_buffer.h"
+#include <deque>
 #include <set>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
 #include <string>
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <type_traits>
 
 using json = nlohmann::json;
 
 // 使用asio作为底层网络库
-typedef websocketpp::server<websocketpp::config::asio> websocket_server;
+typedef websocketpp::server<DeviceServerConfig> websocket_server;
 
 // 消息处理回调函数的类型
 typedef websocket_server::message_ptr message_ptr;
@@ -23,52 +47,392 @@ typedef websocket_server::message_ptr message_ptr;
 // 连接句柄类型
 typedef websocketpp::connection_hdl connection_hdl;
 
-class DeviceServer {
+// 判断endpoint配置是否使用asio网络传输（否则为iostream等进程内传输）
+template <typename Config>
+struct uses_asio_transport
+    : std::is_same<typename Config::transport_type,
+                   websocketpp::transport::asio::endpoint<typename Config::transport_config>> {};
+
+// 服务器运行参数
+struct DeviceServerOptions {
+    // 托管的逻辑设备，第一个为默认设备（请求未指定deviceId、连接路径也不是/devices/<id>时使用）
+    std::vector<std::string> deviceIds = {"DEV12345"};
+    // 把每台设备的线程固定到一个CPU核（第i台设备使用第i % 核数个核）
+    bool pinDevices = false;
+    // 以SO_REUSEPORT绑定监听端口，多个工作进程同时监听同一端口，由内核分配新连接
+    bool reusePort = false;
+    // 工作进程之间共享的设备状态，为空时只使用本进程的状态；槽位顺序与deviceIds一致
+    std::shared_ptr<SharedDeviceState> sharedState;
+    size_t workerIndex = 0;  // 本进程在共享状态中的工作进程编号
+    // 录制生产的视频帧与测量数据集，为空时不录制
+    std::shared_ptr<CaptureWriter> recorder;
+    // 回放录制文件：视频流与测量使用文件中的帧与数据集（循环播放），为空时生成模拟数据
+    std::shared_ptr<const CaptureReader> replay;
+    double replaySpeed = 1.0;  // 回放速度倍数，按录制时的时间间隔除以该值等待，0为不等待
+    // 新连接的套接字选项（仅asio传输），SO_RCVBUF同时设置在监听套接字上，连接建立时即生效
+    SocketOptions socket;
+    size_t maxMessageSize = 0;  // 最大接收消息字节数，0为endpoint配置的默认值
+};
+
+// 设备服务器，按websocketpp的endpoint配置模板化
+// - DeviceServerConfig: 正常的TCP服务器（websocketpp::config::asio加上本项目的缓冲与消息大小）
+// - websocketpp::config::core: iostream传输，不经过套接字，用于进程内测试与基准测试
+// 一个进程可以托管多台逻辑设备，每台设备有独立的状态、视频流生产线程、事件发送线程与测量任务队列，
+// 请求按信封中的deviceId或连接路径/devices/<id>路由到设备
+template <typename Config>
+class BasicDeviceServer {
 public:
-    DeviceServer();
+    typedef websocketpp::server<Config> server_type;
+    typedef typename server_type::message_ptr message_ptr;
+
+    explicit BasicDeviceServer(const DeviceServerOptions& options = DeviceServerOptions());
+    ~BasicDeviceServer();
     
-    // 运行服务器
+    // 运行服务器（仅asio传输），阻塞到服务器停止；只能由一个线程调用，见实现中的说明
     void run(uint16_t port);
+
+    // 底层endpoint，进程内传输需要通过它创建连接并喂入数据
+    server_type& endpoint() { return m_server; }
     
 private:
+    struct Device;
+    struct SnapshotRequest;
+
     void onOpen(connection_hdl hdl);
     void onClose(connection_hdl hdl);
     void onMessage(connection_hdl hdl, message_ptr msg);
+    // 握手时检查连接路径，/devices/<id>中的设备不存在时拒绝连接
+    bool onValidate(connection_hdl hdl);
+    // 处理普通HTTP请求（/metrics 导出Prometheus指标）
+    void onHttp(connection_hdl hdl);
+
+    // 按连接路径查找设备：/devices/<id>返回该设备（不存在时为空指针），其他路径返回默认设备
+    Device* deviceForResource(const std::string& resource);
+
+    // 发送JSON响应，同时统计发送字节数，最终响应还会记录请求延迟
+    void sendJson(connection_hdl hdl, const json& response);
+    // 发送已序列化的响应，command/requestId/status须与payload中的一致
+    void sendPayload(connection_hdl hdl,
+                     const std::string& command,
+                     const std::string& requestId,
+                     const std::string& status,
+                     const std::string& payload);
     
     // 处理测量请求
-    void handleMeasureRequest(connection_hdl hdl, const std::string& requestId, const json& params);
+    void handleMeasureRequest(Device& device,
+                              connection_hdl hdl,
+                              const std::string& requestId,
+                              const json& params);
     
     // 处理设置取流模式请求
-    void handleSetStreamMode(connection_hdl hdl, const std::string& requestId, const json& params);
+    void handleSetStreamMode(Device& device,
+                             connection_hdl hdl,
+                             const std::string& requestId,
+                             const json& params);
     
     // 处理获取观察模式请求
-    void handleGetStreamMode(connection_hdl hdl, const std::string& requestId);
+    void handleGetStreamMode(Device& device, connection_hdl hdl, const std::string& requestId);
     
-    // 处理获取设备状态请求
-    void handleMeasureStatus(connection_hdl hdl, const std::string& requestId);
+    // 处理获取设备状态请求，params.ifVersionNewerThan不小于当前版本时只返回unchanged
+    void handleMeasureStatus(Device& device,
+                             connection_hdl hdl,
+                             const std::string& requestId,
+                             const json& params);
     
     // 处理校准请求
-    void handleCalibrate(connection_hdl hdl, const std::string& requestId, const json& params);
+    void handleCalibrate(Device& device,
+                         connection_hdl hdl,
+                         const std::string& requestId,
+                         const json& params);
     
     // 处理开始取流请求
-    void handleStartStream(connection_hdl hdl, const std::string& requestId, const json& params);
+    void handleStartStream(Device& device,
+                           connection_hdl hdl,
+                           const std::string& requestId,
+                           const json& params);
     
+    // 连接是否来自本机（回环地址），共享内存传输只对同一主机上的客户端开放
+    bool isLocalConnection(connection_hdl hdl);
+
     // 处理停止取流请求
-    void handleStopStream(connection_hdl hdl, const std::string& requestId);
+    void handleStopStream(Device& device, connection_hdl hdl, const std::string& requestId);
     
     // 处理停止测量请求
-    void handleStopMeasure(connection_hdl hdl, const std::string& requestId);
+    void handleStopMeasure(Device& device, connection_hdl hdl, const std::string& requestId);
+
+    // 处理获取服务器指标请求
+    void handleServerMetrics(Device& device, connection_hdl hdl, const std::string& requestId);
+
+    // 处理请求关键帧请求（差分编码的视频流重新同步）
+    void handleRequestKeyframe(Device& device, connection_hdl hdl, const std::string& requestId);
+
+    // 处理获取单帧快照请求，立即返回最新一帧（trigger模式下触发采集新的一帧）
+    // 尚无可用的帧时登记请求后返回，不阻塞网络线程，由视频流生产线程发布新帧后回复
+    void handleGetSnapshot(Device& device,
+                           connection_hdl hdl,
+                           const std::string& requestId,
+                           const json& params);
+    // 回复快照请求：先发送响应，再以视频流优先级发送三缓冲中的最新一帧
+    void sendSnapshot(Device& device, const SnapshotRequest& request);
     
     void sendMeasuringStatus(connection_hdl hdl, const std::string& requestId);
-    void sendMeasurementComplete(connection_hdl hdl, const std::string& requestId, const json& params);
-    void startMeasurement(connection_hdl hdl, const std::string& requestId, const json& params);
-
-    websocket_server m_server;
-    std::set<connection_hdl, std::owner_less<connection_hdl>> m_connections;
-    std::string m_current_stream_mode; // 当前取流模式
-    std::atomic<bool> m_is_calibrated{false}; // 是否已校准
-    std::atomic<bool> m_is_streaming{false}; // 是否正在取流
-    std::atomic<bool> m_is_measuring{false}; // 是否正在测量
+    void sendMeasurementComplete(Device& device,
+                                 connection_hdl hdl,
+                                 const std::string& requestId,
+                                 const json& data);
+    void startMeasurement(Device& device,
+                          connection_hdl hdl,
+                          const std::string& requestId,
+                          const SurfaceParams& surface);
+
+    // 处理获取面形数据请求，返回最近一次测量的面形（可指定金字塔层级或由粗到细依次发送）
+    void handleGetSurfaceData(Device& device,
+                              connection_hdl hdl,
+                              const std::string& requestId,
+                              const json& params);
+    // 以MeasureResult二进制帧发送一级面形，chunkSize非0时切成分段消息（BinaryMessageType::Chunk）
+    void sendSurfaceFrame(connection_hdl hdl,
+                          uint32_t datasetId,
+                          const SurfaceMap& map,
+                          size_t chunkSize);
+
+    // 处理获取面形汇总请求，在服务端计算PV/RMS与Zernike系数，同一数据集的相同参数只计算一次
+    void handleGetSurfaceSummary(Device& device,
+                                 connection_hdl hdl,
+                                 const std::string& requestId,
+                                 const json& params);
+
+    // 处理订阅/取消订阅设备事件请求，params.topics为主题列表，缺省为全部主题
+    void handleSubscribe(Device& device,
+                         connection_hdl hdl,
+                         const std::string& requestId,
+                         const json& params);
+    void handleUnsubscribe(Device& device,
+                           connection_hdl hdl,
+                           const std::string& requestId,
+                           const json& params);
+    // 向订阅了该设备topic的连接发布事件；订阅者来不及接收时同一主题只保留最新的一条
+    void publishEvent(Device& device, const std::string& topic, const json& data);
+    // 设备状态变化后调用：与当前快照不同时生成新版本的快照并发布status事件
+    // 调用时不能持有device.streamMutex
+    void publishStatus(Device& device);
+    // 放入订阅者的待发送事件，调用时必须持有device.eventMutex
+    void queueEvent(Device& device, const std::string& topic, const json& data);
+    // 当前设备状态快照，无锁读取
+    struct DeviceState;
+    std::shared_ptr<const DeviceState> deviceState(const Device& device) const;
+    // 事件发送线程：把各订阅者待发送的事件写出，发送缓冲积压时等待
+    void eventLoop(Device& device);
+
+    // 视频流生产线程：有订阅者时按固定帧率生成模拟图像并发送给所有订阅者
+    void streamLoop(Device& device);
+    // 按取流模式生成一帧模拟图像（含二进制数据头）
+    void renderFrame(const std::string& mode, uint64_t frameIndex, std::string& frame);
+
+    // 放入设备的任务队列，任务线程逐个执行（同一设备同一时间只执行一个测量或校准）
+    // owner为提交任务的会话键，各会话的任务轮流执行
+    void postJob(Device& device, const void* owner, std::function<void()> job);
+    void jobLoop(Device& device);
+
+    // 与共享状态同步：本进程改变的字段写入共享段，其余字段采用共享段中的值，调用时持有device.stateMutex
+    void syncSharedState(Device& device, const DeviceState* current, DeviceState& state);
+    // 共享状态监视线程：发现其他工作进程修改了设备状态时重新发布本进程的状态快照
+    void sharedStateLoop();
+
+    server_type m_server;
+    ServerMetrics m_metrics;
+    std::atomic<bool> m_running{true};
+    std::atomic<bool> m_io_running{false};  // 已有线程在run()中运行io_service
+    bool m_reuse_port = false;
+    std::shared_ptr<SharedDeviceState> m_shared_state;
+    size_t m_worker_index = 0;
+    std::thread m_shared_state_thread;
+    std::shared_ptr<CaptureWriter> m_recorder;
+    std::shared_ptr<const CaptureReader> m_replay;
+    double m_replay_speed = 1.0;
+    SocketOptions m_socket_options;
+
+    // 视频流订阅者
+    struct StreamSubscriber {
+        uint32_t streamId;
+        StreamView view;  // 像素格式、ROI与抽样倍率
+        double maxFps;    // 最大帧率，不超过生产帧率
+        bool deltaEncoding;         // 是否使用关键帧+差分帧编码
+        uint32_t keyframeRequests;  // 客户端请求关键帧的次数，变化时下一帧发送关键帧
+        // transport为shm时帧写入共享内存环形缓冲，连接上只发送槽位通知；随订阅一起释放
+        std::shared_ptr<FrameRing> ring;
+    };
+    // 设备事件订阅者
+    struct EventSubscriber {
+        std::set<std::string> topics;
+        struct PendingEvent {
+            uint64_t sequence;
+            std::string payload;  // 已序列化的事件消息
+        };
+        std::map<std::string, PendingEvent> pending;  // 每个主题尚未发送的最新事件
+    };
+    // 正在处理中的请求，用于计算从收到请求到发送最终响应的延迟
+    struct InFlightRequest {
+        CommandType type;
+        std::chrono::steady_clock::time_point received;
+    };
+    // 连接会话，连接打开时创建、关闭时从所有会话表中移除
+    struct Session {
+        uint64_t sessionId = 0;
+        connection_hdl hdl;
+        std::chrono::steady_clock::time_point opened;
+        Device* device = nullptr;  // 按连接路径绑定的设备，请求未指定deviceId时使用
+        // 发送调度：所有发往该连接的消息按优先级排队，命令响应不必等待排在前面的大块数据
+        std::shared_ptr<SendScheduler<server_type>> sender;
+        // 该连接上尚未发送最终响应的请求，键为requestId
+        std::mutex inflightMutex;
+        std::map<std::string, InFlightRequest> inflight;
+        // 有副作用的请求的最终响应，客户端以同一requestId重发时直接返回
+        ResponseCache responses;
+        // 发送统计
+        std::atomic<uint64_t> messagesSent{0};
+        std::atomic<uint64_t> bytesSent{0};
+        std::atomic<uint64_t> framesSent{0};
+        std::atomic<uint64_t> framesDropped{0};
+    };
+    // 会话在某台设备上的视频流与事件订阅，按会话键存放在设备的订阅表中
+    struct StreamSubscription {
+        std::shared_ptr<Session> session;
+        StreamSubscriber stream;
+    };
+    struct EventSubscription {
+        std::shared_ptr<Session> session;
+        EventSubscriber events;
+    };
+    // 连接对应的会话键
+    static const void* sessionKey(connection_hdl hdl) { return hdl.lock().get(); }
+    // 查找连接的会话，连接已关闭时返回空指针
+    std::shared_ptr<Session> findSession(connection_hdl hdl);
+    std::shared_mutex m_session_mutex;  // 保护会话表，查找只需共享锁
+    SessionRegistry<Session> m_sessions;
+    std::atomic<uint64_t> m_next_session_id{1};
+
+    // 最新一帧，视频流生产线程每帧发布，getSnapshot直接从中读取
+    struct LatestFrame {
+        std::string frame;      // 原始帧（含数据头）
+        uint64_t sequence = 0;  // 发布序号，从1开始，0表示尚无数据
+        std::chrono::steady_clock::time_point captured;
+    };
+
+    // 等待新一帧的快照请求
+    struct SnapshotRequest {
+        connection_hdl hdl;
+        std::string requestId;
+        StreamView view;
+        size_t chunkSize = 0;  // 非0时快照切成分段消息发送
+        std::string mode;      // 收到请求时的取流模式
+        uint64_t target = 1;   // 需要的最小发布序号
+    };
+
+    // 设备状态快照，发布后只读；写入方在Device::stateMutex内生成新版本后原子替换指针（RCU）
+    // 读取方用std::atomic_load取得指针即得到一致的状态，无需加锁，旧快照在最后一个读取方释放后回收
+    struct DeviceState {
+        uint64_t version = 0;  // 从1开始，状态每变化一次加1
+        std::string alignViewMode;
+        bool isCalibrated = false;
+        bool isStreaming = false;
+        bool isMeasuring = false;
+        json status;                   // status事件内容
+        std::string deviceStatusText;  // getMeasureStatus的deviceStatus字段，每个版本只序列化一次
+    };
+
+    // 测量数据集
+    struct SurfaceDataset {
+        uint32_t datasetId = 0;
+        SurfaceMap map;
+        std::vector<SurfaceMap> pyramid;  // 降采样金字塔，pyramid[k - 1]为第k级，测量完成时构建
+        SurfaceMap variance;              // 多次测量的逐像素方差，未要求时为空
+        // getSurfaceSummary的结果缓存，键为SurfaceSummaryOptions::cacheKey()，随数据集一起释放
+        mutable std::mutex summaryMutex;  // 计算期间持有，相同参数的并发请求等待同一次计算
+        mutable std::map<std::string, json> summaries;
+    };
+
+    // 设备任务队列中的一项
+    struct DeviceJob {
+        const void* owner = nullptr;  // 提交任务的会话键
+        uint64_t round = 0;           // 轮次，队列按轮次排列，同一轮次按提交顺序
+        std::function<void()> run;
+    };
+
+    // 一次测量（采集）与等待其结果的请求，参数相同的并发请求共用一次测量
+    struct Measurement {
+        struct Waiter {
+            connection_hdl hdl;
+            std::string requestId;
+        };
+        SurfaceParams surface;
+        // 以下由Device::jobMutex保护
+        std::vector<Waiter> waiters;  // waiters[0]为发起测量的请求
+        bool started = false;
+        std::chrono::steady_clock::time_point startedAt;
+        bool finished = false;  // 已取走waiters，不再接受新的请求
+    };
+
+    // 一台逻辑设备，服务器构造时创建，之后设备表不再变化
+    // 设备之间不共享锁，各自的线程可以固定在不同的CPU核上
+    struct Device {
+        std::string deviceId;
+        unsigned shard = 0;  // 设备编号，pinDevices时决定线程所在的CPU核
+
+        std::atomic<bool> isCalibrated{false};  // 是否已校准
+        std::atomic<bool> isStreaming{false};   // 是否正在取流
+        std::atomic<bool> isMeasuring{false};   // 是否正在测量
+
+        std::mutex streamMutex;  // 保护取流订阅表和取流模式
+        std::condition_variable streamCv;
+        std::string currentStreamMode = "continuous";  // 当前取流模式
+        SessionRegistry<StreamSubscription> streamSubscribers;
+        std::thread streamThread;
+
+        // 最新一帧与快照
+        TripleBuffer<LatestFrame> latestFrame;
+        std::atomic<uint64_t> publishedSequence{0};
+        std::mutex snapshotMutex;        // 串行化快照读取端
+        StreamViewCache snapshotViews;  // 快照的格式转换与裁剪，由snapshotMutex保护
+        std::atomic<size_t> snapshotWaiters{0};  // snapshotRequests的条数，发布新帧后据此决定是否加锁
+        // 以下由streamMutex保护
+        std::chrono::steady_clock::time_point snapshotDeadline;  // 此前保持采集，快照无需等待
+        std::vector<SnapshotRequest> snapshotRequests;           // 等待新一帧的快照请求
+        uint64_t triggerPending = 0;                            // trigger模式下待处理的触发次数
+
+        std::mutex eventMutex;  // 保护以下事件状态
+        std::condition_variable eventCv;
+        SessionRegistry<EventSubscription> eventSubscribers;  // 订阅了至少一个主题的会话
+        uint64_t eventSequence = 0;  // 该设备所有主题共用的事件序号
+        std::thread eventThread;
+
+        std::mutex stateMutex;  // 串行化状态快照的写入方
+        std::shared_ptr<const DeviceState> state;  // 只通过std::atomic_load/atomic_store访问
+        std::atomic<uint64_t> sharedVersion{0};    // 最近一次同步时共享段中该设备的版本
+
+        // 测量与校准任务队列，各会话轮流：会话排队中的第k个任务位于第k轮（从当前轮次算起）
+        std::mutex jobMutex;
+        std::condition_variable jobCv;
+        std::deque<DeviceJob> jobs;
+        uint64_t jobRound = 0;                         // 最近开始执行的任务的轮次
+        std::map<const void*, uint64_t> ownerRounds;  // 会话 -> 其排队中最后一个任务的轮次
+        std::vector<std::shared_ptr<Measurement>> measurements;  // 排队中与进行中的测量
+        std::thread jobThread;
+        // 测量缓冲，只由任务线程访问
+        SurfaceEngine engine;
+        SurfaceAccumulator accumulator;  // averageCount > 1时的逐像素均值与方差
+        SurfaceMap singleMap;            // averageCount > 1时每次测量的结果
+        size_t replayDataset = 0;        // 回放时下一个使用的数据集记录
+        std::mutex datasetMutex;  // 保护lastDataset指针，数据集本身发布后只读
+        std::shared_ptr<const SurfaceDataset> lastDataset;
+    };
+    std::vector<std::unique_ptr<Device>> m_devices;  // m_devices[0]为默认设备
+    std::unordered_map<std::string, Device*> m_device_index;  // deviceId -> 设备，构造后只读
+    std::atomic<uint32_t> m_next_stream_id{1};
+    std::atomic<uint32_t> m_next_dataset_id{1};
 };
 
+// 基于TCP的设备服务器
+typedef BasicDeviceServer<DeviceServerConfig> DeviceServer;
+
 #endif // DEVICE_SERVER_H
@@ -0,0 +1,58 @@
+#ifndef IN_PROCESS_SERVER_H
+#define IN_PROCESS_SERVER_H
+
+#include "device_server.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 进程内收到的一条服务器消息
+struct InProcessMessage {
+    websocketpp::frame::opcode::value opcode;
+    std::string payload;
+};
+
+// 不经过套接字的进程内设备服务器
+// 基于websocketpp的iostream传输：客户端帧直接喂给服务器连接，服务器写出的字节保存在内存中，
+// 用于在没有TCP和内核网络开销的情况下测试和压测协议处理逻辑
+class InProcessServer {
+public:
+    typedef BasicDeviceServer<websocketpp::config::core> server_type;
+
+    explicit InProcessServer(const DeviceServerOptions& options = DeviceServerOptions());
+    ~InProcessServer();
+
+    // 建立一个虚拟客户端连接并完成WebSocket握手，返回连接编号
+    // resource为握手请求的路径，/devices/<id>把连接绑定到指定设备
+    size_t connect(const std::string& resource = "/");
+    // 断开连接（相当于对端关闭套接字）
+    void disconnect(size_t connection);
+
+    // 以客户端身份发送一条文本消息
+    void sendText(size_t connection, const std::string& payload);
+    // 直接喂入已编码的客户端帧，压测时可以预先编码避免重复计算掩码
+    void feed(size_t connection, const std::string& bytes);
+
+    // 取出该连接上服务器已发送的完整消息
+    std::vector<InProcessMessage> receive(size_t connection);
+    // 丢弃该连接上服务器已发送的数据，返回丢弃的字节数
+    size_t discard(size_t connection);
+
+    // 把文本消息编码为带掩码的客户端帧
+    static std::string encodeClientFrame(const std::string& payload,
+                                         websocketpp::frame::opcode::value opcode =
+                                             websocketpp::frame::opcode::text);
+
+    server_type& server() { return m_server; }
+
+private:
+    struct Connection;
+
+    Connection& connectionAt(size_t connection);
+
+    server_type m_server;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+};
+
+#endif  // IN_PROCESS_SERVER_H
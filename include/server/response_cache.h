@@ -0,0 +1,56 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 一个连接上有副作用的请求的最终响应，键为requestId
+// 客户端等待超时后用同一requestId重发请求时，服务器返回已缓存的最终响应（或仍在处理中），
+// 而不是再测量一次。按收到请求的先后淘汰：最多保留kDefaultCapacity条，收到请求kDefaultTtl后过期
+// 线程安全
+class ResponseCache {
+public:
+    static constexpr size_t kDefaultCapacity = 64;
+    static constexpr std::chrono::minutes kDefaultTtl{5};
+
+    enum class Lookup {
+        Miss,        // 新请求，已登记为处理中，按正常流程执行
+        InProgress,  // 同一请求正在处理，最终响应发出后客户端会收到
+        Done,        // 已有最终响应，见response
+    };
+
+    explicit ResponseCache(size_t capacity = kDefaultCapacity,
+                           std::chrono::steady_clock::duration ttl = kDefaultTtl);
+
+    // 查找请求，未缓存时登记为处理中；requestId相同但命令不同时视为新请求，不登记
+    Lookup begin(const std::string& requestId, const std::string& command, std::string& response);
+    // 记录最终响应，只对登记为处理中的请求生效
+    void complete(const std::string& requestId,
+                  const std::string& command,
+                  const std::string& response);
+
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::string command;
+        std::string response;
+        bool done = false;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    // 淘汰过期与超出容量的条目，调用时持有m_mutex
+    void evict(std::chrono::steady_clock::time_point now);
+
+    size_t m_capacity;
+    std::chrono::steady_clock::duration m_ttl;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::deque<std::string> m_order;  // 按收到请求的先后
+};
+
+#endif  // RESPONSE_CACHE_H
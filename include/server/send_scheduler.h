@@ -0,0 +1,225 @@
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#define ASIO_STANDALONE
+#define _WEBSOCKETPP_CPP11_STL_
+
+#include <websocketpp/frame.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 发送优先级，数值越小越先发送
+enum class SendPriority : uint8_t {
+    Control = 0,  // 命令响应
+    Event = 1,    // 设备事件
+    Stream = 2,   // 视频流帧、快照图像与共享内存槽位通知
+    Bulk = 3,     // 面形数据等大块数据
+};
+
+// 单个连接的发送调度器
+// websocketpp把连接上排队的所有消息合并为一次写出，排在数MB数据之后的命令响应要等它们全部写完。
+// 调度器按优先级排队，命令响应立即交给websocketpp；其他消息只在已交出但尚未写完的字节数
+// 低于窗口时才交出，因此命令响应之前最多只有一个窗口（加一条消息）的数据。
+// 大块数据由调用方切成分段消息（splitIntoChunks）后逐段排队，命令响应可以插在段与段之间。
+// 写完的判断：窗口内的消息由调度器预先组帧（服务端帧不加掩码），websocketpp写完释放消息时回调
+// 任意线程都可以调用send，同一时间只有一个线程向websocketpp交出消息，同一优先级保持先后顺序
+template <typename Server>
+class SendScheduler : public std::enable_shared_from_this<SendScheduler<Server>> {
+public:
+    typedef typename Server::message_ptr message_ptr;
+    typedef typename message_ptr::element_type message_type;
+
+    static constexpr size_t kPriorityCount = 4;
+    static constexpr size_t kDefaultWindow = 256 * 1024;
+
+    SendScheduler(Server& server, websocketpp::connection_hdl hdl, size_t window = kDefaultWindow)
+        : m_server(server), m_hdl(hdl), m_window(window) {}
+
+    // 排队发送一条消息，连接已关闭时返回false
+    bool send(SendPriority priority, std::string payload, websocketpp::frame::opcode::value op) {
+        std::vector<std::string> payloads;
+        payloads.push_back(std::move(payload));
+        return send(priority, std::move(payloads), op);
+    }
+
+    // 排队发送多条消息（如一条大消息的各个分段），它们之间不会插入同一优先级的其他消息
+    bool send(SendPriority priority,
+              std::vector<std::string> payloads,
+              websocketpp::frame::opcode::value op) {
+        websocketpp::lib::error_code ec;
+        auto con = m_server.get_con_from_hdl(m_hdl, ec);
+        if (ec) {
+            return false;
+        }
+        std::vector<Item> items;
+        for (std::string& payload : payloads) {
+            Item item;
+            item.size = payload.size();
+            if (priority == SendPriority::Control) {
+                // 不受窗口限制，使用连接的消息管理器（可复用的消息对象），由websocketpp组帧
+                item.msg = con->get_message(op, payload.size());
+                item.msg->get_raw_payload().swap(payload);
+            } else {
+                item.msg = prepare(std::move(payload), op);
+            }
+            items.push_back(std::move(item));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed) {
+                return false;
+            }
+            std::deque<Item>& queue = m_queues[static_cast<size_t>(priority)];
+            for (Item& item : items) {
+                m_queued_bytes[static_cast<size_t>(priority)] += item.size;
+                queue.push_back(std::move(item));
+            }
+        }
+        pump();
+        return true;
+    }
+
+    // 新的priority级消息之前还要写出的字节数：已交出未写完的字节加上同级及更高级排队的字节
+    size_t backlog(SendPriority priority) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = inflightBytes();
+        for (size_t i = 0; i <= static_cast<size_t>(priority); i++) {
+            bytes += m_queued_bytes[i];
+        }
+        return bytes;
+    }
+
+    // 排队中（尚未交给websocketpp）的字节数
+    size_t queuedBytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = 0;
+        for (size_t queued : m_queued_bytes) {
+            bytes += queued;
+        }
+        return bytes;
+    }
+
+    // 连接关闭：丢弃排队的消息，之后的send返回false
+    void close() {
+        // 丢弃的消息在解锁后析构（先于lock声明），析构回调需要加锁
+        std::vector<Item> dropped;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        for (size_t i = 0; i < kPriorityCount; i++) {
+            for (Item& item : m_queues[i]) {
+                dropped.push_back(std::move(item));
+            }
+            m_queues[i].clear();
+            m_queued_bytes[i] = 0;
+        }
+    }
+
+private:
+    struct Item {
+        message_ptr msg;
+        size_t size = 0;
+    };
+
+    // 预先组帧的消息，websocketpp写完（或排队时被丢弃）后释放，释放时从窗口内字节数中扣除
+    message_ptr prepare(std::string payload, websocketpp::frame::opcode::value op) {
+        size_t size = payload.size();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_windowed_bytes += size;
+        }
+        std::weak_ptr<SendScheduler> self = this->shared_from_this();
+        message_ptr msg(new message_type(nullptr, op, 0), [self, size](message_type* released) {
+            delete released;
+            if (std::shared_ptr<SendScheduler> scheduler = self.lock()) {
+                scheduler->onWritten(size);
+            }
+        });
+        msg->get_raw_payload().swap(payload);
+        websocketpp::frame::basic_header header(op, size, true, false);
+        websocketpp::frame::extended_header extended(size);
+        msg->set_header(websocketpp::frame::prepare_header(header, extended));
+        msg->set_prepared(true);
+        return msg;
+    }
+
+    // 已交给websocketpp、尚未写完的字节数，调用时持有m_mutex
+    size_t inflightBytes() const {
+        size_t queued = 0;
+        for (size_t i = static_cast<size_t>(SendPriority::Control) + 1; i < kPriorityCount; i++) {
+            queued += m_queued_bytes[i];
+        }
+        return m_windowed_bytes - queued;
+    }
+
+    void onWritten(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_windowed_bytes -= size;
+        }
+        pump();
+    }
+
+    // 按优先级交出可以发送的消息；已有线程在交出时直接返回，由它继续处理新排队的消息
+    void pump() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_pumping) {
+            return;
+        }
+        m_pumping = true;
+        for (;;) {
+            std::deque<Item>* queue = nullptr;
+            size_t priority = 0;
+            for (; priority < kPriorityCount; priority++) {
+                if (m_queues[priority].empty()) {
+                    continue;
+                }
+                if (priority == static_cast<size_t>(SendPriority::Control) ||
+                    inflightBytes() < m_window) {
+                    queue = &m_queues[priority];
+                }
+                break;
+            }
+            if (!queue) {
+                break;
+            }
+            Item item = std::move(queue->front());
+            queue->pop_front();
+            m_queued_bytes[priority] -= item.size;
+
+            // websocketpp的send可能同步释放消息（连接已关闭），释放回调需要加锁
+            lock.unlock();
+            websocketpp::lib::error_code ec;
+            auto con = m_server.get_con_from_hdl(m_hdl, ec);
+            if (!ec) {
+                ec = con->send(item.msg);
+            }
+            item.msg.reset();
+            lock.lock();
+            if (ec) {
+                m_pumping = false;
+                lock.unlock();
+                close();
+                return;
+            }
+        }
+        m_pumping = false;
+    }
+
+    Server& m_server;
+    websocketpp::connection_hdl m_hdl;
+    size_t m_window;
+
+    mutable std::mutex m_mutex;
+    std::deque<Item> m_queues[kPriorityCount];
+    size_t m_queued_bytes[kPriorityCount] = {};
+    size_t m_windowed_bytes = 0;  // 尚未释放的预先组帧消息（排队中与已交出未写完）的字节数
+    bool m_pumping = false;
+    bool m_closed = false;
+};
+
+#endif  // SEND_SCHEDULER_H
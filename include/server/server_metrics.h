@@ -0,0 +1,144 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include "command_types.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// HDR风格的对数-线性延迟直方图（单位：微秒）
+// 每个2的幂区间再线性细分为32个子桶，相对误差约3%
+// 每个直方图只允许一个线程写入，其他线程可以随时读取
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr uint64_t kSubBucketCount = 1ull << kSubBucketBits;
+    static constexpr int kMaxShift = 32;  // 可记录的最大值约为 2^38 微秒（约76小时）
+    static constexpr size_t kBucketCount = (kMaxShift + 2) * kSubBucketCount;
+
+    // 记录一个延迟值（仅限所属线程调用）
+    void record(uint64_t micros);
+
+    // 桶索引与数值区间的换算
+    static size_t bucketIndex(uint64_t micros);
+    static uint64_t bucketUpperBound(size_t index);
+
+    std::atomic<uint64_t> m_buckets[kBucketCount] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// 合并多个线程直方图后的只读快照
+struct LatencySnapshot {
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(LatencyHistogram::kBucketCount, 0);
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void merge(const LatencyHistogram& histogram);
+    // 返回百分位对应的延迟（微秒），percentile取值范围 [0, 100]
+    uint64_t percentile(double percentile) const;
+    // 返回不大于bound的样本数量，用于导出Prometheus累计桶
+    // 样本按所在桶的上界计，分辨率约3%：上界超过bound的桶不计入
+    uint64_t countAtOrBelow(uint64_t bound) const;
+    json toJson() const;
+};
+
+// 服务器运行指标
+// 计数器按线程分片保存，写入端无锁且没有原子读改写操作，读取端汇总所有分片
+class ServerMetrics {
+public:
+    static constexpr size_t kCommandCount = static_cast<size_t>(CommandType::Unknown) + 1;
+
+    ServerMetrics();
+
+    // 请求统计
+    void recordRequest(CommandType type);
+    void recordError(CommandType type);
+    void recordTimeout(CommandType type);
+    void recordLatency(CommandType type, std::chrono::steady_clock::duration latency);
+
+    // 流量统计
+    void addBytesIn(size_t bytes);
+    void addBytesOut(size_t bytes);
+
+    // 连接统计
+    void connectionOpened();
+    void connectionClosed();
+
+    // 视频流帧统计
+    void recordFrameSent();
+    void recordFrameDropped();
+
+    // 设备事件统计，被同一主题的新事件替换而未发送的计为合并
+    void recordEventSent();
+    void recordEventCoalesced();
+
+    // 测量请求并入了参数相同的排队中或刚开始的测量，没有单独采集
+    void recordMeasurementCoalesced();
+
+    // 客户端重发的请求，返回了缓存的响应或处理中状态，没有重新执行
+    void recordRequestReplayed();
+
+    // 导出为getServerMetrics命令的data字段
+    json toJson() const;
+    // 导出为Prometheus文本格式
+    std::string toPrometheus() const;
+
+private:
+    // 单个线程独占的计数分片
+    struct Shard {
+        std::atomic<uint64_t> requests[kCommandCount] = {};
+        std::atomic<uint64_t> errors[kCommandCount] = {};
+        std::atomic<uint64_t> timeouts[kCommandCount] = {};
+        LatencyHistogram latency[kCommandCount];
+        std::atomic<uint64_t> bytesIn{0};
+        std::atomic<uint64_t> bytesOut{0};
+        std::atomic<uint64_t> framesSent{0};
+        std::atomic<uint64_t> framesDropped{0};
+        std::atomic<uint64_t> eventsSent{0};
+        std::atomic<uint64_t> eventsCoalesced{0};
+        std::atomic<uint64_t> measurementsCoalesced{0};
+        std::atomic<uint64_t> requestsReplayed{0};
+    };
+
+    // 分片池，线程退出后其分片会归还给池子供后续线程复用（计数保持累计）
+    struct ShardPool {
+        uint64_t id = 0;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::vector<Shard*> freeShards;
+    };
+
+    struct ShardLease;
+
+    Shard& localShard();
+
+    // 汇总后的计数
+    struct Totals {
+        uint64_t requests[kCommandCount] = {};
+        uint64_t errors[kCommandCount] = {};
+        uint64_t timeouts[kCommandCount] = {};
+        LatencySnapshot latency[kCommandCount];
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        uint64_t framesSent = 0;
+        uint64_t framesDropped = 0;
+        uint64_t eventsSent = 0;
+        uint64_t eventsCoalesced = 0;
+        uint64_t measurementsCoalesced = 0;
+        uint64_t requestsReplayed = 0;
+    };
+    Totals collect() const;
+
+    std::shared_ptr<ShardPool> m_pool;
+    std::atomic<int64_t> m_active_connections{0};
+    std::chrono::steady_clock::time_point m_start_time;
+};
+
+#endif  // SERVER_METRICS_H
@@ -0,0 +1,79 @@
+#ifndef SESSION_REGISTRY_H
+#define SESSION_REGISTRY_H
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 按连接索引的会话表
+// 键为连接对象的地址（connection_hdl.lock().get()），查找、插入、删除均为哈希表上的O(1)操作；
+// 会话指针连续存放在数组中，广播时顺序遍历，不必逐个比较weak_ptr的控制块
+// 删除时用最后一个元素填补空位，遍历顺序不稳定
+// 非线程安全，由调用方加锁
+template <typename Session>
+class SessionRegistry {
+public:
+    typedef std::shared_ptr<Session> SessionPtr;
+    typedef typename std::vector<SessionPtr>::const_iterator const_iterator;
+
+    // 键已存在时返回false，保留原会话
+    bool insert(const void* key, SessionPtr session) {
+        if (!m_index.emplace(key, m_sessions.size()).second) {
+            return false;
+        }
+        m_sessions.push_back(std::move(session));
+        m_keys.push_back(key);
+        return true;
+    }
+
+    // 返回被删除的会话，键不存在时返回空指针
+    SessionPtr erase(const void* key) {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            return SessionPtr();
+        }
+        size_t slot = it->second;
+        m_index.erase(it);
+        SessionPtr removed = std::move(m_sessions[slot]);
+        size_t last = m_sessions.size() - 1;
+        if (slot != last) {
+            m_sessions[slot] = std::move(m_sessions[last]);
+            m_keys[slot] = m_keys[last];
+            m_index[m_keys[slot]] = slot;
+        }
+        m_sessions.pop_back();
+        m_keys.pop_back();
+        return removed;
+    }
+
+    // 键不存在时返回空指针
+    Session* find(const void* key) const {
+        auto it = m_index.find(key);
+        return it == m_index.end() ? nullptr : m_sessions[it->second].get();
+    }
+    SessionPtr get(const void* key) const {
+        auto it = m_index.find(key);
+        return it == m_index.end() ? SessionPtr() : m_sessions[it->second];
+    }
+    bool contains(const void* key) const { return m_index.count(key) > 0; }
+
+    size_t size() const { return m_sessions.size(); }
+    bool empty() const { return m_sessions.empty(); }
+    void reserve(size_t count) {
+        m_index.reserve(count);
+        m_sessions.reserve(count);
+        m_keys.reserve(count);
+    }
+
+    const_iterator begin() const { return m_sessions.begin(); }
+    const_iterator end() const { return m_sessions.end(); }
+
+private:
+    std::unordered_map<const void*, size_t> m_index;  // 键 -> m_sessions中的位置
+    std::vector<SessionPtr> m_sessions;
+    std::vector<const void*> m_keys;  // 与m_sessions一一对应，移动元素时更新索引
+};
+
+#endif  // SESSION_REGISTRY_H
@@ -0,0 +1,64 @@
+#ifndef SHARED_DEVICE_STATE_H
+#define SHARED_DEVICE_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// 多个工作进程共享的设备状态（server --workers模式）
+// 监管进程在fork之前创建匿名共享映射，工作进程继承同一段内存，每台设备一个槽位：
+// - 观察模式与校准状态为设备级状态，任一工作进程修改后其他工作进程都能看到
+// - 取流与测量标志按工作进程分别保存，设备状态为所有工作进程的"或"
+// 槽位由进程间自旋锁保护，锁字保存持有者的pid，持有者崩溃时由监管进程释放
+// 仅POSIX平台，其他平台create()返回空指针
+struct SharedDeviceStatus {
+    std::string alignViewMode;
+    bool isCalibrated = false;
+    bool isStreaming = false;  // 任一工作进程正在取流
+    bool isMeasuring = false;  // 任一工作进程正在测量
+    uint64_t version = 0;      // 槽位内容每变化一次加1
+};
+
+class SharedDeviceState {
+public:
+    static constexpr size_t kMaxWorkers = 64;
+    static constexpr size_t kModeLength = 16;
+
+    // 创建deviceCount个槽位，初始为continuous、未校准；失败时返回空指针
+    static std::shared_ptr<SharedDeviceState> create(size_t deviceCount);
+    ~SharedDeviceState();
+
+    size_t deviceCount() const { return m_device_count; }
+
+    // 槽位当前版本，无需加锁，用于发现其他工作进程的修改
+    uint64_t version(size_t device) const;
+
+    // 写入本工作进程的变化并读取合并后的状态
+    // mode/calibrated为空指针时保留共享段中的值；worker的取流/测量标志总是写入
+    void update(size_t device,
+                size_t worker,
+                const std::string* mode,
+                const bool* calibrated,
+                bool streaming,
+                bool measuring,
+                SharedDeviceStatus& status);
+
+    // 工作进程退出后清除其取流/测量标志，并释放它持有的锁（由监管进程调用）
+    void releaseWorker(size_t worker, int pid);
+
+    SharedDeviceState(const SharedDeviceState&) = delete;
+    SharedDeviceState& operator=(const SharedDeviceState&) = delete;
+
+private:
+    struct Slot;
+
+    SharedDeviceState(void* memory, size_t bytes, size_t deviceCount);
+    Slot& slot(size_t device) const;
+
+    void* m_memory;
+    size_t m_bytes;
+    size_t m_device_count;
+};
+
+#endif  // SHARED_DEVICE_STATE_H
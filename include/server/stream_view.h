@@ -0,0 +1,64 @@
+#ifndef STREAM_VIEW_H
+#define STREAM_VIEW_H
+
+#include "command_types.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 订阅者请求的图像视图：像素格式、感兴趣区域(ROI)与抽样倍率
+struct StreamView {
+    static constexpr unsigned kMaxDecimation = 16;
+
+    uint8_t pixelFormat = 0;  // BinaryFormat，0表示使用原始格式
+    // ROI，宽高为0表示整幅图像；超出图像的部分在每帧按实际分辨率裁剪
+    uint16_t roiX = 0;
+    uint16_t roiY = 0;
+    uint16_t roiWidth = 0;
+    uint16_t roiHeight = 0;
+    uint8_t decimation = 1;  // 每decimation x decimation个像素区域平均为1个像素
+
+    bool operator<(const StreamView& other) const;
+
+    // 按原始图像尺寸计算ROI裁剪后的区域与输出尺寸
+    void resolve(unsigned sourceWidth,
+                 unsigned sourceHeight,
+                 unsigned& x,
+                 unsigned& y,
+                 unsigned& width,
+                 unsigned& height,
+                 unsigned& factor) const;
+    // 输出图像尺寸
+    void outputSize(unsigned sourceWidth,
+                    unsigned sourceHeight,
+                    unsigned& width,
+                    unsigned& height) const;
+};
+
+// 解析startStream的format/roi/decimation参数，失败时返回false并给出错误信息
+bool parseStreamView(const json& params, StreamView& view, std::string& error);
+
+// 一帧图像的各视图版本
+// 每帧对每种被请求的视图只生成一次，请求相同视图的订阅者共享同一份结果
+// 先在原始格式上裁剪ROI，再在目标格式对应的8位格式上区域平均抽样，最后扩展位深
+class StreamViewCache {
+public:
+    // 开始新的一帧，source为原始帧（含数据头）
+    void reset(std::string* source);
+
+    // 获取指定视图的帧（含数据头）
+    std::string& get(const StreamView& view);
+
+private:
+    struct Entry {
+        bool valid = false;
+        std::string frame;  // 跨帧复用缓冲，避免每帧重新分配
+    };
+
+    std::string* m_source = nullptr;
+    std::map<StreamView, Entry> m_entries;
+    std::vector<uint8_t> m_scratch[2];
+};
+
+#endif  // STREAM_VIEW_H
@@ -0,0 +1,72 @@
+#ifndef SURFACE_ANALYSIS_H
+#define SURFACE_ANALYSIS_H
+
+#include "command_types.h"
+#include "surface_engine.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 面形统计与Zernike拟合，客户端只需要PV/RMS等汇总数字时无需下载整幅面形
+// 统计量与最小二乘法方程按行分块并行累加，行内循环可被编译器向量化
+
+// getSurfaceSummary的参数
+struct SurfaceSummaryOptions {
+    static constexpr unsigned kMaxZernikeTerms = 36;
+
+    unsigned zernikeTerms = 9;  // 拟合的Fringe Zernike项数（Z1起）
+    // 计算残差PV/RMS前去除的项
+    bool removePiston = true;  // Z1
+    bool removeTilt = true;    // Z2、Z3
+    bool removePower = false;  // Z4
+
+    // 实际拟合的项数（至少覆盖需要去除的项）
+    unsigned fittedTerms() const;
+    // 缓存键，参数相同的请求共享计算结果
+    std::string cacheKey() const;
+};
+
+// 解析getSurfaceSummary的zernikeTerms/remove参数，失败时返回false并给出错误信息
+bool parseSurfaceSummaryOptions(const json& params,
+                                SurfaceSummaryOptions& options,
+                                std::string& error);
+
+// 孔径：有效像素的质心与最远有效像素的距离（像素），Zernike在该单位圆上定义
+struct SurfacePupil {
+    double centerX = 0;
+    double centerY = 0;
+    double radius = 0;
+};
+
+struct SurfaceSummary {
+    size_t validPixels = 0;
+    double pv = 0;   // 峰谷值(nm)
+    double rms = 0;  // 均方根(nm)，相对于平均值
+    // 去除指定项之后的残差
+    double residualPv = 0;
+    double residualRms = 0;
+    SurfacePupil pupil;
+    std::vector<double> zernike;  // Fringe Zernike系数Z1..Zn(nm)，未归一化（边缘处|Zj| = 1）
+};
+
+// Fringe Zernike第index项（1起，不超过kMaxZernikeTerms）在单位圆内(x, y)处的值
+double fringeZernike(unsigned index, double x, double y);
+
+// 计算面形汇总，有效像素不足以拟合时返回false
+bool summarizeSurface(const SurfaceMap& map,
+                      const SurfaceSummaryOptions& options,
+                      SurfaceSummary& summary);
+
+// 面形金字塔，用于先发送低分辨率预览再发送完整面形
+// 每级由上一级按kPyramidFactor x kPyramidFactor区域平均降采样（只平均有效像素，全部无效时为NaN）
+// 边长不能整除时最后一行/列的区域不完整，短边小于kPyramidMinSide时不再继续降采样
+const unsigned kPyramidFactor = 4;
+const unsigned kPyramidMinSide = 32;
+
+// 按factor降采样一级，输出尺寸向上取整
+void downsampleSurface(const SurfaceMap& source, unsigned factor, SurfaceMap& target);
+
+// 构建map之下的各级，levels[0]为1/kPyramidFactor尺寸，逐级变小；map本身过小时levels为空
+void buildSurfacePyramid(const SurfaceMap& map, std::vector<SurfaceMap>& levels);
+
+#endif  // SURFACE_ANALYSIS_H
@@ -0,0 +1,104 @@
+#ifndef SURFACE_ENGINE_H
+#define SURFACE_ENGINE_H
+
+#include "command_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 模拟相移干涉测量：按测试面形生成N幅相移干涉图，再经相位提取与二维相位解包裹重建面形
+// 各步骤按行分块在线程池中并行，行内循环写成无分支形式以便编译器向量化
+
+// 测量参数，面形为圆形孔径内的Fringe Zernike项之和（单位：波长）
+struct SurfaceParams {
+    static constexpr unsigned kMinSize = 16;
+    static constexpr unsigned kMaxSize = 4096;
+    static constexpr unsigned kMinSteps = 3;
+    static constexpr unsigned kMaxSteps = 16;
+    static constexpr unsigned kMaxAverageCount = 64;
+
+    uint16_t width = 1024;
+    uint16_t height = 1024;
+    uint8_t steps = 4;          // 相移步数，相邻两幅干涉图相移2π/steps
+    double wavelength = 632.8;  // 光源波长(nm)
+    double noise = 0.01;        // 干涉图强度噪声，相对于条纹调制幅度
+    uint8_t averageCount = 1;   // 连续测量次数，结果为逐像素平均
+    bool variance = false;      // 多次测量时是否保留逐像素方差
+    // 面形（波前）系数，单位为波长
+    double tiltX = 1.5;         // Z2: x
+    double tiltY = -0.8;        // Z3: y
+    double power = 3.0;         // Z4: 2ρ²-1
+    double astigmatism = 0.6;   // Z5: ρ²cos2θ
+    double coma = 0.4;          // Z7: (3ρ²-2)ρcosθ
+    double spherical = 0.3;     // Z9: 6ρ⁴-6ρ²+1
+};
+
+// 解析executeMeasure的参数，缺省项使用默认值，失败时返回false并给出错误信息
+bool parseSurfaceParams(const json& params, SurfaceParams& surface, std::string& error);
+// 两组测量参数是否完全相同，相同时一次采集的结果可以同时作为两个请求的结果
+bool sameSurfaceParams(const SurfaceParams& a, const SurfaceParams& b);
+
+// 面形数据，按行存储
+struct SurfaceMap {
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::vector<double> heights;  // 面形高度(nm)，已去除平均值；孔径外与调制度不足的像素为NaN
+    size_t validPixels = 0;
+};
+
+// 各步骤耗时(毫秒)
+struct SurfaceTimings {
+    double synthesizeMs = 0;
+    double phaseMs = 0;
+    double unwrapMs = 0;
+};
+
+// 多次测量的逐像素平均，Welford算法在原地更新均值与M2，内存与测量次数无关
+// 每个像素只统计该像素有效的样本，按行分块并行，行内循环无分支可被编译器向量化
+class SurfaceAccumulator {
+public:
+    // 清空并按尺寸分配缓冲，尺寸不变时复用上次的内存
+    void reset(uint16_t width, uint16_t height);
+    // 累加一次测量，尺寸必须与reset时一致
+    void add(const SurfaceMap& map);
+    // 平均面形，没有有效样本的像素为NaN
+    void mean(SurfaceMap& map) const;
+    // 逐像素样本方差(nm²)，有效样本少于2个的像素为NaN
+    void variance(SurfaceMap& map) const;
+
+    unsigned samples() const { return m_samples; }
+
+private:
+    uint16_t m_width = 0;
+    uint16_t m_height = 0;
+    unsigned m_samples = 0;
+    std::vector<double> m_mean;
+    std::vector<double> m_m2;     // 与均值之差的平方和
+    std::vector<double> m_count;  // 有效样本数，用double避免循环中的类型转换
+};
+
+// 测量引擎，在多次测量之间复用中间缓冲；同一实例不能被多个线程同时使用
+class SurfaceEngine {
+public:
+    // 完整测量流程，seed决定干涉图噪声
+    void measure(const SurfaceParams& params,
+                 uint32_t seed,
+                 SurfaceMap& map,
+                 SurfaceTimings* timings = nullptr);
+
+    // 以下为各步骤，供基准测试单独调用
+    // 生成steps幅12位干涉图（孔径外没有条纹）
+    void synthesize(const SurfaceParams& params, uint32_t seed);
+    // N步最小二乘相位提取，得到(-π, π]内的包裹相位，调制度不足的像素为NaN
+    void extractPhase();
+    // 相位解包裹并换算为面形高度
+    void unwrap(SurfaceMap& map);
+
+private:
+    SurfaceParams m_params;
+    std::vector<uint16_t> m_frames;  // steps幅干涉图依次存放
+    std::vector<float> m_wrapped;    // 包裹相位
+};
+
+#endif  // SURFACE_ENGINE_H
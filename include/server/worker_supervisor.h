@@ -0,0 +1,26 @@
+#ifndef WORKER_SUPERVISOR_H
+#define WORKER_SUPERVISOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+// 工作进程监管（server --workers模式，仅POSIX平台）
+// fork出count个工作进程，在子进程中调用worker(index)，返回值作为子进程的退出码；
+// 工作进程崩溃或异常退出时按退避时间重启（同一编号），正常退出（退出码0）时不再重启
+// 监管进程收到SIGINT/SIGTERM时向所有工作进程发送SIGTERM并等待其退出
+// 必须在创建任何线程之前调用（fork只复制调用线程）
+struct WorkerSupervisorOptions {
+    std::chrono::milliseconds initialBackoff{500};  // 第一次重启前的等待时间，连续崩溃时加倍
+    std::chrono::milliseconds maxBackoff{30000};
+    std::chrono::seconds stableAfter{60};  // 运行超过该时间后再崩溃时退避时间重新计算
+};
+
+// onExit(index, pid)在监管进程中于工作进程退出后调用，用于清理其共享状态
+// 返回监管进程的退出码，不支持的平台返回1
+int runWorkerSupervisor(size_t count,
+                        const std::function<int(size_t)>& worker,
+                        const std::function<void(size_t, int)>& onExit,
+                        const WorkerSupervisorOptions& options = WorkerSupervisorOptions());
+
+#endif  // WORKER_SUPERVISOR_H
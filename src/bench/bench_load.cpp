@@ -0,0 +1,723 @@
+// 设备服务器负载生成器
+// 建立K个命令连接按配置的命令组合发送请求（固定速率或闭环），另可建立S个取流连接统计帧率、
+// 抖动与丢帧，结果以JSON输出，便于回归对比
+// --idle N在压测前另外建立N个不发送请求的空闲连接，报告服务器每个连接的常驻内存，
+// --max-idle-bytes给出每连接内存的上限，超过时以非0退出（ctest的idle_connections测试）
+#define ASIO_STANDALONE
+#define _WEBSOCKETPP_CPP11_STL_
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <nlohmann/json.hpp>
+#include "binary_header.h"
+#include "endpoint_config.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+typedef websocketpp::client<DeviceClientConfig> websocket_client;
+typedef DeviceClientConfig::message_type::ptr message_ptr;
+typedef websocketpp::connection_hdl connection_hdl;
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+struct Options {
+    std::string uri = "ws://localhost:9002";
+    int connections = 4;       // 命令连接数
+    int streams = 0;           // 取流连接数
+    int idle = 0;              // 空闲连接数
+    double maxIdleBytes = 0;   // 服务器每个空闲连接的常驻内存上限（字节），0为不检查
+    double durationSec = 10;   // 压测时长
+    double rate = 0;           // 所有命令连接的总请求速率（次/秒），0表示闭环模式
+    int depth = 1;             // 闭环模式下每个连接同时在途的请求数
+    std::vector<std::pair<std::string, double>> mix = {{"getMeasureStatus", 1.0}};
+    std::string output;        // 输出文件，为空时输出到标准输出
+    int64_t chunkSize = 0;     // getSurfaceData请求的分段长度，0为不分段
+    SocketOptions socket;      // 各连接的套接字选项
+    size_t maxMessageSize = 0;  // 0为endpoint配置的默认值
+};
+
+// 单个命令的统计
+struct CommandStats {
+    uint64_t sent = 0;
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    std::vector<uint32_t> latencyUs;
+};
+
+// 在途请求
+struct Outstanding {
+    std::string command;
+    Clock::time_point start;  // 固定速率模式下为计划发送时间，避免协调遗漏
+};
+
+// 每个连接的状态，只在IO线程中访问
+struct Connection {
+    connection_hdl hdl;
+    int index = 0;
+    bool stream = false;
+    bool open = false;
+    uint64_t nextSeq = 0;
+    std::map<std::string, Outstanding> outstanding;
+
+    // 取流统计
+    double nominalFps = 0;
+    uint64_t frames = 0;
+    uint64_t frameBytes = 0;
+    uint64_t malformedFrames = 0;
+    Clock::time_point firstFrame;
+    Clock::time_point lastFrame;
+    std::vector<uint32_t> intervalsUs;
+};
+
+uint64_t percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+json latencyJson(std::vector<uint32_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (uint32_t value : samples) {
+        sum += value;
+    }
+    return {{"count", samples.size()},
+            {"meanUs", samples.empty() ? 0.0 : sum / samples.size()},
+            {"p50Us", percentile(samples, 50)},
+            {"p99Us", percentile(samples, 99)},
+            {"p999Us", percentile(samples, 99.9)},
+            {"maxUs", samples.empty() ? 0 : samples.back()}};
+}
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const Options& options)
+        : m_options(options),
+          m_random(12345) {
+        m_client.init_asio();
+        if (m_options.maxMessageSize > 0) {
+            m_client.set_max_message_size(m_options.maxMessageSize);
+        }
+        m_client.set_tcp_pre_init_handler([this](connection_hdl hdl) {
+            websocketpp::lib::error_code ec;
+            websocket_client::connection_ptr con = m_client.get_con_from_hdl(hdl, ec);
+            if (!ec) {
+                applySocketOptions(con->get_raw_socket(), m_options.socket);
+            }
+        });
+        m_timer.reset(new asio::steady_timer(m_client.get_io_service()));
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.clear_error_channels(websocketpp::log::elevel::all);
+
+        double total = 0;
+        for (auto& entry : m_options.mix) {
+            total += entry.second;
+            m_mix_cdf.push_back(total);
+            m_stats[entry.first];
+        }
+        for (double& value : m_mix_cdf) {
+            value /= total;
+        }
+    }
+
+    // 执行压测并返回JSON结果
+    json run() {
+        int total = m_options.connections + m_options.streams;
+        for (int i = 0; i < total; i++) {
+            if (!openConnection(i, i >= m_options.connections, m_connections)) {
+                return {{"error", "failed to create connection"}};
+            }
+        }
+
+        // 保持IO线程运行，直到压测结束时关闭所有连接
+        m_client.start_perpetual();
+        std::thread io([this]() { m_client.run(); });
+
+        // 等待所有连接建立
+        if (!waitForOpen(total)) {
+            postAndWait([this]() { return closeAll(); });
+            io.join();
+            return {{"error", "failed to establish connections"}};
+        }
+
+        // 建立空闲连接，前后各取一次服务器的常驻内存
+        if (m_options.idle > 0) {
+            uint64_t before = serverResidentBytes();
+            auto openStart = Clock::now();
+            for (int opened = 0; opened < m_options.idle;) {
+                int batch = std::min(kIdleBatch, m_options.idle - opened);
+                postAndWait([this, total, opened, batch]() {
+                    for (int i = 0; i < batch; i++) {
+                        openConnection(total + opened + i, false, m_idle_connections);
+                    }
+                    return true;
+                });
+                opened += batch;
+                if (!waitForOpen(total + opened)) {
+                    postAndWait([this]() { return closeAll(); });
+                    io.join();
+                    return {{"error", "failed to establish idle connections"}};
+                }
+            }
+            double openSec = std::chrono::duration<double>(Clock::now() - openStart).count();
+            uint64_t after = serverResidentBytes();
+            double perConnection =
+                (static_cast<double>(after) - static_cast<double>(before)) / m_options.idle;
+            m_idle_report = {{"connections", m_options.idle},
+                             {"openSec", openSec},
+                             {"serverResidentBeforeBytes", before},
+                             {"serverResidentAfterBytes", after},
+                             {"serverBytesPerConnection", std::round(perConnection)}};
+        }
+
+        postAndWait([this]() { return start(); });
+        std::this_thread::sleep_for(std::chrono::duration<double>(m_options.durationSec));
+        postAndWait([this]() { return stop(); });
+
+        // 给在途请求留出收尾时间
+        auto drainDeadline = Clock::now() + std::chrono::seconds(3);
+        while (postAndWait([this]() { return outstandingCount(); }) > 0 &&
+               Clock::now() < drainDeadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        // 获取服务端指标
+        postAndWait([this]() { return requestServerMetrics(); });
+        auto metricsDeadline = Clock::now() + std::chrono::seconds(2);
+        while (!postAndWait([this]() { return !m_server_metrics.is_null(); }) &&
+               Clock::now() < metricsDeadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        json result = postAndWait([this]() { return report(); });
+        postAndWait([this]() { return closeAll(); });
+        io.join();
+        return result;
+    }
+
+private:
+    // 空闲连接每批建立的数量，不超过服务器监听队列的长度
+    static constexpr int kIdleBatch = 1000;
+
+    // 在IO线程中执行并等待结果
+    template <typename Func>
+    auto postAndWait(Func func) -> decltype(func()) {
+        auto task = std::make_shared<std::packaged_task<decltype(func())()>>(func);
+        auto future = task->get_future();
+        asio::post(m_client.get_io_service(), [task]() { (*task)(); });
+        return future.get();
+    }
+
+    // 等待已建立的连接数达到count，超时或有连接失败时返回false
+    bool waitForOpen(int count) {
+        auto deadline = Clock::now() + std::chrono::seconds(10);
+        while (postAndWait([this]() { return m_open_count; }) < count) {
+            if (Clock::now() > deadline || postAndWait([this]() { return m_failed_count; }) > 0) {
+                std::cerr << "Failed to establish all connections" << std::endl;
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    // 取一次服务器指标中的常驻内存字节数，服务器不支持时为0
+    uint64_t serverResidentBytes() {
+        postAndWait([this]() { return requestServerMetrics(); });
+        auto deadline = Clock::now() + std::chrono::seconds(2);
+        while (!postAndWait([this]() { return !m_server_metrics.is_null(); }) &&
+               Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        uint64_t bytes = postAndWait([this]() {
+            return m_server_metrics.is_object() ? m_server_metrics.value("residentBytes", 0ull)
+                                                : 0ull;
+        });
+        postAndWait([this]() {
+            m_server_metrics = json();
+            return true;
+        });
+        return bytes;
+    }
+
+    bool openConnection(int index,
+                        bool stream,
+                        std::vector<std::shared_ptr<Connection>>& connections) {
+        websocketpp::lib::error_code ec;
+        websocket_client::connection_ptr con = m_client.get_connection(m_options.uri, ec);
+        if (ec) {
+            std::cerr << "Connect initialization error: " << ec.message() << std::endl;
+            return false;
+        }
+
+        auto connection = std::make_shared<Connection>();
+        connection->index = index;
+        connection->stream = stream;
+        connection->hdl = con->get_handle();
+        connections.push_back(connection);
+
+        con->set_open_handler([this, connection](connection_hdl) {
+            connection->open = true;
+            m_open_count++;
+        });
+        con->set_close_handler([connection](connection_hdl) { connection->open = false; });
+        con->set_fail_handler([this, connection](connection_hdl) {
+            connection->open = false;
+            m_failed_count++;
+            std::cerr << "Connection " << connection->index << " failed" << std::endl;
+        });
+        con->set_message_handler([this, connection](connection_hdl, message_ptr msg) {
+            onMessage(*connection, msg);
+        });
+
+        m_client.connect(con);
+        return true;
+    }
+
+    bool start() {
+        m_start = Clock::now();
+        m_running = true;
+
+        for (auto& connection : m_connections) {
+            if (connection->stream) {
+                send(*connection, "startStream", Clock::now(), false);
+            }
+        }
+
+        if (m_options.rate > 0) {
+            // 固定速率模式：按计划时间发送，落后时补发
+            m_next_send = m_start;
+            scheduleTick();
+        } else {
+            // 闭环模式：每个连接保持depth个在途请求
+            for (auto& connection : m_connections) {
+                if (!connection->stream) {
+                    for (int i = 0; i < m_options.depth; i++) {
+                        send(*connection, pickCommand(), Clock::now(), true);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    bool stop() {
+        m_running = false;
+        m_stop = Clock::now();
+        m_timer->cancel();
+        for (auto& connection : m_connections) {
+            if (connection->stream && connection->open) {
+                send(*connection, "stopStream", Clock::now(), false);
+            }
+        }
+        return true;
+    }
+
+    size_t outstandingCount() const {
+        size_t count = 0;
+        for (auto& connection : m_connections) {
+            if (connection->open) {
+                count += connection->outstanding.size();
+            }
+        }
+        return count;
+    }
+
+    bool requestServerMetrics() {
+        for (auto& connection : m_connections) {
+            if (connection->open) {
+                send(*connection, "getServerMetrics", Clock::now(), false);
+                return true;
+            }
+        }
+        m_server_metrics = json::object();
+        return false;
+    }
+
+    bool closeAll() {
+        m_timer->cancel();
+        m_client.stop_perpetual();
+        for (auto* connections : {&m_connections, &m_idle_connections}) {
+            for (auto& connection : *connections) {
+                websocketpp::lib::error_code ec;
+                m_client.close(connection->hdl, websocketpp::close::status::normal, "", ec);
+            }
+        }
+        return true;
+    }
+
+    void scheduleTick() {
+        m_timer->expires_at(m_next_send);
+        m_timer->async_wait([this](const std::error_code& ec) {
+            if (ec || !m_running) {
+                return;
+            }
+            auto period = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / m_options.rate));
+            auto now = Clock::now();
+            while (m_next_send <= now && m_running) {
+                Connection& connection = nextRequestConnection();
+                send(connection, pickCommand(), m_next_send, true);
+                m_next_send += period;
+            }
+            scheduleTick();
+        });
+    }
+
+    Connection& nextRequestConnection() {
+        for (;;) {
+            Connection& connection = *m_connections[m_round_robin++ % m_connections.size()];
+            if (!connection.stream || m_options.connections == 0) {
+                return connection;
+            }
+        }
+    }
+
+    std::string pickCommand() {
+        double value = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+        for (size_t i = 0; i < m_mix_cdf.size(); i++) {
+            if (value <= m_mix_cdf[i]) {
+                return m_options.mix[i].first;
+            }
+        }
+        return m_options.mix.back().first;
+    }
+
+    void send(Connection& connection,
+              const std::string& command,
+              Clock::time_point start,
+              bool measured) {
+        if (!connection.open) {
+            return;
+        }
+
+        json params = json::object();
+        if (command == "setAlignViewMode") {
+            params["alignViewMode"] = "continuous";
+        } else if (command == "getSurfaceData" && m_options.chunkSize > 0) {
+            params["chunkSize"] = m_options.chunkSize;
+        }
+
+        std::string requestId =
+            "b" + std::to_string(connection.index) + "-" + std::to_string(connection.nextSeq++);
+        json request = {{"command", command}, {"requestId", requestId}, {"params", params}};
+
+        websocketpp::lib::error_code ec;
+        m_client.send(connection.hdl, request.dump(), websocketpp::frame::opcode::text, ec);
+        if (ec) {
+            return;
+        }
+
+        if (measured) {
+            m_stats[command].sent++;
+            connection.outstanding[requestId] = {command, start};
+        } else {
+            connection.outstanding[requestId] = {"", start};
+        }
+    }
+
+    void onMessage(Connection& connection, message_ptr msg) {
+        auto now = Clock::now();
+
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            onFrame(connection, msg->get_payload(), now);
+            return;
+        }
+
+        json message = json::parse(msg->get_payload(), nullptr, false);
+        if (message.is_discarded() || !message.contains("requestId")) {
+            return;
+        }
+
+        std::string status = message.value("status", "");
+        if (status == "pending") {
+            return;
+        }
+
+        auto it = connection.outstanding.find(message.value("requestId", ""));
+        if (it == connection.outstanding.end()) {
+            return;
+        }
+        Outstanding request = it->second;
+        connection.outstanding.erase(it);
+
+        std::string command = message.value("command", "");
+        if (command == "startStream" && status == "success") {
+            connection.nominalFps = message["data"].value("fps", 0.0);
+        } else if (command == "getServerMetrics" && status == "success") {
+            m_server_metrics = message["data"];
+        }
+
+        // 未计入统计的控制请求
+        if (request.command.empty()) {
+            return;
+        }
+
+        CommandStats& stats = m_stats[request.command];
+        if (status == "success") {
+            stats.completed++;
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - request.start);
+            stats.latencyUs.push_back(static_cast<uint32_t>(latency.count()));
+        } else if (status == "timeout") {
+            stats.timeouts++;
+        } else {
+            stats.errors++;
+        }
+
+        // 闭环模式下收到最终响应后立即发送下一个请求
+        if (m_running && m_options.rate <= 0) {
+            send(connection, pickCommand(), Clock::now(), true);
+        }
+    }
+
+    void onFrame(Connection& connection, const std::string& payload, Clock::time_point now) {
+        if (!m_running) {
+            return;
+        }
+
+        BinaryHeader header;
+        if (!decodeBinaryHeader(reinterpret_cast<const uint8_t*>(payload.data()),
+                                payload.size(),
+                                header)) {
+            connection.malformedFrames++;
+            return;
+        }
+
+        if (connection.frames == 0) {
+            connection.firstFrame = now;
+        } else {
+            auto interval = std::chrono::duration_cast<std::chrono::microseconds>(
+                now - connection.lastFrame);
+            connection.intervalsUs.push_back(static_cast<uint32_t>(interval.count()));
+        }
+        connection.lastFrame = now;
+        connection.frames++;
+        connection.frameBytes += payload.size();
+    }
+
+    json report() {
+        double duration = std::chrono::duration<double>(m_stop - m_start).count();
+
+        json commands = json::object();
+        for (auto& entry : m_stats) {
+            CommandStats& stats = entry.second;
+            uint64_t unanswered = stats.sent - stats.completed - stats.errors - stats.timeouts;
+            commands[entry.first] = {{"sent", stats.sent},
+                                     {"completed", stats.completed},
+                                     {"errors", stats.errors},
+                                     {"timeouts", stats.timeouts},
+                                     {"unanswered", unanswered},
+                                     {"throughputPerSec", stats.completed / duration},
+                                     {"latency", latencyJson(stats.latencyUs)}};
+        }
+
+        // 取流统计：帧率、帧间隔抖动和按标称帧率估算的丢帧数
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t malformed = 0;
+        double expected = 0;
+        double intervalSum = 0;
+        double intervalSquareSum = 0;
+        std::vector<uint32_t> intervals;
+        for (auto& connection : m_connections) {
+            if (!connection->stream) {
+                continue;
+            }
+            frames += connection->frames;
+            bytes += connection->frameBytes;
+            malformed += connection->malformedFrames;
+            expected += connection->nominalFps * duration;
+            for (uint32_t value : connection->intervalsUs) {
+                intervalSum += value;
+                intervalSquareSum += static_cast<double>(value) * value;
+            }
+            intervals.insert(intervals.end(),
+                             connection->intervalsUs.begin(),
+                             connection->intervalsUs.end());
+        }
+
+        double meanInterval = intervals.empty() ? 0 : intervalSum / intervals.size();
+        double variance =
+            intervals.empty() ? 0 : intervalSquareSum / intervals.size() - meanInterval * meanInterval;
+        json intervalJson = latencyJson(intervals);
+
+        json stream = {{"connections", m_options.streams},
+                       {"frames", frames},
+                       {"malformedFrames", malformed},
+                       {"fpsPerConnection",
+                        m_options.streams > 0 ? frames / duration / m_options.streams : 0.0},
+                       {"megabytesPerSec", bytes / duration / 1e6},
+                       {"estimatedDrops", std::max(0.0, std::round(expected - frames))},
+                       {"intervalUs", intervalJson},
+                       {"jitterStddevUs", std::sqrt(std::max(0.0, variance))}};
+
+        json mix = json::object();
+        for (auto& entry : m_options.mix) {
+            mix[entry.first] = entry.second;
+        }
+
+        return {{"config",
+                 {{"uri", m_options.uri},
+                  {"connections", m_options.connections},
+                  {"streams", m_options.streams},
+                  {"idle", m_options.idle},
+                  {"durationSec", m_options.durationSec},
+                  {"mode", m_options.rate > 0 ? "open-loop" : "closed-loop"},
+                  {"rate", m_options.rate},
+                  {"depth", m_options.depth},
+                  {"chunkSize", m_options.chunkSize},
+                  {"mix", mix}}},
+                {"measuredDurationSec", duration},
+                {"commands", commands},
+                {"stream", stream},
+                {"idle", m_idle_report},
+                {"serverMetrics", m_server_metrics}};
+    }
+
+    Options m_options;
+    websocket_client m_client;
+    std::unique_ptr<asio::steady_timer> m_timer;  // 固定速率模式的发送节拍
+    std::mt19937 m_random;
+    std::vector<double> m_mix_cdf;
+
+    std::vector<std::shared_ptr<Connection>> m_connections;
+    std::vector<std::shared_ptr<Connection>> m_idle_connections;  // 只建立连接，不发送请求
+    json m_idle_report = json::object();
+    std::map<std::string, CommandStats> m_stats;
+    json m_server_metrics;
+    int m_open_count = 0;
+    int m_failed_count = 0;
+    bool m_running = false;
+    size_t m_round_robin = 0;
+    Clock::time_point m_start;
+    Clock::time_point m_stop;
+    Clock::time_point m_next_send;
+};
+
+// 解析命令组合，例如 "getMeasureStatus:70,getAlignViewMode:30"
+bool parseMix(const std::string& text, std::vector<std::pair<std::string, double>>& mix) {
+    mix.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        std::string item = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        size_t colon = item.find(':');
+        double weight = colon == std::string::npos ? 1.0 : std::atof(item.c_str() + colon + 1);
+        if (weight <= 0) {
+            return false;
+        }
+        mix.push_back({item.substr(0, colon), weight});
+        if (end == std::string::npos) {
+            break;
+        }
+        pos = end + 1;
+    }
+    return !mix.empty();
+}
+
+void printUsage(const char* program) {
+    std::cerr << "用法: " << program << " [选项]\n"
+              << "  --uri <ws://host:port>   服务器地址 (默认 ws://localhost:9002)\n"
+              << "  --connections <K>        命令连接数 (默认 4)\n"
+              << "  --streams <S>            取流连接数 (默认 0)\n"
+              << "  --idle <N>               另外建立的空闲连接数，报告服务器每连接内存 (默认 0)\n"
+              << "  --max-idle-bytes <字节>  每个空闲连接的服务器内存上限，超过时返回非0 (默认不检查)\n"
+              << "  --duration <秒>          压测时长 (默认 10)\n"
+              << "  --rate <次/秒>           总请求速率，0为闭环模式 (默认 0)\n"
+              << "  --depth <N>              闭环模式下每连接在途请求数 (默认 1)\n"
+              << "  --mix <cmd:w,...>        命令组合及权重 (默认 getMeasureStatus:1)\n"
+              << "  --chunk-size <字节>      getSurfaceData的分段长度，0为不分段 (默认 0)\n"
+              << "  --output <file.json>     结果输出文件 (默认标准输出)\n"
+              << kSocketOptionsUsage;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        std::string error;
+        if (parseSocketOption(argc, argv, i, options.socket, options.maxMessageSize, error)) {
+            if (!error.empty()) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--uri" && hasValue) {
+            options.uri = argv[++i];
+        } else if (arg == "--connections" && hasValue) {
+            options.connections = std::atoi(argv[++i]);
+        } else if (arg == "--streams" && hasValue) {
+            options.streams = std::atoi(argv[++i]);
+        } else if (arg == "--idle" && hasValue) {
+            options.idle = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--max-idle-bytes" && hasValue) {
+            options.maxIdleBytes = std::atof(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            options.durationSec = std::atof(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::atof(argv[++i]);
+        } else if (arg == "--depth" && hasValue) {
+            options.depth = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--mix" && hasValue) {
+            if (!parseMix(argv[++i], options.mix)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--chunk-size" && hasValue) {
+            options.chunkSize = std::max<int64_t>(0, std::atoll(argv[++i]));
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.connections + options.streams <= 0 || options.durationSec <= 0 ||
+        (options.maxIdleBytes > 0 && options.idle <= 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    raiseOpenFileLimit();
+
+    LoadGenerator generator(options);
+    json result = generator.run();
+
+    // 空闲连接的内存超出上限视为失败；服务器不提供常驻内存（非Linux）时无法检查，同样失败
+    if (options.maxIdleBytes > 0 && !result.contains("error")) {
+        const json& idle = result["idle"];
+        if (idle.value("serverResidentAfterBytes", 0ull) == 0) {
+            result["error"] = "server resident memory unavailable";
+        } else if (idle.value("serverBytesPerConnection", 0.0) > options.maxIdleBytes) {
+            result["error"] = "idle connection memory exceeds --max-idle-bytes";
+        }
+    }
+
+    if (options.output.empty()) {
+        std::cout << result.dump(2) << std::endl;
+    } else {
+        std::ofstream out(options.output);
+        out << result.dump(2) << std::endl;
+    }
+
+    return result.contains("error") ? 1 : 0;
+}
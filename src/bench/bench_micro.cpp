@@ -0,0 +1,532 @@
+// 协议热点路径微基准测试
+// 每条消息都会经过的函数：信封解析、响应序列化、requestId生成与解析、命令类型转换、
+// 二进制数据头编解码，经进程内传输的完整请求分发，视频流像素转换内核（各指令集对比），
+// 以及面形重建各步骤（多线程并行）。
+// 输出每次操作的耗时(ns/op)与内存分配次数(allocs/op)
+#include "command_types.h"
+#include "time_utils.h"
+#include "binary_header.h"
+#include "in_process_server.h"
+#include "pixel_kernels.h"
+#include "session_registry.h"
+#include "surface_analysis.h"
+#include "surface_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// ---------------- 内存分配计数 ----------------
+// 替换全局operator new/delete（含对齐版本），每次分配计数一次，内存来自malloc
+// 本文件以-fno-builtin-malloc/-fno-builtin-free编译（见CMakeLists.txt），
+// 编译器不再把operator delete中的free与operator new配对检查（-Wmismatched-new-delete）
+
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+
+void* countedAlloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    size = (std::max<size_t>(size, 1) + align - 1) / align * align;  // aligned_alloc要求整数倍
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(size, align);
+#else
+    void* ptr = std::aligned_alloc(align, size);
+#endif
+    if (ptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+}  // namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+
+void* operator new[](size_t size) { return countedAlloc(size); }
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { alignedFree(ptr); }
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { alignedFree(ptr); }
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 阻止编译器把被测代码优化掉
+template <typename T>
+inline void doNotOptimize(T const& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+    uint64_t iterations = 0;
+};
+
+struct Options {
+    std::string filter;   // 只运行名称包含该字符串的测试
+    double minTimeMs = 200;  // 每轮测量的最短时间
+    int repetitions = 5;     // 测量轮数，取中位数
+    std::string json;        // JSON结果输出文件
+};
+
+// 先估算迭代次数使单轮耗时不少于minTimeMs，再测量多轮取中位数
+BenchResult runBenchmark(const Options& options,
+                         const std::string& name,
+                         const std::function<void(uint64_t)>& body) {
+    BenchResult result;
+    result.name = name;
+
+    uint64_t iterations = 1;
+    for (;;) {
+        auto start = Clock::now();
+        body(iterations);
+        double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (elapsedMs >= options.minTimeMs / 10 || iterations >= (1ull << 40)) {
+            double perOpMs = elapsedMs / iterations;
+            iterations = std::max<uint64_t>(1, static_cast<uint64_t>(options.minTimeMs / perOpMs));
+            break;
+        }
+        iterations *= 10;
+    }
+
+    std::vector<double> nsPerOp;
+    std::vector<double> allocsPerOp;
+    for (int i = 0; i < options.repetitions; i++) {
+        uint64_t allocationsBefore = g_allocations.load();
+        auto start = Clock::now();
+        body(iterations);
+        auto elapsed = Clock::now() - start;
+        uint64_t allocations = g_allocations.load() - allocationsBefore;
+
+        nsPerOp.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+        allocsPerOp.push_back(static_cast<double>(allocations) / iterations);
+    }
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    std::sort(allocsPerOp.begin(), allocsPerOp.end());
+    result.nsPerOp = nsPerOp[nsPerOp.size() / 2];
+    result.allocsPerOp = allocsPerOp[allocsPerOp.size() / 2];
+    result.iterations = iterations;
+    return result;
+}
+
+// 与DeviceServer::onMessage相同的信封解析流程
+struct Envelope {
+    std::string command;
+    std::string requestId;
+    json params;
+};
+
+bool parseEnvelope(const std::string& payload, Envelope& envelope) {
+    json message = json::parse(payload);
+    if (!message.contains("command") || !message.contains("requestId")) {
+        return false;
+    }
+    envelope.command = message["command"];
+    envelope.requestId = message["requestId"];
+    envelope.params = message.value("params", json());
+    return true;
+}
+
+// ---------------- 测试用例 ----------------
+
+struct Benchmark {
+    std::string name;
+    std::function<void(uint64_t)> body;
+};
+
+std::vector<Benchmark> makeBenchmarks() {
+    std::vector<Benchmark> benchmarks;
+
+    static const std::string kStatusRequest =
+        R"({"command":"getMeasureStatus","requestId":"20250802161054050","params":{}})";
+    static const std::string kStatusUnchangedRequest =
+        R"({"command":"getMeasureStatus","requestId":"20250802161054050",)"
+        R"("params":{"ifVersionNewerThan":1000000}})";
+    static const std::string kModeRequest =
+        R"({"command":"setAlignViewMode","requestId":"20250802161054050",)"
+        R"("params":{"alignViewMode":"align"}})";
+
+    benchmarks.push_back({"envelope_parse/getMeasureStatus", [](uint64_t n) {
+                              Envelope envelope;
+                              for (uint64_t i = 0; i < n; i++) {
+                                  doNotOptimize(parseEnvelope(kStatusRequest, envelope));
+                              }
+                          }});
+
+    benchmarks.push_back({"envelope_parse/setAlignViewMode", [](uint64_t n) {
+                              Envelope envelope;
+                              for (uint64_t i = 0; i < n; i++) {
+                                  doNotOptimize(parseEnvelope(kModeRequest, envelope));
+                              }
+                          }});
+
+    benchmarks.push_back({"response_build_dump/getMeasureStatus", [](uint64_t n) {
+                              for (uint64_t i = 0; i < n; i++) {
+                                  json deviceStatus = {{"deviceId", "DEV12345"},
+                                                       {"firmwareVersion", "2.5.1"},
+                                                       {"temperature", 36.7},
+                                                       {"uptime", 12345},
+                                                       {"alignViewMode", "continuous"},
+                                                       {"isCalibrated", false},
+                                                       {"isStreaming", false},
+                                                       {"isMeasuring", false},
+                                                       {"battery", 85}};
+                                  json response = {{"command", "getMeasureStatus"},
+                                                   {"requestId", "20250802161054050"},
+                                                   {"status", "success"},
+                                                   {"data", {{"deviceStatus", deviceStatus}}}};
+                                  std::string payload = response.dump();
+                                  doNotOptimize(payload);
+                              }
+                          }});
+
+    benchmarks.push_back({"response_dump/prebuilt", [](uint64_t n) {
+                              json response = {{"command", "stopStream"},
+                                               {"requestId", "20250802161054050"},
+                                               {"status", "success"}};
+                              for (uint64_t i = 0; i < n; i++) {
+                                  std::string payload = response.dump();
+                                  doNotOptimize(payload);
+                              }
+                          }});
+
+    benchmarks.push_back({"generateTimestampId", [](uint64_t n) {
+                              for (uint64_t i = 0; i < n; i++) {
+                                  std::string id = generateTimestampId();
+                                  doNotOptimize(id);
+                              }
+                          }});
+
+    benchmarks.push_back({"parseTimestampId", [](uint64_t n) {
+                              const std::string id = "20250802161054050";
+                              for (uint64_t i = 0; i < n; i++) {
+                                  std::string readable = parseTimestampId(id);
+                                  doNotOptimize(readable);
+                              }
+                          }});
+
+    benchmarks.push_back({"commandTypeToString", [](uint64_t n) {
+                              for (uint64_t i = 0; i < n; i++) {
+                                  auto type = static_cast<CommandType>(
+                                      i % (static_cast<uint64_t>(CommandType::Unknown) + 1));
+                                  std::string name = commandTypeToString(type);
+                                  doNotOptimize(name);
+                              }
+                          }});
+
+    benchmarks.push_back({"stringToCommandType", [](uint64_t n) {
+                              static const std::string names[] = {"setAlignViewMode",
+                                                                  "getMeasureStatus",
+                                                                  "getSurfaceData",
+                                                                  "notACommand"};
+                              for (uint64_t i = 0; i < n; i++) {
+                                  doNotOptimize(stringToCommandType(names[i & 3]));
+                              }
+                          }});
+
+    benchmarks.push_back({"BinaryHeader/encode", [](uint64_t n) {
+                              BinaryHeader header;
+                              header.messageType = 0x01;
+                              header.format = 8;
+                              header.width = 1024;
+                              header.height = 1024;
+                              header.payloadLength = 1024 * 1024;
+                              uint8_t buffer[BinaryHeader::kEncodedSize];
+                              for (uint64_t i = 0; i < n; i++) {
+                                  header.contexId = static_cast<uint32_t>(i);
+                                  encodeBinaryHeader(header, buffer);
+                                  doNotOptimize(buffer);
+                              }
+                          }});
+
+    benchmarks.push_back({"BinaryHeader/decode", [](uint64_t n) {
+                              BinaryHeader header;
+                              header.payloadLength = 16;
+                              std::vector<uint8_t> frame(BinaryHeader::kEncodedSize + 16);
+                              encodeBinaryHeader(header, frame.data());
+                              BinaryHeader decoded;
+                              for (uint64_t i = 0; i < n; i++) {
+                                  doNotOptimize(
+                                      decodeBinaryHeader(frame.data(), frame.size(), decoded));
+                                  doNotOptimize(decoded);
+                              }
+                          }});
+
+    // 完整请求路径：帧解析 -> 信封解析 -> 命令处理 -> 响应序列化 -> 帧编码，不经过套接字
+    benchmarks.push_back({"dispatch/getMeasureStatus", [](uint64_t n) {
+                              static InProcessServer harness;
+                              static const size_t connection = harness.connect();
+                              static const std::string frame =
+                                  InProcessServer::encodeClientFrame(kStatusRequest);
+                              // 服务器每个请求都会打印日志，测量期间屏蔽标准输出
+                              std::streambuf* saved = std::cout.rdbuf(nullptr);
+                              for (uint64_t i = 0; i < n; i++) {
+                                  harness.feed(connection, frame);
+                                  doNotOptimize(harness.discard(connection));
+                              }
+                              std::cout.rdbuf(saved);
+                          }});
+
+    // 客户端已有最新版本时只返回unchanged
+    benchmarks.push_back({"dispatch/getMeasureStatus/unchanged", [](uint64_t n) {
+                              static InProcessServer harness;
+                              static const size_t connection = harness.connect();
+                              static const std::string frame =
+                                  InProcessServer::encodeClientFrame(kStatusUnchangedRequest);
+                              std::streambuf* saved = std::cout.rdbuf(nullptr);
+                              for (uint64_t i = 0; i < n; i++) {
+                                  harness.feed(connection, frame);
+                                  doNotOptimize(harness.discard(connection));
+                              }
+                              std::cout.rdbuf(saved);
+                          }});
+
+    // 按连接查找会话：10000个连接，哈希会话表与按weak_ptr控制块比较的有序表对比
+    static const size_t kSessionCount = 10000;
+    static std::vector<std::shared_ptr<int>> connections = []() {
+        std::vector<std::shared_ptr<int>> list;
+        for (size_t i = 0; i < kSessionCount; i++) {
+            list.push_back(std::make_shared<int>(static_cast<int>(i)));
+        }
+        return list;
+    }();
+    benchmarks.push_back({"session/lookup/registry/10000", [](uint64_t n) {
+                              static SessionRegistry<int> registry = []() {
+                                  SessionRegistry<int> table;
+                                  for (const std::shared_ptr<int>& connection : connections) {
+                                      table.insert(connection.get(), connection);
+                                  }
+                                  return table;
+                              }();
+                              for (uint64_t i = 0; i < n; i++) {
+                                  std::weak_ptr<void> hdl = connections[i * 7919 % kSessionCount];
+                                  doNotOptimize(registry.find(hdl.lock().get()));
+                              }
+                          }});
+    benchmarks.push_back({"session/lookup/owner_less_map/10000", [](uint64_t n) {
+                              typedef std::weak_ptr<void> Handle;
+                              static std::map<Handle, int, std::owner_less<Handle>> table = []() {
+                                  std::map<Handle, int, std::owner_less<Handle>> map;
+                                  for (const std::shared_ptr<int>& connection : connections) {
+                                      map[connection] = *connection;
+                                  }
+                                  return map;
+                              }();
+                              for (uint64_t i = 0; i < n; i++) {
+                                  std::weak_ptr<void> hdl = connections[i * 7919 % kSessionCount];
+                                  doNotOptimize(table.find(hdl));
+                              }
+                          }});
+
+    // 像素转换内核，每种CPU支持的指令集各测一遍
+    PixelKernelIsa supported = setPixelKernelIsa(PixelKernelIsa::Avx2);
+    for (int level = 0; level <= static_cast<int>(supported); level++) {
+        PixelKernelIsa isa = static_cast<PixelKernelIsa>(level);
+        std::string suffix = std::string("/") + pixelKernelIsaName(isa);
+
+        benchmarks.push_back({"pixel/rgb24ToGray8/1280x720" + suffix, [isa](uint64_t n) {
+                                  const size_t pixels = 1280 * 720;
+                                  static std::vector<uint8_t> rgb(pixels * 3, 0x5A);
+                                  static std::vector<uint8_t> gray(pixels);
+                                  setPixelKernelIsa(isa);
+                                  for (uint64_t i = 0; i < n; i++) {
+                                      rgb24ToGray8(rgb.data(), gray.data(), pixels);
+                                      doNotOptimize(gray.data());
+                                  }
+                              }});
+
+        benchmarks.push_back({"pixel/gray8ToGray16/1024x1024" + suffix, [isa](uint64_t n) {
+                                  const size_t pixels = 1024 * 1024;
+                                  static std::vector<uint8_t> gray8(pixels, 0x5A);
+                                  static std::vector<uint8_t> gray16(pixels * 2);
+                                  setPixelKernelIsa(isa);
+                                  for (uint64_t i = 0; i < n; i++) {
+                                      gray8ToGray16(gray8.data(), gray16.data(), pixels);
+                                      doNotOptimize(gray16.data());
+                                  }
+                              }});
+
+        benchmarks.push_back({"pixel/downsample2x/2048x2048" + suffix, [isa](uint64_t n) {
+                                  const size_t side = 2048;
+                                  static std::vector<uint8_t> src(side * side, 0x5A);
+                                  static std::vector<uint8_t> dst(side * side / 4);
+                                  setPixelKernelIsa(isa);
+                                  for (uint64_t i = 0; i < n; i++) {
+                                      downsampleBoxGray8(
+                                          src.data(), side, side, side, 2, dst.data());
+                                      doNotOptimize(dst.data());
+                                  }
+                              }});
+    }
+    setPixelKernelIsa(supported);
+
+    // 面形重建：默认测试面形，1024x1024，4步相移；各步骤的输入只在第一次调用时准备
+    static SurfaceEngine engine;
+    static SurfaceParams surface;
+    static SurfaceMap map;
+    benchmarks.push_back({"surface/synthesize/1024x1024", [](uint64_t n) {
+                              for (uint64_t i = 0; i < n; i++) {
+                                  engine.synthesize(surface, static_cast<uint32_t>(i));
+                              }
+                          }});
+    benchmarks.push_back({"surface/extractPhase/1024x1024", [](uint64_t n) {
+                              static bool prepared = (engine.synthesize(surface, 1), true);
+                              doNotOptimize(prepared);
+                              for (uint64_t i = 0; i < n; i++) {
+                                  engine.extractPhase();
+                              }
+                          }});
+    benchmarks.push_back({"surface/unwrap/1024x1024", [](uint64_t n) {
+                              static bool prepared =
+                                  (engine.synthesize(surface, 1), engine.extractPhase(), true);
+                              doNotOptimize(prepared);
+                              for (uint64_t i = 0; i < n; i++) {
+                                  engine.unwrap(map);
+                                  doNotOptimize(map.heights.data());
+                              }
+                          }});
+    benchmarks.push_back({"surface/pyramid/1024x1024", [](uint64_t n) {
+                              static bool prepared = (engine.measure(surface, 1, map), true);
+                              doNotOptimize(prepared);
+                              std::vector<SurfaceMap> levels;
+                              for (uint64_t i = 0; i < n; i++) {
+                                  buildSurfacePyramid(map, levels);
+                                  doNotOptimize(levels.data());
+                              }
+                          }});
+    // 面形汇总：统计量与Zernike拟合，9项为默认参数，36项为最大项数
+    for (unsigned terms : {9u, 36u}) {
+        benchmarks.push_back({"surface/summary/terms=" + std::to_string(terms),
+                              [terms](uint64_t n) {
+                                  static bool prepared = (engine.measure(surface, 1, map), true);
+                                  doNotOptimize(prepared);
+                                  SurfaceSummaryOptions options;
+                                  options.zernikeTerms = terms;
+                                  SurfaceSummary summary;
+                                  for (uint64_t i = 0; i < n; i++) {
+                                      summarizeSurface(map, options, summary);
+                                      doNotOptimize(summary.zernike.data());
+                                  }
+                              }});
+    }
+
+    return benchmarks;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "用法: " << program << " [选项]\n"
+              << "  --filter <子串>       只运行名称包含该子串的测试\n"
+              << "  --min-time <毫秒>     每轮最短测量时间 (默认 200)\n"
+              << "  --repetitions <N>     测量轮数，取中位数 (默认 5)\n"
+              << "  --json <file.json>    结果输出为JSON文件" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            options.minTimeMs = std::max(1.0, std::atof(argv[++i]));
+        } else if (arg == "--repetitions" && hasValue) {
+            options.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && hasValue) {
+            options.json = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    std::printf("%-44s %14s %12s %14s\n", "benchmark", "ns/op", "allocs/op", "iterations");
+    for (const Benchmark& benchmark : makeBenchmarks()) {
+        if (!options.filter.empty() &&
+            benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        BenchResult result = runBenchmark(options, benchmark.name, benchmark.body);
+        std::printf("%-44s %14.1f %12.2f %14llu\n",
+                    result.name.c_str(),
+                    result.nsPerOp,
+                    result.allocsPerOp,
+                    static_cast<unsigned long long>(result.iterations));
+        std::fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (!options.json.empty()) {
+        json output = json::array();
+        for (const BenchResult& result : results) {
+            output.push_back({{"name", result.name},
+                              {"nsPerOp", result.nsPerOp},
+                              {"allocsPerOp", result.allocsPerOp},
+                              {"iterations", result.iterations}});
+        }
+        std::ofstream out(options.json);
+        out << output.dump(2) << std::endl;
+    }
+
+    return 0;
+}
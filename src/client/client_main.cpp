@@ -1,5 +1,8 @@
 #include "device_client.h"
+#include "trace_recorder.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <limits>
@@ -8,7 +11,7 @@
 #include <windows.h>
 #endif
 
-int main() {
+int main(int argc, char* argv[]) {
     // 设置控制台编码，以支持中文显示
 #ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);
@@ -16,11 +19,51 @@ int main() {
     std::locale::global(std::locale(""));
 #endif
 
+    // 解析命令行参数
+    std::string traceFile;
+    std::string deviceId;
+    DeviceClientOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string error;
+        if (parseSocketOption(argc, argv, i, options.socket, options.maxMessageSize, error)) {
+            if (!error.empty()) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--device" && i + 1 < argc) {
+            deviceId = argv[++i];
+        } else if (arg == "--retries" && i + 1 < argc) {
+            options.retries = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "用法: " << argv[0]
+                      << " [--trace <trace.json>] [--device <deviceId>] [--retries <N>]"
+                      << " [套接字选项]\n"
+                      << kSocketOptionsUsage;
+            return 1;
+        }
+    }
+
+    // 开启请求生命周期追踪（Chrome/Perfetto trace-event格式）
+    if (!traceFile.empty()) {
+        if (!TraceRecorder::instance().enable(traceFile, "device_client")) {
+            std::cerr << "无法创建追踪文件: " << traceFile << std::endl;
+            return 1;
+        }
+        std::cout << "请求追踪已开启: " << traceFile << std::endl;
+    }
+
     // 创建设备客户端
-    DeviceClient client;
+    DeviceClient client(options);
     
-    // 连接到服务器
-    if (!client.connect("ws://localhost:9002")) {
+    // 连接到服务器，指定设备时连接到该设备的路径，之后的请求都发往该设备
+    std::string uri = "ws://localhost:9002";
+    if (!deviceId.empty()) {
+        uri += "/devices/" + deviceId;
+    }
+    if (!client.connect(uri)) {
         std::cerr << "Failed to connect to server" << std::endl;
         return 1;
     }
@@ -44,8 +87,12 @@ int main() {
         std::cout << "7. 停止取流" << std::endl;
         std::cout << "8. 停止测量" << std::endl;
         std::cout << "9. 获取面形数据" << std::endl;
+        std::cout << "10. 获取服务器指标" << std::endl;
+        std::cout << "11. 获取单帧快照" << std::endl;
+        std::cout << "12. 获取面形汇总" << std::endl;
+        std::cout << "13. 订阅设备事件" << std::endl;
         std::cout << "0. 退出" << std::endl;
-        std::cout << "请选择操作 (0-9): ";
+        std::cout << "请选择操作 (0-13): ";
         std::cin >> choice;
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
         
@@ -54,8 +101,23 @@ int main() {
         switch (choice) {
             case 1: {
                 // 发送阻塞测量命令
+                std::string count;
+                std::cout << "请输入平均次数 (1-64，直接回车为1): ";
+                std::getline(std::cin, count);
+
+                json params = json::object();
+                if (!count.empty()) {
+                    try {
+                        params["averageCount"] = std::stoi(count);
+                    } catch (...) {
+                        std::cout << "无效的平均次数" << std::endl;
+                        continue;
+                    }
+                    params["variance"] = params["averageCount"] > 1;
+                }
+
                 std::cout << "发送阻塞测量命令..." << std::endl;
-                result = client.executeMeasurement(true);
+                result = client.executeMeasurement(true, params);
                 break;
             }
             case 2: {
@@ -104,8 +166,31 @@ int main() {
             }
             case 6: {
                 // 开始取流
+                std::string format;
+                std::cout << "请输入图像格式 (raw/gray8/gray16/rgb24，直接回车为raw): ";
+                std::getline(std::cin, format);
+
+                std::string encoding;
+                std::cout << "请输入编码方式 (none/delta，直接回车为none): ";
+                std::getline(std::cin, encoding);
+
+                std::string transport;
+                std::cout << "请输入传输方式 (websocket/shm，直接回车为websocket): ";
+                std::getline(std::cin, transport);
+
+                json params = json::object();
+                if (!format.empty()) {
+                    params["format"] = format;
+                }
+                if (!encoding.empty()) {
+                    params["encoding"] = encoding;
+                }
+                if (!transport.empty()) {
+                    params["transport"] = transport;
+                }
+
                 std::cout << "开始取流..." << std::endl;
-                result = client.startStream();
+                result = client.startStream(params);
                 break;
             }
             case 7: {
@@ -122,8 +207,69 @@ int main() {
             }
             case 9: {
                 // 获取面形数据
+                std::string level;
+                std::cout << "请输入金字塔层级 (0为完整面形，p为由粗到细，直接回车为0): ";
+                std::getline(std::cin, level);
+
+                json params = json::object();
+                if (level == "p") {
+                    params["progressive"] = true;
+                } else if (!level.empty()) {
+                    try {
+                        params["level"] = std::stoi(level);
+                    } catch (...) {
+                        std::cout << "无效的层级" << std::endl;
+                        continue;
+                    }
+                }
+
                 std::cout << "获取面形数据..." << std::endl;
-                result = client.getSurfaceData();
+                result = client.getSurfaceData(params);
+                break;
+            }
+            case 10: {
+                // 获取服务器指标
+                std::cout << "获取服务器指标..." << std::endl;
+                result = client.getServerMetrics();
+                break;
+            }
+            case 11: {
+                // 获取单帧快照
+                std::cout << "获取单帧快照..." << std::endl;
+                result = client.getSnapshot();
+                break;
+            }
+            case 12: {
+                // 获取面形汇总
+                std::string terms;
+                std::cout << "请输入Zernike项数 (1-36，直接回车为9): ";
+                std::getline(std::cin, terms);
+
+                json params = json::object();
+                if (!terms.empty()) {
+                    try {
+                        params["zernikeTerms"] = std::stoi(terms);
+                    } catch (...) {
+                        std::cout << "无效的项数" << std::endl;
+                        continue;
+                    }
+                }
+
+                std::cout << "获取面形汇总..." << std::endl;
+                result = client.getSurfaceSummary(params);
+                break;
+            }
+            case 13: {
+                // 订阅设备事件，事件在IO线程中打印
+                client.setEventHandler([](const std::string& topic,
+                                          uint64_t sequence,
+                                          const json& data) {
+                    std::cout << "\n[事件 " << sequence << "] " << topic << ": " << data.dump()
+                              << std::endl;
+                });
+
+                std::cout << "订阅设备事件..." << std::endl;
+                result = client.subscribe();
                 break;
             }
             case 0:
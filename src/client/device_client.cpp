@@ -1,5 +1,6 @@
 #include "device_client.h"
 #include "time_utils.h"
+#include "trace_recorder.h"
 #include <iostream>
 #include <chrono>
 
@@ -7,10 +8,25 @@ using websocketpp::lib::bind;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 
-DeviceClient::DeviceClient()
-    : m_done(false) {
+DeviceClient::DeviceClient(const DeviceClientOptions& options)
+    : m_socket_options(options.socket), m_retries(options.retries), m_done(false) {
     // 初始化WebSocket客户端
     m_client.init_asio();
+    if (options.maxMessageSize > 0) {
+        m_client.set_max_message_size(options.maxMessageSize);
+    }
+    // TCP连接建立后、发送握手请求之前设置套接字选项
+    m_client.set_tcp_pre_init_handler([this](connection_hdl hdl) {
+        websocketpp::lib::error_code ec;
+        websocket_client::connection_ptr con = m_client.get_con_from_hdl(hdl, ec);
+        if (ec) {
+            return;
+        }
+        auto socketError = applySocketOptions(con->get_raw_socket(), m_socket_options);
+        if (socketError) {
+            std::cerr << "Error setting socket options: " << socketError.message() << std::endl;
+        }
+    });
 
     // 完全禁用所有日志通道
     m_client.clear_access_channels(websocketpp::log::alevel::all);
@@ -67,6 +83,8 @@ CommandResult DeviceClient::sendCommand(CommandType cmdType, const json& params,
 
     // 生成请求ID
     std::string requestId = generateTimestampId();
+    TraceRecorder& tracer = TraceRecorder::instance();
+    tracer.mark(requestId, "requestCreated");
 
     // 创建命令请求消息
     json request = {
@@ -90,8 +108,10 @@ CommandResult DeviceClient::sendCommand(CommandType cmdType, const json& params,
     }
 
     // 发送请求
+    std::string payload = request.dump();
     try {
-        m_client.send(m_hdl, request.dump(), websocketpp::frame::opcode::text);
+        m_client.send(m_hdl, payload, websocketpp::frame::opcode::text);
+        tracer.mark(requestId, "requestSent");
         std::cout << "Sent " << commandTypeToString(cmdType) << " request with ID: " << requestId
                   << std::endl;
     } catch (const std::exception& e) {
@@ -103,7 +123,7 @@ CommandResult DeviceClient::sendCommand(CommandType cmdType, const json& params,
     }
 
     // 等待响应或超时
-    auto status = future.wait_for(std::chrono::seconds(timeout_sec));
+    auto status = waitForResponse(requestId, payload, future, timeout_sec);
     if (status == std::future_status::timeout) {
         std::cout << "Request timed out after " << timeout_sec << " seconds" << std::endl;
         // 将超时状态设置为true
@@ -141,6 +161,8 @@ CommandResult DeviceClient::sendBlockingCommand(CommandType cmdType,
 
     // 生成请求ID
     std::string requestId = generateTimestampId();
+    TraceRecorder& tracer = TraceRecorder::instance();
+    tracer.mark(requestId, "requestCreated");
 
     // 创建命令请求消息
     json request = {
@@ -164,8 +186,10 @@ CommandResult DeviceClient::sendBlockingCommand(CommandType cmdType,
     }
 
     // 发送请求
+    std::string payload = request.dump();
     try {
-        m_client.send(m_hdl, request.dump(), websocketpp::frame::opcode::text);
+        m_client.send(m_hdl, payload, websocketpp::frame::opcode::text);
+        tracer.mark(requestId, "requestSent");
         std::cout << "Sent " << commandTypeToString(cmdType) << " request with ID: " << requestId
                   << (isBlocking ? " (blocking mode)" : " (non-blocking mode)") << std::endl;
     } catch (const std::exception& e) {
@@ -177,7 +201,7 @@ CommandResult DeviceClient::sendBlockingCommand(CommandType cmdType,
     }
 
     // 等待响应或超时
-    auto status = future.wait_for(std::chrono::seconds(timeout_sec));
+    auto status = waitForResponse(requestId, payload, future, timeout_sec);
     if (status == std::future_status::timeout) {
         std::cout << "Request timed out after " << timeout_sec << " seconds" << std::endl;
         // 将超时状态设置为true
@@ -212,6 +236,32 @@ CommandResult DeviceClient::sendBlockingCommand(CommandType cmdType,
     }
 }
 
+std::future_status DeviceClient::waitForResponse(const std::string& requestId,
+                                                 const std::string& payload,
+                                                 std::future<void>& future,
+                                                 int timeout_sec) {
+    auto status = future.wait_for(std::chrono::seconds(timeout_sec));
+    for (int attempt = 1; status == std::future_status::timeout && attempt <= m_retries;
+         attempt++) {
+        {
+            std::lock_guard<std::mutex> lock(m_pending_mutex);
+            if (m_pending_requests.count(requestId) == 0) {
+                break;
+            }
+        }
+        std::cout << "Request " << requestId << " timed out, retrying (" << attempt << "/"
+                  << m_retries << ")" << std::endl;
+        websocketpp::lib::error_code ec;
+        m_client.send(m_hdl, payload, websocketpp::frame::opcode::text, ec);
+        if (ec) {
+            std::cerr << "Error resending request: " << ec.message() << std::endl;
+            break;
+        }
+        status = future.wait_for(std::chrono::seconds(timeout_sec));
+    }
+    return status;
+}
+
 // 设置视频流模式
 CommandResult DeviceClient::setAlignViewMode(const std::string& mode) {
     json params = {{"alignViewMode", mode}};
@@ -224,27 +274,91 @@ CommandResult DeviceClient::getAlignViewMode() {
 }
 
 // 开始视频流
-CommandResult DeviceClient::startStream() { return sendCommand(CommandType::StartStream); }
+CommandResult DeviceClient::startStream(const json& params) {
+    CommandResult result = sendCommand(CommandType::StartStream, params);
+    if (!params.is_object() || params.value("transport", "") != "shm" || result.timeout) {
+        return result;
+    }
+
+    // 服务器不在本机或共享内存打不开时改用WebSocket传输
+    bool ringOpened = false;
+    {
+        std::lock_guard<std::mutex> lock(m_frame_mutex);
+        ringOpened = m_frame_ring != nullptr;
+    }
+    if (result.completed && ringOpened) {
+        return result;
+    }
+    if (result.completed) {
+        stopStream();
+    } else if (result.errorMessage == "Stream already running") {
+        return result;
+    }
+    std::cout << "Shared memory transport unavailable, falling back to websocket" << std::endl;
+    json fallback = params;
+    fallback["transport"] = "websocket";
+    return sendCommand(CommandType::StartStream, fallback);
+}
+
+// 请求视频流关键帧
+CommandResult DeviceClient::requestKeyframe() {
+    return sendCommand(CommandType::RequestKeyframe);
+}
+
+// 获取单帧快照
+CommandResult DeviceClient::getSnapshot(const json& params) {
+    json request = params.is_object() ? params : json::object();
+    if (!request.contains("chunkSize")) {
+        request["chunkSize"] = kDefaultChunkSize;
+    }
+    return sendCommand(CommandType::GetSnapshot, request);
+}
 
 // 停止视频流
 CommandResult DeviceClient::stopStream() { return sendCommand(CommandType::StopStream); }
 
 // 开始测量
-CommandResult DeviceClient::executeMeasurement(bool isBlocking) {
+CommandResult DeviceClient::executeMeasurement(bool isBlocking, const json& params) {
     // 使用sendBlockingCommand，支持阻塞/非阻塞模式
-    return sendBlockingCommand(CommandType::ExcuteMeasurement, json(), 30, isBlocking);
+    return sendBlockingCommand(CommandType::ExcuteMeasurement, params, 30, isBlocking);
 }
 
 // 停止测量
 CommandResult DeviceClient::stopMeasure() { return sendCommand(CommandType::StopMeasure); }
 
 // 查询测量状态
-CommandResult DeviceClient::getMeasureStatus() {
-    return sendCommand(CommandType::GetMeasureStatus);
+CommandResult DeviceClient::getMeasureStatus(const json& params) {
+    return sendCommand(CommandType::GetMeasureStatus, params);
 }
 
 // 获取面形数据
-CommandResult DeviceClient::getSurfaceData() { return sendCommand(CommandType::GetSurfaceData); }
+CommandResult DeviceClient::getSurfaceData(const json& params) {
+    json request = params.is_object() ? params : json::object();
+    if (!request.contains("chunkSize")) {
+        request["chunkSize"] = kDefaultChunkSize;
+    }
+    return sendCommand(CommandType::GetSurfaceData, request);
+}
+
+// 获取面形汇总
+CommandResult DeviceClient::getSurfaceSummary(const json& params) {
+    return sendCommand(CommandType::GetSurfaceSummary, params);
+}
+
+// 获取服务器运行指标
+CommandResult DeviceClient::getServerMetrics() {
+    return sendCommand(CommandType::GetServerMetrics);
+}
+
+// 订阅设备事件
+CommandResult DeviceClient::subscribe(const json& params) {
+    return sendCommand(CommandType::Subscribe, params);
+}
+
+// 取消订阅设备事件
+CommandResult DeviceClient::unsubscribe(const json& params) {
+    return sendCommand(CommandType::Unsubscribe, params);
+}
 
 // 关闭连接
 void DeviceClient::close() {
@@ -288,12 +402,41 @@ void DeviceClient::onFail(connection_hdl hdl) {
     m_connected = false;
 }
 
+// 设置二进制帧回调
+void DeviceClient::setFrameHandler(FrameHandler handler) {
+    std::lock_guard<std::mutex> lock(m_frame_mutex);
+    m_frame_handler = std::move(handler);
+}
+
+// 设置设备事件回调
+void DeviceClient::setEventHandler(EventHandler handler) {
+    std::lock_guard<std::mutex> lock(m_event_mutex);
+    m_event_handler = std::move(handler);
+}
+
 void DeviceClient::onMessage(connection_hdl hdl, message_ptr msg) {
+    // 二进制消息为视频流图像或测量结果
+    if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+        handleBinaryMessage(msg->get_payload());
+        return;
+    }
+
     try {
         // 解析JSON消息
         std::string payload = msg->get_payload();
         json message = json::parse(payload);
 
+        // 服务器推送的设备事件没有requestId
+        if (message.value("command", "") == "event") {
+            std::lock_guard<std::mutex> lock(m_event_mutex);
+            if (m_event_handler) {
+                m_event_handler(message.value("topic", ""),
+                                message.value("sequence", uint64_t(0)),
+                                message.value("data", json()));
+            }
+            return;
+        }
+
         // 确保消息包含必要的字段
         if (!message.contains("command") || !message.contains("requestId")) {
             std::cerr << "Invalid message format: missing required fields" << std::endl;
@@ -303,10 +446,29 @@ void DeviceClient::onMessage(connection_hdl hdl, message_ptr msg) {
         std::string msgType = message["command"];
         std::string requestId = message["requestId"];
 
+        // pending等中间状态之后还会有最终响应
+        std::string status = message.value("status", "");
+        TraceRecorder& tracer = TraceRecorder::instance();
+        if (status == "pending") {
+            tracer.mark(requestId, "responseReceived");
+        } else {
+            tracer.finish(requestId, "responseReceived");
+        }
+
+        if (status == "success" && (msgType == "startStream" || msgType == "stopStream")) {
+            updateFrameRing(msgType, message.value("data", json()));
+        }
+
         // 查找对应的请求
         std::lock_guard<std::mutex> lock(m_pending_mutex);
         auto it = m_pending_requests.find(requestId);
         if (it != m_pending_requests.end()) {
+            // 重发请求后原请求与重发的响应可能都会到达，只处理第一个
+            if (status == "pending" ? it->second.pendingReceived : it->second.finalReceived) {
+                return;
+            }
+            it->second.finalReceived = status != "pending";
+
             // 根据命令类型处理响应
             CommandType cmdType = it->second.cmdType;
 
@@ -323,7 +485,8 @@ void DeviceClient::onMessage(connection_hdl hdl, message_ptr msg) {
                 // 通用响应处理
                 handleGenericResponse(it, message);
             }
-        } else {
+        } else if (msgType != "requestKeyframe") {
+            // 解码失败时自动发出的关键帧请求不等待响应
             std::cout << "Received response for unknown request ID: " << requestId << std::endl;
         }
     } catch (json::parse_error& e) {
@@ -333,6 +496,106 @@ void DeviceClient::onMessage(connection_hdl hdl, message_ptr msg) {
     }
 }
 
+// 处理二进制帧
+void DeviceClient::handleBinaryMessage(const std::string& payload) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(payload.data());
+    BinaryHeader header;
+    if (!decodeBinaryHeader(data, payload.size(), header)) {
+        std::cerr << "Invalid binary message: " << payload.size() << " bytes" << std::endl;
+        return;
+    }
+
+    // 分段消息拼接完整后按原消息处理
+    if (header.messageType == static_cast<uint8_t>(BinaryMessageType::Chunk)) {
+        std::string message;
+        {
+            std::lock_guard<std::mutex> lock(m_frame_mutex);
+            ChunkAssembler& chunks = m_chunks[header.contexId];
+            if (!chunks.add(header, data + BinaryHeader::kEncodedSize)) {
+                return;
+            }
+            message = chunks.take();
+        }
+        handleBinaryMessage(message);
+        return;
+    }
+
+    if (header.messageType == static_cast<uint8_t>(BinaryMessageType::StreamSlot)) {
+        handleSlotNotice(header, data + BinaryHeader::kEncodedSize);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_frame_mutex);
+
+    // 关键帧/差分帧先解码为完整图像
+    BinaryHeader image;
+    const uint8_t* pixels = nullptr;
+    if (!m_stream_decoder.decode(header, data + BinaryHeader::kEncodedSize, image, pixels)) {
+        std::cerr << "Stream frame decode failed, requesting keyframe" << std::endl;
+        if (!m_keyframe_requested) {
+            m_keyframe_requested = true;
+            sendKeyframeRequest();
+        }
+        return;
+    }
+    if (header.messageType == static_cast<uint8_t>(BinaryMessageType::StreamKeyframe)) {
+        m_keyframe_requested = false;
+    }
+
+    if (m_frame_handler) {
+        m_frame_handler(image, pixels, image.payloadLength);
+    }
+}
+
+void DeviceClient::handleSlotNotice(const BinaryHeader& header, const uint8_t* payload) {
+    uint64_t sequence = 0;
+    uint32_t slot = 0;
+    if (!decodeSlotNotice(payload, header.payloadLength, sequence, slot)) {
+        std::cerr << "Invalid slot notice" << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_frame_mutex);
+    if (!m_frame_ring) {
+        return;
+    }
+    // 回调直接读取共享内存中的图像，返回后才释放槽位
+    size_t size = 0;
+    const uint8_t* frame = m_frame_ring->read(sequence, slot, size);
+    BinaryHeader image;
+    if (frame && decodeBinaryHeader(frame, size, image)) {
+        if (m_frame_handler) {
+            m_frame_handler(image, frame + BinaryHeader::kEncodedSize, image.payloadLength);
+        }
+    } else {
+        std::cerr << "Shared memory slot " << slot << " does not hold frame " << sequence
+                  << std::endl;
+    }
+    m_frame_ring->release(sequence);
+}
+
+void DeviceClient::updateFrameRing(const std::string& command, const json& data) {
+    std::unique_ptr<FrameRing> ring;
+    if (command == "startStream" && data.is_object() && data.value("transport", "") == "shm" &&
+        data.contains("shm") && data["shm"].is_object()) {
+        ring = FrameRing::open(data["shm"].value("name", ""));
+    }
+    std::lock_guard<std::mutex> lock(m_frame_mutex);
+    m_frame_ring = std::move(ring);
+}
+
+void DeviceClient::sendKeyframeRequest() {
+    json request = {{"command", commandTypeToString(CommandType::RequestKeyframe)},
+                    {"requestId", generateTimestampId()},
+                    {"params", json::object()}};
+
+    websocketpp::lib::error_code ec;
+    m_client.send(m_hdl, request.dump(), websocketpp::frame::opcode::text, ec);
+    if (ec) {
+        std::cerr << "Error sending keyframe request: " << ec.message() << std::endl;
+    }
+}
+
 // 处理测量命令的响应
 void DeviceClient::handleMeasureResponse(PendingRequestsIterator it, const json& message) {
     if (!message.contains("status")) {
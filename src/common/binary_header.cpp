@@ -0,0 +1,111 @@
+#include "binary_header.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+inline void writeLe16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void writeLe32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+inline uint16_t readLe16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+inline uint32_t readLe32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+}  // namespace
+
+void encodeBinaryHeader(const BinaryHeader& header, uint8_t* out) {
+    out[0] = header.messageType;
+    writeLe32(out + 1, header.contexId);
+    out[5] = header.format;
+    writeLe16(out + 6, header.width);
+    writeLe16(out + 8, header.height);
+    writeLe32(out + 10, header.payloadLength);
+}
+
+bool decodeBinaryHeader(const uint8_t* data, size_t size, BinaryHeader& header) {
+    if (size < BinaryHeader::kEncodedSize) {
+        return false;
+    }
+
+    header.messageType = data[0];
+    header.contexId = readLe32(data + 1);
+    header.format = data[5];
+    header.width = readLe16(data + 6);
+    header.height = readLe16(data + 8);
+    header.payloadLength = readLe32(data + 10);
+
+    return size - BinaryHeader::kEncodedSize == header.payloadLength;
+}
+
+std::vector<std::string> splitIntoChunks(const std::string& message, size_t chunkSize) {
+    std::vector<std::string> chunks;
+    BinaryHeader original;
+    if (chunkSize == 0 || message.size() <= chunkSize ||
+        !decodeBinaryHeader(reinterpret_cast<const uint8_t*>(message.data()),
+                            message.size(),
+                            original)) {
+        chunks.push_back(message);
+        return chunks;
+    }
+
+    BinaryHeader header;
+    header.messageType = static_cast<uint8_t>(BinaryMessageType::Chunk);
+    header.contexId = original.contexId;
+    header.format = original.messageType;
+    for (size_t offset = 0; offset < message.size(); offset += chunkSize) {
+        size_t length = std::min(chunkSize, message.size() - offset);
+        header.payloadLength = static_cast<uint32_t>(kChunkPrefixSize + length);
+        std::string chunk(BinaryHeader::kEncodedSize + header.payloadLength, '\0');
+        uint8_t* out = reinterpret_cast<uint8_t*>(&chunk[0]);
+        encodeBinaryHeader(header, out);
+        writeLe32(out + BinaryHeader::kEncodedSize, static_cast<uint32_t>(offset));
+        writeLe32(out + BinaryHeader::kEncodedSize + 4, static_cast<uint32_t>(message.size()));
+        std::memcpy(out + BinaryHeader::kEncodedSize + kChunkPrefixSize,
+                    message.data() + offset,
+                    length);
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+bool ChunkAssembler::add(const BinaryHeader& header, const uint8_t* payload) {
+    if (header.payloadLength < kChunkPrefixSize) {
+        m_message.clear();
+        return false;
+    }
+    uint32_t offset = readLe32(payload);
+    uint32_t total = readLe32(payload + 4);
+    size_t length = header.payloadLength - kChunkPrefixSize;
+    // 新消息从偏移0开始；之后的段必须紧接已拼接的内容
+    if (offset == 0) {
+        m_message.clear();
+        m_total = total;
+    }
+    if (offset != m_message.size() || total != m_total || offset + length > total) {
+        m_message.clear();
+        return false;
+    }
+    m_message.append(reinterpret_cast<const char*>(payload + kChunkPrefixSize), length);
+    return m_message.size() == m_total;
+}
+
+std::string ChunkAssembler::take() {
+    std::string message;
+    message.swap(m_message);
+    m_total = 0;
+    return message;
+}
@@ -11,6 +11,12 @@ std::string commandTypeToString(CommandType type) {
         case CommandType::StopMeasure: return "stopMeasure";
         case CommandType::GetMeasureStatus: return "getMeasureStatus";
         case CommandType::GetSurfaceData: return "getSurfaceData";
+        case CommandType::GetServerMetrics: return "getServerMetrics";
+        case CommandType::RequestKeyframe: return "requestKeyframe";
+        case CommandType::GetSnapshot: return "getSnapshot";
+        case CommandType::GetSurfaceSummary: return "getSurfaceSummary";
+        case CommandType::Subscribe: return "subscribe";
+        case CommandType::Unsubscribe: return "unsubscribe";
         
         default: return "unknown";
     }
@@ -26,6 +32,12 @@ CommandType stringToCommandType(const std::string& typeStr) {
     if (typeStr == "stopMeasure") return CommandType::StopMeasure;
     if (typeStr == "getMeasureStatus") return CommandType::GetMeasureStatus;
     if (typeStr == "getSurfaceData") return CommandType::GetSurfaceData;
+    if (typeStr == "getServerMetrics") return CommandType::GetServerMetrics;
+    if (typeStr == "requestKeyframe") return CommandType::RequestKeyframe;
+    if (typeStr == "getSnapshot") return CommandType::GetSnapshot;
+    if (typeStr == "getSurfaceSummary") return CommandType::GetSurfaceSummary;
+    if (typeStr == "subscribe") return CommandType::Subscribe;
+    if (typeStr == "unsubscribe") return CommandType::Unsubscribe;
 
     return CommandType::Unknown; // 默认返回
 }
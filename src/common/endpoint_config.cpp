@@ -0,0 +1,59 @@
+#include "endpoint_config.h"
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+const char* const kSocketOptionsUsage =
+    "  --no-nodelay             不设置TCP_NODELAY（默认关闭Nagle算法）\n"
+    "  --sndbuf <字节>          SO_SNDBUF (默认系统值)\n"
+    "  --rcvbuf <字节>          SO_RCVBUF (默认系统值)\n"
+    "  --busy-poll <微秒>       SO_BUSY_POLL，仅Linux (默认关闭)\n"
+    "  --max-message-size <字节> 最大接收消息 (默认按endpoint配置)\n";
+
+bool parseSocketOption(int argc,
+                       char* argv[],
+                       int& i,
+                       SocketOptions& options,
+                       size_t& maxMessageSize,
+                       std::string& error) {
+    std::string arg = argv[i];
+    if (arg == "--no-nodelay") {
+        options.noDelay = false;
+        return true;
+    }
+    if (arg != "--sndbuf" && arg != "--rcvbuf" && arg != "--busy-poll" &&
+        arg != "--max-message-size") {
+        return false;
+    }
+    if (i + 1 >= argc) {
+        error = arg + " 需要参数值";
+        return true;
+    }
+    char* end = nullptr;
+    long long value = std::strtoll(argv[++i], &end, 10);
+    if (!end || *end != '\0' || value <= 0 || value > 0x7FFFFFFF) {
+        error = arg + " 的参数值无效: " + argv[i];
+        return true;
+    }
+    if (arg == "--sndbuf") {
+        options.sendBuffer = static_cast<int>(value);
+    } else if (arg == "--rcvbuf") {
+        options.receiveBuffer = static_cast<int>(value);
+    } else if (arg == "--busy-poll") {
+        options.busyPollUs = static_cast<int>(value);
+    } else {
+        maxMessageSize = static_cast<size_t>(value);
+    }
+    return true;
+}
+
+void raiseOpenFileLimit() {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
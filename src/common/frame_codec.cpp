@@ -0,0 +1,239 @@
+#include "frame_codec.h"
+#include <cstring>
+
+namespace {
+
+const size_t kMinRun = 3;           // 短于该长度的重复按原样复制更省空间
+const size_t kMaxLiteral = 128;     // 单个控制字节可描述的最大原样字节数
+const size_t kShortRunLimit = 127;  // 控制字节低7位可描述的最大追加长度
+
+inline uint64_t load64(const uint8_t* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// 从start开始与data[start]相同的字节数
+inline size_t runLength(const uint8_t* data, size_t start, size_t size) {
+    const uint8_t value = data[start];
+    const uint64_t pattern = 0x0101010101010101ull * value;
+    size_t end = start + 1;
+    // 差分帧以大段的0为主，按8字节比较加快扫描
+    while (end + 8 <= size && load64(data + end) == pattern) {
+        end += 8;
+    }
+    while (end < size && data[end] == value) {
+        end++;
+    }
+    return end - start;
+}
+
+void appendLiterals(const uint8_t* data, size_t size, std::string& out) {
+    while (size > 0) {
+        size_t count = size < kMaxLiteral ? size : kMaxLiteral;
+        out.push_back(static_cast<char>(count - 1));
+        out.append(reinterpret_cast<const char*>(data), count);
+        data += count;
+        size -= count;
+    }
+}
+
+void appendRun(uint8_t value, size_t length, std::string& out) {
+    size_t extra = length - kMinRun;
+    if (extra < kShortRunLimit) {
+        out.push_back(static_cast<char>(0x80 | extra));
+    } else {
+        out.push_back(static_cast<char>(0xFF));
+        extra -= kShortRunLimit;
+        // varint: 每字节7位，最高位表示后续还有字节
+        while (extra >= 0x80) {
+            out.push_back(static_cast<char>(0x80 | (extra & 0x7F)));
+            extra >>= 7;
+        }
+        out.push_back(static_cast<char>(extra));
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// 压缩结果追加到out末尾
+void rleCompressAppend(const uint8_t* data, size_t size, std::string& out) {
+    size_t literalStart = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t length = runLength(data, i, size);
+        if (length >= kMinRun) {
+            appendLiterals(data + literalStart, i - literalStart, out);
+            appendRun(data[i], length, out);
+            i += length;
+            literalStart = i;
+        } else {
+            i += length;
+        }
+    }
+    appendLiterals(data + literalStart, size - literalStart, out);
+}
+
+// 编码帧：数据头 + 压缩数据
+void encodeFrame(BinaryHeader header,
+                 BinaryMessageType type,
+                 const uint8_t* data,
+                 size_t size,
+                 std::string& out) {
+    out.resize(BinaryHeader::kEncodedSize);
+    rleCompressAppend(data, size, out);
+    header.messageType = static_cast<uint8_t>(type);
+    header.contexId = 0;
+    header.payloadLength = static_cast<uint32_t>(out.size() - BinaryHeader::kEncodedSize);
+    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&out[0]));
+}
+
+inline size_t imageSize(const BinaryHeader& header) {
+    return static_cast<size_t>(header.width) * header.height * header.format / 8;
+}
+
+}  // namespace
+
+void rleCompress(const uint8_t* data, size_t size, std::string& out) {
+    out.clear();
+    rleCompressAppend(data, size, out);
+}
+
+bool rleDecompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize) {
+    size_t in = 0;
+    size_t written = 0;
+    while (in < size) {
+        uint8_t control = data[in++];
+        if (control < 0x80) {
+            size_t count = static_cast<size_t>(control) + 1;
+            if (count > size - in || count > outSize - written) {
+                return false;
+            }
+            std::memcpy(out + written, data + in, count);
+            in += count;
+            written += count;
+            continue;
+        }
+
+        size_t length = static_cast<size_t>(control & 0x7F) + kMinRun;
+        if ((control & 0x7F) == kShortRunLimit) {
+            size_t extra = 0;
+            int shift = 0;
+            uint8_t byte = 0;
+            do {
+                if (in >= size || shift > 56) {
+                    return false;
+                }
+                byte = data[in++];
+                extra |= static_cast<size_t>(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            length += extra;
+        }
+        if (in >= size || length > outSize - written) {
+            return false;
+        }
+        std::memset(out + written, data[in++], length);
+        written += length;
+    }
+    return written == outSize;
+}
+
+void xorBytes(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t value = load64(a + i) ^ load64(b + i);
+        std::memcpy(out + i, &value, sizeof(value));
+    }
+    for (; i < size; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+// ---------------- StreamEncoder ----------------
+
+void StreamEncoder::push(const std::string& frame, uint64_t index) {
+    BinaryHeader header;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(frame.data());
+    decodeBinaryHeader(data, frame.size(), header);
+
+    // 图像尺寸或格式变化（如切换取流模式）时上一帧不能作为参考
+    m_has_previous = m_has_current && header.format == m_header.format &&
+                     header.width == m_header.width && header.height == m_header.height;
+    m_current.swap(m_previous);
+    m_previous_index = m_current_index;
+
+    m_header = header;
+    m_current.assign(data + BinaryHeader::kEncodedSize, data + frame.size());
+    m_current_index = index;
+    m_has_current = true;
+    m_sequence++;
+    m_keyframe_valid = false;
+    m_delta_valid = false;
+}
+
+std::string& StreamEncoder::keyframe() {
+    if (!m_keyframe_valid) {
+        encodeFrame(
+            m_header, BinaryMessageType::StreamKeyframe, m_current.data(), m_current.size(),
+            m_keyframe);
+        m_keyframe_valid = true;
+    }
+    return m_keyframe;
+}
+
+std::string& StreamEncoder::delta() {
+    if (!m_delta_valid) {
+        m_scratch.resize(m_current.size());
+        xorBytes(m_current.data(), m_previous.data(), m_scratch.data(), m_current.size());
+        encodeFrame(
+            m_header, BinaryMessageType::StreamDelta, m_scratch.data(), m_scratch.size(), m_delta);
+        m_delta_valid = true;
+    }
+    return m_delta;
+}
+
+// ---------------- StreamDecoder ----------------
+
+bool StreamDecoder::decode(const BinaryHeader& header,
+                           const uint8_t* payload,
+                           BinaryHeader& image,
+                           const uint8_t*& pixels) {
+    image = header;
+    pixels = payload;
+
+    bool keyframe = header.messageType == static_cast<uint8_t>(BinaryMessageType::StreamKeyframe);
+    bool delta = header.messageType == static_cast<uint8_t>(BinaryMessageType::StreamDelta);
+    if (!keyframe && !delta) {
+        return true;
+    }
+
+    size_t size = imageSize(header);
+    if (keyframe) {
+        Reference& reference = m_streams[header.contexId];
+        reference.pixels.resize(size);
+        if (!rleDecompress(payload, header.payloadLength, reference.pixels.data(), size)) {
+            m_streams.erase(header.contexId);
+            return false;
+        }
+        reference.header = header;
+    } else {
+        auto it = m_streams.find(header.contexId);
+        if (it == m_streams.end() || it->second.header.format != header.format ||
+            it->second.header.width != header.width ||
+            it->second.header.height != header.height) {
+            return false;
+        }
+        m_scratch.resize(size);
+        if (!rleDecompress(payload, header.payloadLength, m_scratch.data(), size)) {
+            m_streams.erase(it);
+            return false;
+        }
+        xorBytes(it->second.pixels.data(), m_scratch.data(), it->second.pixels.data(), size);
+    }
+
+    const Reference& reference = m_streams[header.contexId];
+    image.messageType = static_cast<uint8_t>(BinaryMessageType::StreamImage);
+    image.payloadLength = static_cast<uint32_t>(size);
+    pixels = reference.pixels.data();
+    return true;
+}
@@ -0,0 +1,194 @@
+#include "frame_ring.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t kRingMagic = 0x52464D53;  // "SMFR"
+const size_t kAlignment = 64;           // 控制块与槽位按缓存行对齐，读写双方不共享缓存行
+
+size_t alignUp(size_t value) { return (value + kAlignment - 1) / kAlignment * kAlignment; }
+
+}  // namespace
+
+// 共享内存开头的控制块，只包含无锁原子量与普通数据
+struct FrameRing::Control {
+    uint32_t magic;
+    uint32_t slotCount;
+    uint64_t slotSize;
+    alignas(kAlignment) std::atomic<uint64_t> written;   // 最后写入的帧序号，服务端写
+    alignas(kAlignment) std::atomic<uint64_t> released;  // 最后释放的帧序号，客户端写
+};
+
+struct FrameRing::SlotHeader {
+    std::atomic<uint64_t> sequence;  // 槽位中的帧序号，写入完成后发布
+    uint64_t size;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory frame ring needs lock-free atomics");
+
+std::unique_ptr<FrameRing> FrameRing::create(const std::string& name,
+                                             uint32_t slotCount,
+                                             size_t slotSize) {
+#ifndef _WIN32
+    if (slotCount == 0 || slotSize == 0) {
+        return nullptr;
+    }
+    size_t stride = alignUp(sizeof(SlotHeader) + slotSize);
+    size_t bytes = alignUp(sizeof(Control)) + stride * slotCount;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    // 新对象内容为全零，填写控制块后客户端才能打开
+    Control* control = new (memory) Control();
+    control->slotCount = slotCount;
+    control->slotSize = slotSize;
+    for (uint32_t i = 0; i < slotCount; i++) {
+        new (static_cast<char*>(memory) + alignUp(sizeof(Control)) + i * stride) SlotHeader();
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    control->magic = kRingMagic;
+    return std::unique_ptr<FrameRing>(new FrameRing(name, memory, bytes, true));
+#else
+    (void)name, (void)slotCount, (void)slotSize;
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<FrameRing> FrameRing::open(const std::string& name) {
+#ifndef _WIN32
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    void* memory = MAP_FAILED;
+    size_t bytes = 0;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Control)) {
+        bytes = static_cast<size_t>(info.st_size);
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const Control* control = static_cast<const Control*>(memory);
+    size_t stride = alignUp(sizeof(SlotHeader) + control->slotSize);
+    if (control->magic != kRingMagic || control->slotCount == 0 ||
+        alignUp(sizeof(Control)) + stride * control->slotCount > bytes) {
+        munmap(memory, bytes);
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return std::unique_ptr<FrameRing>(new FrameRing(name, memory, bytes, false));
+#else
+    (void)name;
+    return nullptr;
+#endif
+}
+
+FrameRing::FrameRing(const std::string& name, void* memory, size_t bytes, bool owner)
+    : m_name(name), m_memory(memory), m_bytes(bytes), m_owner(owner) {
+    const Control* control = static_cast<const Control*>(memory);
+    m_slot_count = control->slotCount;
+    m_slot_size = control->slotSize;
+    m_slot_stride = alignUp(sizeof(SlotHeader) + m_slot_size);
+}
+
+FrameRing::~FrameRing() {
+#ifndef _WIN32
+    munmap(m_memory, m_bytes);
+    // 已打开的客户端映射在删除后仍然有效，直到它自己解除映射
+    if (m_owner) {
+        shm_unlink(m_name.c_str());
+    }
+#endif
+}
+
+FrameRing::SlotHeader& FrameRing::slotHeader(uint32_t slot) const {
+    char* base = static_cast<char*>(m_memory) + alignUp(sizeof(Control));
+    return *reinterpret_cast<SlotHeader*>(base + slot * m_slot_stride);
+}
+
+bool FrameRing::write(const uint8_t* data, size_t size, uint64_t& sequence, uint32_t& slot) {
+    Control* control = static_cast<Control*>(m_memory);
+    uint64_t written = control->written.load(std::memory_order_relaxed);
+    uint64_t released = control->released.load(std::memory_order_acquire);
+    if (size > m_slot_size || written - released >= m_slot_count) {
+        return false;
+    }
+
+    sequence = written + 1;
+    slot = static_cast<uint32_t>((sequence - 1) % m_slot_count);
+    SlotHeader& header = slotHeader(slot);
+    std::memcpy(reinterpret_cast<char*>(&header) + sizeof(SlotHeader), data, size);
+    header.size = size;
+    header.sequence.store(sequence, std::memory_order_release);
+    control->written.store(sequence, std::memory_order_release);
+    return true;
+}
+
+const uint8_t* FrameRing::read(uint64_t sequence, uint32_t slot, size_t& size) const {
+    if (slot >= m_slot_count) {
+        return nullptr;
+    }
+    const SlotHeader& header = slotHeader(slot);
+    if (header.sequence.load(std::memory_order_acquire) != sequence ||
+        header.size > m_slot_size) {
+        return nullptr;
+    }
+    size = static_cast<size_t>(header.size);
+    return reinterpret_cast<const uint8_t*>(&header) + sizeof(SlotHeader);
+}
+
+void FrameRing::release(uint64_t sequence) {
+    Control* control = static_cast<Control*>(m_memory);
+    uint64_t released = control->released.load(std::memory_order_relaxed);
+    if (sequence > released) {
+        control->released.store(sequence, std::memory_order_release);
+    }
+}
+
+void encodeSlotNotice(uint64_t sequence, uint32_t slot, uint8_t* out) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<uint8_t>(sequence >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        out[8 + i] = static_cast<uint8_t>(slot >> (8 * i));
+    }
+}
+
+bool decodeSlotNotice(const uint8_t* data, size_t size, uint64_t& sequence, uint32_t& slot) {
+    if (size != FrameRing::kNoticeSize) {
+        return false;
+    }
+    sequence = 0;
+    for (int i = 0; i < 8; i++) {
+        sequence |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    slot = 0;
+    for (int i = 0; i < 4; i++) {
+        slot |= static_cast<uint32_t>(data[8 + i]) << (8 * i);
+    }
+    return true;
+}
@@ -0,0 +1,124 @@
+#include "parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::function<void(size_t, size_t)> RangeFunction;
+
+class ThreadPool {
+public:
+    static ThreadPool& instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t workerCount() const { return m_workers.size() + 1; }
+
+    void run(size_t count, size_t grain, const RangeFunction& fn) {
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+        std::unique_lock<std::mutex> busy(m_job_mutex, std::try_to_lock);
+        if (chunks <= 1 || m_workers.empty() || !busy.owns_lock()) {
+            for (size_t begin = 0; begin < count; begin += grain) {
+                fn(begin, std::min(begin + grain, count));
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_fn = &fn;
+            m_count = count;
+            m_grain = grain;
+            m_chunks = chunks;
+            m_next = 0;
+            m_active = m_workers.size();
+            m_generation++;
+        }
+        m_cv.notify_all();
+
+        work();
+
+        // 等所有工作线程确认完成后才能释放fn
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]() { return m_active == 0; });
+        m_fn = nullptr;
+    }
+
+private:
+    ThreadPool() {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 1; i < cores; i++) {
+            m_workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    // 领取剩余的块直到全部分完
+    void work() {
+        for (;;) {
+            size_t chunk = m_next.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= m_chunks) {
+                return;
+            }
+            size_t begin = chunk * m_grain;
+            (*m_fn)(begin, std::min(begin + m_grain, m_count));
+        }
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_cv.wait(lock, [this, &seen]() { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+            lock.unlock();
+            work();
+            lock.lock();
+            if (--m_active == 0) {
+                m_done_cv.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_job_mutex;  // 同一时间只执行一个并行任务
+    std::mutex m_mutex;      // 保护以下任务描述
+    std::condition_variable m_cv;
+    std::condition_variable m_done_cv;
+    const RangeFunction* m_fn = nullptr;
+    size_t m_count = 0;
+    size_t m_grain = 1;
+    size_t m_chunks = 0;
+    std::atomic<size_t> m_next{0};
+    size_t m_active = 0;  // 尚未完成当前任务的工作线程数
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+};
+
+}  // namespace
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+    ThreadPool::instance().run(count, grain, fn);
+}
+
+size_t parallelWorkerCount() { return ThreadPool::instance().workerCount(); }
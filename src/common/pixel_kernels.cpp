@@ -0,0 +1,462 @@
+#include "pixel_kernels.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PIXEL_TARGET_SSSE3
+#define PIXEL_TARGET_AVX2
+#else
+// 按函数开启指令集，整个工程无需额外的编译选项
+#define PIXEL_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define PIXEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+// ---------------- 标量实现 ----------------
+
+void rgb24ToGray8Scalar(const uint8_t* rgb, uint8_t* gray, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t* p = rgb + i * 3;
+        gray[i] = static_cast<uint8_t>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+    }
+}
+
+void gray8ToRgb24Scalar(const uint8_t* gray, uint8_t* rgb, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        rgb[i * 3 + 0] = gray[i];
+        rgb[i * 3 + 1] = gray[i];
+        rgb[i * 3 + 2] = gray[i];
+    }
+}
+
+void gray8ToGray16Scalar(const uint8_t* gray8, uint8_t* gray16, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        gray16[i * 2 + 0] = gray8[i];
+        gray16[i * 2 + 1] = gray8[i];
+    }
+}
+
+void gray16ToGray8Scalar(const uint8_t* gray16, uint8_t* gray8, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        gray8[i] = gray16[i * 2 + 1];
+    }
+}
+
+// 2x2区域平均的一行，从第start个输出像素开始
+void downsample2xRowScalar(const uint8_t* row0,
+                           const uint8_t* row1,
+                           uint8_t* out,
+                           size_t start,
+                           size_t outWidth) {
+    for (size_t x = start; x < outWidth; x++) {
+        unsigned sum = row0[x * 2] + row0[x * 2 + 1] + row1[x * 2] + row1[x * 2 + 1];
+        out[x] = static_cast<uint8_t>((sum + 2) >> 2);
+    }
+}
+
+void downsampleBoxScalar(const uint8_t* src,
+                         size_t width,
+                         size_t height,
+                         size_t srcStride,
+                         size_t channels,
+                         size_t factor,
+                         uint8_t* dst) {
+    size_t outWidth = width / factor;
+    size_t outHeight = height / factor;
+    unsigned area = static_cast<unsigned>(factor * factor);
+    for (size_t y = 0; y < outHeight; y++) {
+        const uint8_t* block = src + y * factor * srcStride;
+        uint8_t* out = dst + y * outWidth * channels;
+        for (size_t x = 0; x < outWidth; x++) {
+            for (size_t c = 0; c < channels; c++) {
+                unsigned sum = 0;
+                for (size_t dy = 0; dy < factor; dy++) {
+                    const uint8_t* row = block + dy * srcStride + x * factor * channels + c;
+                    for (size_t dx = 0; dx < factor; dx++) {
+                        sum += row[dx * channels];
+                    }
+                }
+                out[x * channels + c] = static_cast<uint8_t>((sum + area / 2) / area);
+            }
+        }
+    }
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+// ---------------- SSE实现 ----------------
+
+// RGB24每8个像素（24字节）分两次加载：x为字节[0,16)，y为字节[8,24)
+// 以下掩码把某个通道的8个值从x/y中取出并零扩展为16位
+struct RgbShuffleMasks {
+    alignas(16) uint8_t fromX[3][16];
+    alignas(16) uint8_t fromY[3][16];
+    alignas(16) uint8_t expand[3][16];  // 灰度16字节 -> RGB48字节
+};
+
+const RgbShuffleMasks& rgbShuffleMasks() {
+    static const RgbShuffleMasks masks = []() {
+        RgbShuffleMasks m;
+        for (int channel = 0; channel < 3; channel++) {
+            for (int lane = 0; lane < 8; lane++) {
+                int byte = lane * 3 + channel;
+                m.fromX[channel][lane * 2] = byte < 16 ? static_cast<uint8_t>(byte) : 0x80;
+                m.fromY[channel][lane * 2] = byte >= 16 ? static_cast<uint8_t>(byte - 8) : 0x80;
+                m.fromX[channel][lane * 2 + 1] = 0x80;
+                m.fromY[channel][lane * 2 + 1] = 0x80;
+            }
+            for (int i = 0; i < 16; i++) {
+                m.expand[channel][i] = static_cast<uint8_t>((channel * 16 + i) / 3);
+            }
+        }
+        return m;
+    }();
+    return masks;
+}
+
+inline __m128i loadMask(const uint8_t* mask) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+// 8个像素的灰度值（16位）
+PIXEL_TARGET_SSSE3 inline __m128i rgbToGray16x8(const uint8_t* rgb, const RgbShuffleMasks& m) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 8));
+    __m128i r = _mm_or_si128(_mm_shuffle_epi8(x, loadMask(m.fromX[0])),
+                             _mm_shuffle_epi8(y, loadMask(m.fromY[0])));
+    __m128i g = _mm_or_si128(_mm_shuffle_epi8(x, loadMask(m.fromX[1])),
+                             _mm_shuffle_epi8(y, loadMask(m.fromY[1])));
+    __m128i b = _mm_or_si128(_mm_shuffle_epi8(x, loadMask(m.fromX[2])),
+                             _mm_shuffle_epi8(y, loadMask(m.fromY[2])));
+    // 最大值 255*256+128 < 65536，16位无符号运算不会溢出
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)),
+                                _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+    return _mm_srli_epi16(sum, 8);
+}
+
+PIXEL_TARGET_SSSE3 void rgb24ToGray8Sse(const uint8_t* rgb, uint8_t* gray, size_t pixelCount) {
+    const RgbShuffleMasks& m = rgbShuffleMasks();
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i lo = rgbToGray16x8(rgb + i * 3, m);
+        __m128i hi = rgbToGray16x8(rgb + i * 3 + 24, m);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(lo, hi));
+    }
+    rgb24ToGray8Scalar(rgb + i * 3, gray + i, pixelCount - i);
+}
+
+PIXEL_TARGET_SSSE3 void gray8ToRgb24Sse(const uint8_t* gray, uint8_t* rgb, size_t pixelCount) {
+    const RgbShuffleMasks& m = rgbShuffleMasks();
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + i));
+        __m128i* out = reinterpret_cast<__m128i*>(rgb + i * 3);
+        _mm_storeu_si128(out + 0, _mm_shuffle_epi8(v, loadMask(m.expand[0])));
+        _mm_storeu_si128(out + 1, _mm_shuffle_epi8(v, loadMask(m.expand[1])));
+        _mm_storeu_si128(out + 2, _mm_shuffle_epi8(v, loadMask(m.expand[2])));
+    }
+    gray8ToRgb24Scalar(gray + i, rgb + i * 3, pixelCount - i);
+}
+
+void gray8ToGray16Sse(const uint8_t* gray8, uint8_t* gray16, size_t pixelCount) {
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray8 + i));
+        __m128i* out = reinterpret_cast<__m128i*>(gray16 + i * 2);
+        // 字节与自身交错即 v * 257
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi8(v, v));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(v, v));
+    }
+    gray8ToGray16Scalar(gray8 + i, gray16 + i * 2, pixelCount - i);
+}
+
+void gray16ToGray8Sse(const uint8_t* gray16, uint8_t* gray8, size_t pixelCount) {
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(gray16 + i * 2);
+        __m128i lo = _mm_srli_epi16(_mm_loadu_si128(in + 0), 8);
+        __m128i hi = _mm_srli_epi16(_mm_loadu_si128(in + 1), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray8 + i), _mm_packus_epi16(lo, hi));
+    }
+    gray16ToGray8Scalar(gray16 + i * 2, gray8 + i, pixelCount - i);
+}
+
+// 16个相邻字节两两相加，得到8个16位和
+inline __m128i pairSum(__m128i v) {
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(v, 8));
+}
+
+void downsample2xRowSse(const uint8_t* row0, const uint8_t* row1, uint8_t* out, size_t outWidth) {
+    size_t x = 0;
+    for (; x + 16 <= outWidth; x += 16) {
+        const __m128i* a = reinterpret_cast<const __m128i*>(row0 + x * 2);
+        const __m128i* b = reinterpret_cast<const __m128i*>(row1 + x * 2);
+        __m128i lo = _mm_add_epi16(pairSum(_mm_loadu_si128(a)), pairSum(_mm_loadu_si128(b)));
+        __m128i hi =
+            _mm_add_epi16(pairSum(_mm_loadu_si128(a + 1)), pairSum(_mm_loadu_si128(b + 1)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_set1_epi16(2)), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_set1_epi16(2)), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(lo, hi));
+    }
+    downsample2xRowScalar(row0, row1, out, x, outWidth);
+}
+
+// ---------------- AVX2实现 ----------------
+
+PIXEL_TARGET_AVX2 inline __m256i loadMask2(const uint8_t* mask) {
+    return _mm256_broadcastsi128_si256(loadMask(mask));
+}
+
+PIXEL_TARGET_AVX2 inline __m256i loadLanes(const uint8_t* lo, const uint8_t* hi) {
+    return _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)),
+        1);
+}
+
+// 16个像素的灰度值（16位），低128位为前8个像素，高128位为后8个像素
+PIXEL_TARGET_AVX2 inline __m256i rgbToGray16x16(const uint8_t* rgb, const RgbShuffleMasks& m) {
+    // 每个128位通道各自处理8个像素，两个通道的字节偏移相差24，因此可共用同一组掩码
+    __m256i x = loadLanes(rgb, rgb + 24);
+    __m256i y = loadLanes(rgb + 8, rgb + 32);
+    __m256i r = _mm256_or_si256(_mm256_shuffle_epi8(x, loadMask2(m.fromX[0])),
+                                _mm256_shuffle_epi8(y, loadMask2(m.fromY[0])));
+    __m256i g = _mm256_or_si256(_mm256_shuffle_epi8(x, loadMask2(m.fromX[1])),
+                                _mm256_shuffle_epi8(y, loadMask2(m.fromY[1])));
+    __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(x, loadMask2(m.fromX[2])),
+                                _mm256_shuffle_epi8(y, loadMask2(m.fromY[2])));
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(77)),
+                                   _mm256_mullo_epi16(g, _mm256_set1_epi16(150)));
+    sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(b, _mm256_set1_epi16(29)));
+    sum = _mm256_add_epi16(sum, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(sum, 8);
+}
+
+// packus按128位通道交错，重排为顺序输出
+PIXEL_TARGET_AVX2 inline __m256i packOrdered(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+PIXEL_TARGET_AVX2 void rgb24ToGray8Avx2(const uint8_t* rgb, uint8_t* gray, size_t pixelCount) {
+    const RgbShuffleMasks& m = rgbShuffleMasks();
+    size_t i = 0;
+    for (; i + 32 <= pixelCount; i += 32) {
+        __m256i lo = rgbToGray16x16(rgb + i * 3, m);
+        __m256i hi = rgbToGray16x16(rgb + i * 3 + 48, m);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), packOrdered(lo, hi));
+    }
+    rgb24ToGray8Sse(rgb + i * 3, gray + i, pixelCount - i);
+}
+
+PIXEL_TARGET_AVX2 void gray8ToGray16Avx2(const uint8_t* gray8, uint8_t* gray16, size_t pixelCount) {
+    size_t i = 0;
+    for (; i + 32 <= pixelCount; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gray8 + i));
+        __m256i lo = _mm256_unpacklo_epi8(v, v);
+        __m256i hi = _mm256_unpackhi_epi8(v, v);
+        __m256i* out = reinterpret_cast<__m256i*>(gray16 + i * 2);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    gray8ToGray16Sse(gray8 + i, gray16 + i * 2, pixelCount - i);
+}
+
+PIXEL_TARGET_AVX2 void gray16ToGray8Avx2(const uint8_t* gray16, uint8_t* gray8, size_t pixelCount) {
+    size_t i = 0;
+    for (; i + 32 <= pixelCount; i += 32) {
+        const __m256i* in = reinterpret_cast<const __m256i*>(gray16 + i * 2);
+        __m256i lo = _mm256_srli_epi16(_mm256_loadu_si256(in + 0), 8);
+        __m256i hi = _mm256_srli_epi16(_mm256_loadu_si256(in + 1), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray8 + i), packOrdered(lo, hi));
+    }
+    gray16ToGray8Sse(gray16 + i * 2, gray8 + i, pixelCount - i);
+}
+
+PIXEL_TARGET_AVX2 inline __m256i pairSum2(__m256i v) {
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)),
+                            _mm256_srli_epi16(v, 8));
+}
+
+PIXEL_TARGET_AVX2 void downsample2xRowAvx2(const uint8_t* row0,
+                                           const uint8_t* row1,
+                                           uint8_t* out,
+                                           size_t outWidth) {
+    size_t x = 0;
+    for (; x + 32 <= outWidth; x += 32) {
+        const __m256i* a = reinterpret_cast<const __m256i*>(row0 + x * 2);
+        const __m256i* b = reinterpret_cast<const __m256i*>(row1 + x * 2);
+        __m256i lo = _mm256_add_epi16(pairSum2(_mm256_loadu_si256(a)),
+                                      pairSum2(_mm256_loadu_si256(b)));
+        __m256i hi = _mm256_add_epi16(pairSum2(_mm256_loadu_si256(a + 1)),
+                                      pairSum2(_mm256_loadu_si256(b + 1)));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_set1_epi16(2)), 2);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_set1_epi16(2)), 2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), packOrdered(lo, hi));
+    }
+    downsample2xRowScalar(row0, row1, out, x, outWidth);
+}
+
+// ---------------- CPU能力检测 ----------------
+
+PixelKernelIsa detectIsa() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool ssse3 = (info[2] & (1 << 9)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool ssse3 = __builtin_cpu_supports("ssse3");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return PixelKernelIsa::Avx2;
+    }
+    return ssse3 ? PixelKernelIsa::Sse : PixelKernelIsa::Scalar;
+}
+
+#else
+
+PixelKernelIsa detectIsa() { return PixelKernelIsa::Scalar; }
+
+#endif  // PIXEL_KERNELS_X86
+
+PixelKernelIsa supportedIsa() {
+    static const PixelKernelIsa isa = detectIsa();
+    return isa;
+}
+
+std::atomic<PixelKernelIsa> g_isa{supportedIsa()};
+
+}  // namespace
+
+PixelKernelIsa activePixelKernelIsa() { return g_isa.load(std::memory_order_relaxed); }
+
+PixelKernelIsa setPixelKernelIsa(PixelKernelIsa isa) {
+    if (static_cast<int>(isa) > static_cast<int>(supportedIsa())) {
+        isa = supportedIsa();
+    }
+    g_isa.store(isa, std::memory_order_relaxed);
+    return isa;
+}
+
+const char* pixelKernelIsaName(PixelKernelIsa isa) {
+    switch (isa) {
+        case PixelKernelIsa::Sse:
+            return "sse";
+        case PixelKernelIsa::Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void rgb24ToGray8(const uint8_t* rgb, uint8_t* gray, size_t pixelCount) {
+    switch (activePixelKernelIsa()) {
+#ifdef PIXEL_KERNELS_X86
+        case PixelKernelIsa::Avx2:
+            return rgb24ToGray8Avx2(rgb, gray, pixelCount);
+        case PixelKernelIsa::Sse:
+            return rgb24ToGray8Sse(rgb, gray, pixelCount);
+#endif
+        default:
+            return rgb24ToGray8Scalar(rgb, gray, pixelCount);
+    }
+}
+
+void gray8ToRgb24(const uint8_t* gray, uint8_t* rgb, size_t pixelCount) {
+    switch (activePixelKernelIsa()) {
+#ifdef PIXEL_KERNELS_X86
+        // 输出带宽受限，AVX2版本没有明显收益，与SSE共用实现
+        case PixelKernelIsa::Avx2:
+        case PixelKernelIsa::Sse:
+            return gray8ToRgb24Sse(gray, rgb, pixelCount);
+#endif
+        default:
+            return gray8ToRgb24Scalar(gray, rgb, pixelCount);
+    }
+}
+
+void gray8ToGray16(const uint8_t* gray8, uint8_t* gray16, size_t pixelCount) {
+    switch (activePixelKernelIsa()) {
+#ifdef PIXEL_KERNELS_X86
+        case PixelKernelIsa::Avx2:
+            return gray8ToGray16Avx2(gray8, gray16, pixelCount);
+        case PixelKernelIsa::Sse:
+            return gray8ToGray16Sse(gray8, gray16, pixelCount);
+#endif
+        default:
+            return gray8ToGray16Scalar(gray8, gray16, pixelCount);
+    }
+}
+
+void gray16ToGray8(const uint8_t* gray16, uint8_t* gray8, size_t pixelCount) {
+    switch (activePixelKernelIsa()) {
+#ifdef PIXEL_KERNELS_X86
+        case PixelKernelIsa::Avx2:
+            return gray16ToGray8Avx2(gray16, gray8, pixelCount);
+        case PixelKernelIsa::Sse:
+            return gray16ToGray8Sse(gray16, gray8, pixelCount);
+#endif
+        default:
+            return gray16ToGray8Scalar(gray16, gray8, pixelCount);
+    }
+}
+
+void downsampleBoxGray8(const uint8_t* src,
+                        size_t width,
+                        size_t height,
+                        size_t srcStride,
+                        size_t factor,
+                        uint8_t* dst) {
+    if (factor != 2) {
+        downsampleBoxScalar(src, width, height, srcStride, 1, factor == 0 ? 1 : factor, dst);
+        return;
+    }
+
+    size_t outWidth = width / 2;
+    size_t outHeight = height / 2;
+    PixelKernelIsa isa = activePixelKernelIsa();
+    for (size_t y = 0; y < outHeight; y++) {
+        const uint8_t* row0 = src + y * 2 * srcStride;
+        const uint8_t* row1 = row0 + srcStride;
+        uint8_t* out = dst + y * outWidth;
+        switch (isa) {
+#ifdef PIXEL_KERNELS_X86
+            case PixelKernelIsa::Avx2:
+                downsample2xRowAvx2(row0, row1, out, outWidth);
+                break;
+            case PixelKernelIsa::Sse:
+                downsample2xRowSse(row0, row1, out, outWidth);
+                break;
+#endif
+            default:
+                downsample2xRowScalar(row0, row1, out, 0, outWidth);
+                break;
+        }
+    }
+}
+
+void downsampleBoxRgb24(const uint8_t* src,
+                        size_t width,
+                        size_t height,
+                        size_t srcStride,
+                        size_t factor,
+                        uint8_t* dst) {
+    downsampleBoxScalar(src, width, height, srcStride, 3, factor == 0 ? 1 : factor, dst);
+}
@@ -0,0 +1,180 @@
+#include "trace_recorder.h"
+#include <nlohmann/json.hpp>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+// 未结束的请求数量上限，防止没有最终响应的请求无限堆积
+const size_t kMaxOpenRequests = 100000;
+
+double toMicros(TraceRecorder::Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time.time_since_epoch()).count();
+}
+
+// 为每个线程分配一个较小的编号，便于在查看器中区分
+int currentThreadId() {
+    static std::atomic<int> next_id{1};
+    thread_local int id = next_id.fetch_add(1);
+    return id;
+}
+
+}  // namespace
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::~TraceRecorder() { disable(); }
+
+bool TraceRecorder::enable(const std::string& path, const std::string& processName) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_out.is_open()) {
+        return true;
+    }
+
+    m_out.open(path, std::ios::out | std::ios::trunc);
+    if (!m_out) {
+        return false;
+    }
+
+#ifdef _WIN32
+    m_pid = _getpid();
+#else
+    m_pid = static_cast<int>(getpid());
+#endif
+
+    // JSON数组格式允许省略结尾的']'，进程被强制结束时文件依然可以被加载
+    m_out << "[\n";
+    json meta = {{"name", "process_name"},
+                 {"ph", "M"},
+                 {"pid", m_pid},
+                 {"args", {{"name", processName}}}};
+    writeEvent(meta.dump());
+    m_out.flush();
+
+    m_enabled.store(true);
+    return true;
+}
+
+void TraceRecorder::disable() {
+    m_enabled.store(false);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_out.is_open()) {
+        // 以一个元数据事件收尾，补全数组结尾
+        json meta = {{"name", "process_labels"},
+                     {"ph", "M"},
+                     {"pid", m_pid},
+                     {"args", {{"labels", "trace complete"}}}};
+        m_out << meta.dump() << "\n]\n";
+        m_out.close();
+    }
+    m_last_stage.clear();
+}
+
+void TraceRecorder::mark(const std::string& requestId, const char* stage, Clock::time_point time) {
+    if (!enabled()) {
+        return;
+    }
+    record(requestId, stage, time, false);
+}
+
+void TraceRecorder::finish(const std::string& requestId, const char* stage) {
+    if (!enabled()) {
+        return;
+    }
+    record(requestId, stage, Clock::now(), true);
+}
+
+void TraceRecorder::record(const std::string& requestId,
+                           const char* stage,
+                           Clock::time_point time,
+                           bool last) {
+    int tid = currentThreadId();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_out.is_open()) {
+        return;
+    }
+
+    // 阶段本身记录为瞬时事件
+    json instant = {{"name", stage},
+                    {"cat", "request"},
+                    {"ph", "n"},
+                    {"id", requestId},
+                    {"ts", toMicros(time)},
+                    {"pid", m_pid},
+                    {"tid", tid},
+                    {"args", {{"requestId", requestId}}}};
+    writeEvent(instant.dump());
+
+    // 与上一阶段之间的耗时记录为嵌套的异步区间
+    auto it = m_last_stage.find(requestId);
+    if (it != m_last_stage.end()) {
+        std::string name = it->second.stage + " -> " + stage;
+        json begin = {{"name", name},
+                      {"cat", "request"},
+                      {"ph", "b"},
+                      {"id", requestId},
+                      {"ts", toMicros(it->second.time)},
+                      {"pid", m_pid},
+                      {"tid", tid},
+                      {"args", {{"requestId", requestId}}}};
+        json end = {{"name", name},
+                    {"cat", "request"},
+                    {"ph", "e"},
+                    {"id", requestId},
+                    {"ts", toMicros(time)},
+                    {"pid", m_pid},
+                    {"tid", tid}};
+        writeEvent(begin.dump());
+        writeEvent(end.dump());
+    }
+
+    if (last) {
+        // 整个请求的区间，包住上面各阶段之间的区间
+        Clock::time_point start = it != m_last_stage.end() ? it->second.start : time;
+        json begin = {{"name", "request " + requestId},
+                      {"cat", "request"},
+                      {"ph", "b"},
+                      {"id", requestId},
+                      {"ts", toMicros(start)},
+                      {"pid", m_pid},
+                      {"tid", tid},
+                      {"args", {{"requestId", requestId}}}};
+        json end = {{"name", "request " + requestId},
+                    {"cat", "request"},
+                    {"ph", "e"},
+                    {"id", requestId},
+                    {"ts", toMicros(time)},
+                    {"pid", m_pid},
+                    {"tid", tid}};
+        writeEvent(begin.dump());
+        writeEvent(end.dump());
+
+        if (it != m_last_stage.end()) {
+            m_last_stage.erase(it);
+        }
+        m_out.flush();
+        return;
+    }
+
+    if (it != m_last_stage.end()) {
+        it->second.stage = stage;
+        it->second.time = time;
+    } else {
+        if (m_last_stage.size() >= kMaxOpenRequests) {
+            m_last_stage.clear();
+        }
+        m_last_stage[requestId] = {stage, time, time};
+    }
+}
+
+void TraceRecorder::writeEvent(const std::string& event) { m_out << event << ",\n"; }
@@ -0,0 +1,246 @@
+#include "capture_file.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kCaptureMagic[8] = {'D', 'E', 'V', 'C', 'A', 'P', '0', '1'};
+const uint32_t kCaptureVersion = 1;
+const size_t kFileHeaderSize = 16;
+const size_t kRecordHeaderSize = 32;
+const size_t kDatasetHeaderSize = 24;
+const uint32_t kDatasetHasVariance = 1;
+
+void writeLe(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint64_t readLe(const uint8_t* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+size_t padding(size_t size) { return (8 - size % 8) % 8; }
+
+}  // namespace
+
+std::shared_ptr<CaptureWriter> CaptureWriter::create(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return nullptr;
+    }
+    uint8_t header[kFileHeaderSize] = {};
+    std::memcpy(header, kCaptureMagic, sizeof(kCaptureMagic));
+    writeLe(header + 8, kCaptureVersion, 4);
+    if (std::fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        std::fclose(file);
+        return nullptr;
+    }
+    return std::shared_ptr<CaptureWriter>(new CaptureWriter(file));
+}
+
+CaptureWriter::CaptureWriter(std::FILE* file)
+    : m_file(file), m_start(std::chrono::steady_clock::now()) {}
+
+CaptureWriter::~CaptureWriter() { std::fclose(m_file); }
+
+uint64_t CaptureWriter::records() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_records;
+}
+
+void CaptureWriter::writeFrame(uint32_t device, const std::string& frame) {
+    const void* parts[] = {frame.data()};
+    size_t sizes[] = {frame.size()};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    writeRecord(CaptureRecordType::Frame, device, 0, parts, sizes, 1);
+}
+
+void CaptureWriter::writeDataset(uint32_t device,
+                                 uint32_t durationUs,
+                                 const SurfaceMap& map,
+                                 const SurfaceMap* variance) {
+    size_t pixels = static_cast<size_t>(map.width) * map.height;
+    bool hasVariance = variance && variance->heights.size() == pixels && pixels > 0;
+    uint8_t header[kDatasetHeaderSize] = {};
+    writeLe(header, map.width, 2);
+    writeLe(header + 2, map.height, 2);
+    writeLe(header + 4, hasVariance ? kDatasetHasVariance : 0, 4);
+    writeLe(header + 8, map.validPixels, 8);
+    writeLe(header + 16, hasVariance ? variance->validPixels : 0, 8);
+
+    const double* varianceHeights = hasVariance ? variance->heights.data() : nullptr;
+    const void* parts[] = {header, map.heights.data(), varianceHeights};
+    size_t sizes[] = {
+        sizeof(header), pixels * sizeof(double), hasVariance ? pixels * sizeof(double) : 0};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    writeRecord(CaptureRecordType::Dataset, device, durationUs, parts, sizes, 3);
+}
+
+void CaptureWriter::writeRecord(CaptureRecordType type,
+                                uint32_t device,
+                                uint32_t durationUs,
+                                const void* const* parts,
+                                const size_t* sizes,
+                                size_t count) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += sizes[i];
+    }
+    uint64_t timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - m_start)
+                               .count();
+    uint8_t header[kRecordHeaderSize] = {};
+    writeLe(header, static_cast<uint32_t>(type), 4);
+    writeLe(header + 4, device, 4);
+    writeLe(header + 8, timestampUs, 8);
+    writeLe(header + 16, size, 8);
+    writeLe(header + 24, durationUs, 4);
+
+    static const uint8_t zeros[8] = {};
+    std::fwrite(header, 1, sizeof(header), m_file);
+    for (size_t i = 0; i < count; i++) {
+        if (sizes[i] > 0) {
+            std::fwrite(parts[i], 1, sizes[i], m_file);
+        }
+    }
+    std::fwrite(zeros, 1, padding(size), m_file);
+    m_records++;
+}
+
+std::shared_ptr<const CaptureReader> CaptureReader::open(const std::string& path,
+                                                         std::string& error) {
+    std::shared_ptr<CaptureReader> reader(new CaptureReader());
+    const uint8_t* data = nullptr;
+    size_t bytes = 0;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Cannot open capture file: " + path;
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        bytes = static_cast<size_t>(info.st_size);
+        void* memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            reader->m_memory = memory;
+            reader->m_bytes = bytes;
+            data = static_cast<const uint8_t*>(memory);
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "Cannot open capture file: " + path;
+        return nullptr;
+    }
+    reader->m_copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = reader->m_copy.data();
+    bytes = reader->m_copy.size();
+#endif
+    if (!data || bytes < kFileHeaderSize || std::memcmp(data, kCaptureMagic, 8) != 0 ||
+        readLe(data + 8, 4) != kCaptureVersion) {
+        error = "Not a capture file: " + path;
+        return nullptr;
+    }
+
+    // 最后一条记录不完整时（录制进程被强制结束）忽略它
+    size_t offset = kFileHeaderSize;
+    while (offset + kRecordHeaderSize <= bytes) {
+        const uint8_t* header = data + offset;
+        CaptureRecord record;
+        uint32_t type = static_cast<uint32_t>(readLe(header, 4));
+        record.device = static_cast<uint32_t>(readLe(header + 4, 4));
+        record.timestampUs = readLe(header + 8, 8);
+        record.size = static_cast<size_t>(readLe(header + 16, 8));
+        record.durationUs = static_cast<uint32_t>(readLe(header + 24, 4));
+        record.data = header + kRecordHeaderSize;
+        if (record.size > bytes - offset - kRecordHeaderSize) {
+            break;
+        }
+        offset += kRecordHeaderSize + record.size + padding(record.size);
+
+        std::vector<std::vector<CaptureRecord>>* lists = nullptr;
+        if (type == static_cast<uint32_t>(CaptureRecordType::Frame)) {
+            lists = &reader->m_frames;
+        } else if (type == static_cast<uint32_t>(CaptureRecordType::Dataset)) {
+            lists = &reader->m_datasets;
+        } else {
+            continue;  // 未知类型的记录，跳过
+        }
+        record.type = static_cast<CaptureRecordType>(type);
+        if (record.device >= reader->m_frames.size()) {
+            reader->m_frames.resize(record.device + 1);
+            reader->m_datasets.resize(record.device + 1);
+        }
+        (*lists)[record.device].push_back(record);
+    }
+    if (reader->m_frames.empty()) {
+        error = "Capture file has no records: " + path;
+        return nullptr;
+    }
+    return reader;
+}
+
+CaptureReader::~CaptureReader() {
+#ifndef _WIN32
+    if (m_memory) {
+        munmap(m_memory, m_bytes);
+    }
+#endif
+}
+
+const std::vector<CaptureRecord>& CaptureReader::frames(uint32_t device) const {
+    return m_frames[device % m_frames.size()];
+}
+
+const std::vector<CaptureRecord>& CaptureReader::datasets(uint32_t device) const {
+    return m_datasets[device % m_datasets.size()];
+}
+
+bool CaptureReader::decodeDataset(const CaptureRecord& record,
+                                  SurfaceMap& map,
+                                  SurfaceMap& variance) {
+    if (record.type != CaptureRecordType::Dataset || record.size < kDatasetHeaderSize) {
+        return false;
+    }
+    const uint8_t* data = record.data;
+    uint16_t width = static_cast<uint16_t>(readLe(data, 2));
+    uint16_t height = static_cast<uint16_t>(readLe(data + 2, 2));
+    bool hasVariance = (readLe(data + 4, 4) & kDatasetHasVariance) != 0;
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t bytes = pixels * sizeof(double);
+    if (record.size != kDatasetHeaderSize + bytes * (hasVariance ? 2 : 1)) {
+        return false;
+    }
+
+    map.width = width;
+    map.height = height;
+    map.validPixels = static_cast<size_t>(readLe(data + 8, 8));
+    map.heights.resize(pixels);
+    std::memcpy(map.heights.data(), data + kDatasetHeaderSize, bytes);
+
+    variance = SurfaceMap();
+    if (hasVariance) {
+        variance.width = width;
+        variance.height = height;
+        variance.validPixels = static_cast<size_t>(readLe(data + 16, 8));
+        variance.heights.resize(pixels);
+        std::memcpy(variance.heights.data(), data + kDatasetHeaderSize + bytes, bytes);
+    }
+    return true;
+}
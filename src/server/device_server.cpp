@@ -1,65 +1,509 @@
 #include "device_server.h"
 #include "time_utils.h"
+#include "command_types.h"
+#include "trace_recorder.h"
+#include "binary_header.h"
+#include "frame_codec.h"
+#include "frame_ring.h"
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <ctime>
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// 视频流帧率
+const int kStreamFps = 30;
+// 监视对准视频流分辨率（RGB彩色）
+const uint16_t kAlignWidth = 1280;
+const uint16_t kAlignHeight = 720;
+// 干涉视频流分辨率（灰度）
+const uint16_t kViewWidth = 1024;
+const uint16_t kViewHeight = 1024;
+// 订阅者积压（尚未写出的视频流及更高优先级数据）超过该帧数时丢弃新帧
+const size_t kMaxBufferedFrames = 2;
+// streamId高字节表示消息类型
+const uint32_t kStreamIdPrefix = 0x01000000;
+const uint32_t kDatasetIdPrefix = 0x02000000;
+// 快照的contexId（流序号0，视频流从1开始编号）
+const uint32_t kSnapshotContexId = kStreamIdPrefix;
+// 快照请求后保持采集的时间，期间连续取单帧无需等待新一帧
+const std::chrono::seconds kSnapshotKeepAlive(5);
+// 设备事件主题：设备状态、测量/校准进度、新数据集
+const char* const kEventTopics[] = {"status", "progress", "dataset"};
+// 订阅者积压（尚未写出的事件及命令响应）超过该字节数时暂停发送事件，期间同一主题的新事件替换旧事件
+const size_t kMaxEventBacklog = 64 * 1024;
+// 暂停发送后重新检查发送缓冲的间隔
+const std::chrono::milliseconds kEventRetryInterval(10);
+// 检查其他工作进程是否修改了共享设备状态的间隔
+const std::chrono::milliseconds kSharedStatePollInterval(20);
+// getSurfaceData与getSnapshot分段发送的最小段长（字节）
+const int64_t kMinChunkSize = 4096;
+// 测量开始后该时间内到达的参数相同的请求并入这次测量，采集刚开始，结果对它们同样是新的
+const std::chrono::milliseconds kMeasureCoalesceWindow(200);
+
+// 像素格式名称，与startStream的format参数一致
+const char* pixelFormatName(uint8_t format) {
+    switch (static_cast<BinaryFormat>(format)) {
+        case BinaryFormat::Gray8:
+            return "gray8";
+        case BinaryFormat::Gray16:
+            return "gray16";
+        case BinaryFormat::Rgb24:
+            return "rgb24";
+        default:
+            return "unknown";
+    }
+}
+
+bool isEventTopic(const std::string& topic) {
+    for (const char* name : kEventTopics) {
+        if (topic == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 解析subscribe/unsubscribe的topics参数，缺省为全部主题
+bool parseEventTopics(const json& params, std::set<std::string>& topics, std::string& error) {
+    topics.clear();
+    if (!params.is_object() || !params.contains("topics")) {
+        topics.insert(std::begin(kEventTopics), std::end(kEventTopics));
+        return true;
+    }
+    const json& list = params["topics"];
+    if (!list.is_array()) {
+        error = "Invalid topics";
+        return false;
+    }
+    for (const json& topic : list) {
+        std::string name = topic.is_string() ? topic.get<std::string>() : topic.dump();
+        if (!isEventTopic(name)) {
+            error = "Unknown topic: " + name;
+            return false;
+        }
+        topics.insert(name);
+    }
+    return true;
+}
+
+// 把线程固定到一个CPU核（仅Linux，其他平台忽略）
+void pinThreadToCpu(std::thread& thread, unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+}
 
-using websocketpp::lib::bind;
-using websocketpp::lib::placeholders::_1;
-using websocketpp::lib::placeholders::_2;
+// 数据集ID的文本形式，如"0x02000001"
+std::string datasetIdText(uint32_t datasetId) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "0x%08X", datasetId);
+    return text;
+}
 
-DeviceServer::DeviceServer() {
+// 解析分段长度chunkSize：0为不分段（缺省），非0时不小于kMinChunkSize
+bool parseChunkSize(const json& params, size_t& chunkSize, std::string& error) {
+    chunkSize = 0;
+    if (!params.is_object() || !params.contains("chunkSize")) {
+        return true;
+    }
+    const json& value = params["chunkSize"];
+    if (!value.is_number_integer() || value.get<int64_t>() < 0 ||
+        (value.get<int64_t>() > 0 && value.get<int64_t>() < kMinChunkSize)) {
+        error = "Invalid chunkSize";
+        return false;
+    }
+    chunkSize = static_cast<size_t>(value.get<int64_t>());
+    return true;
+}
+
+// 改变设备或连接状态的命令：客户端重发时返回缓存的最终响应，不再执行一次
+// 查询命令没有副作用，重发时直接重新执行；面形与快照的二进制数据也不缓存
+bool isReplayable(CommandType type) {
+    switch (type) {
+    case CommandType::SetAlignViewMode:
+    case CommandType::StartStream:
+    case CommandType::StopStream:
+    case CommandType::ExcuteMeasurement:
+    case CommandType::StopMeasure:
+    case CommandType::Subscribe:
+    case CommandType::Unsubscribe:
+        return true;
+    default:
+        return false;
+    }
+}
+
+}  // namespace
+
+template <typename Config>
+BasicDeviceServer<Config>::BasicDeviceServer(const DeviceServerOptions& options)
+    : m_reuse_port(options.reusePort),
+      m_shared_state(options.sharedState),
+      m_worker_index(options.workerIndex),
+      m_recorder(options.recorder),
+      m_replay(options.replay),
+      m_replay_speed(options.replaySpeed),
+      m_socket_options(options.socket) {
     // 初始化WebSocket服务器
-    m_server.init_asio();
+    if constexpr (uses_asio_transport<Config>::value) {
+        m_server.init_asio();
+        // 接受连接后、WebSocket握手之前设置套接字选项
+        m_server.set_tcp_pre_init_handler([this](connection_hdl hdl) {
+            websocketpp::lib::error_code ec;
+            typename server_type::connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+            if (ec) {
+                return;
+            }
+            auto socketError = applySocketOptions(con->get_raw_socket(), m_socket_options);
+            if (socketError) {
+                std::cerr << "设置套接字选项失败: " << socketError.message() << std::endl;
+            }
+        });
+    }
+    if (options.maxMessageSize > 0) {
+        m_server.set_max_message_size(options.maxMessageSize);
+    }
 
-    // 日志禁用
-    m_server.set_access_channels(websocketpp::log::alevel::all);
-    m_server.clear_access_channels(websocketpp::log::alevel::frame_payload |
-                                   websocketpp::log::alevel::frame_header);
+    // 访问日志只保留连接建立、关闭与失败，不记录每个控制帧与握手细节
+    m_server.clear_access_channels(websocketpp::log::alevel::all);
+    m_server.set_access_channels(websocketpp::log::alevel::connect |
+                                 websocketpp::log::alevel::disconnect |
+                                 websocketpp::log::alevel::fail);
 
     // 设置消息处理回调
-    m_server.set_message_handler(bind(&DeviceServer::onMessage, this, ::_1, ::_2));
-    m_server.set_open_handler(bind(&DeviceServer::onOpen, this, ::_1));
-    m_server.set_close_handler(bind(&DeviceServer::onClose, this, ::_1));
+    // 每个连接复制一份回调，只捕获this的lambda存放在std::function内部，不为每个连接分配堆内存
+    m_server.set_message_handler(
+        [this](connection_hdl hdl, message_ptr msg) { onMessage(hdl, msg); });
+    m_server.set_open_handler([this](connection_hdl hdl) { onOpen(hdl); });
+    m_server.set_close_handler([this](connection_hdl hdl) { onClose(hdl); });
+    m_server.set_validate_handler([this](connection_hdl hdl) { return onValidate(hdl); });
+    m_server.set_http_handler([this](connection_hdl hdl) { onHttp(hdl); });
+
+    // 创建设备，重复的deviceId只保留第一个
+    std::vector<std::string> deviceIds = options.deviceIds;
+    if (deviceIds.empty()) {
+        deviceIds = DeviceServerOptions().deviceIds;
+    }
+    for (const std::string& deviceId : deviceIds) {
+        if (m_device_index.count(deviceId)) {
+            continue;
+        }
+        auto device = std::make_unique<Device>();
+        device->deviceId = deviceId;
+        device->shard = static_cast<unsigned>(m_devices.size());
+        m_device_index[deviceId] = device.get();
+        m_devices.push_back(std::move(device));
+    }
 
-    // 初始化默认流模式
-    m_current_stream_mode = "continuous";
+    // 每台设备启动视频流生产线程（没有订阅者时处于等待状态）、事件发送线程与任务线程
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (const std::unique_ptr<Device>& entry : m_devices) {
+        Device& device = *entry;
+        publishStatus(device);
+        device.streamThread = std::thread(&BasicDeviceServer::streamLoop, this, std::ref(device));
+        device.eventThread = std::thread(&BasicDeviceServer::eventLoop, this, std::ref(device));
+        device.jobThread = std::thread(&BasicDeviceServer::jobLoop, this, std::ref(device));
+        if (options.pinDevices) {
+            unsigned cpu = device.shard % cores;
+            pinThreadToCpu(device.streamThread, cpu);
+            pinThreadToCpu(device.eventThread, cpu);
+            pinThreadToCpu(device.jobThread, cpu);
+        }
+    }
+    if (m_shared_state) {
+        m_shared_state_thread = std::thread(&BasicDeviceServer::sharedStateLoop, this);
+    }
 }
 
-void DeviceServer::run(uint16_t port) {
-    // 设置服务器监听端口
-    m_server.listen(port);
+template <typename Config>
+BasicDeviceServer<Config>::~BasicDeviceServer() {
+    m_running = false;
+    for (const std::unique_ptr<Device>& entry : m_devices) {
+        Device& device = *entry;
+        // 各线程在持有对应的锁时检查m_running，加锁保证通知不会丢失
+        { std::lock_guard<std::mutex> lock(device.streamMutex); }
+        device.streamCv.notify_all();
+        { std::lock_guard<std::mutex> lock(device.eventMutex); }
+        device.eventCv.notify_all();
+        { std::lock_guard<std::mutex> lock(device.jobMutex); }
+        device.jobCv.notify_all();
+    }
+    if (m_shared_state_thread.joinable()) {
+        m_shared_state_thread.join();
+    }
+    // 正在执行的测量或校准任务完成后任务线程才会退出，队列中剩余的任务被丢弃
+    for (const std::unique_ptr<Device>& entry : m_devices) {
+        for (std::thread* thread :
+             {&entry->streamThread, &entry->eventThread, &entry->jobThread}) {
+            if (thread->joinable()) {
+                thread->join();
+            }
+        }
+    }
+}
 
-    // 开始接收连接
-    m_server.start_accept();
+// 单线程不变式：DeviceServerConfig关闭了transport_config::enable_multithreading，连接没有asio
+// strand，读写回调、定时器与websocketpp对连接状态的修改都不加锁，只在运行io_service的线程中安全。
+// 因此io_service只能由调用run()的这一个线程运行；任务、视频流与事件线程只通过SendScheduler发送，
+// websocketpp把它们的写操作投递到该线程。多个线程调用run()会破坏这一前提
+template <typename Config>
+void BasicDeviceServer<Config>::run(uint16_t port) {
+    if constexpr (uses_asio_transport<Config>::value) {
+        static_assert(!Config::transport_config::enable_multithreading,
+                      "BasicDeviceServer expects one io thread without per-connection strands");
+        bool alreadyRunning = m_io_running.exchange(true);
+        assert(!alreadyRunning && "BasicDeviceServer::run() must be called from one thread only");
+        if (alreadyRunning) {
+            std::cerr << "run() is already running on another thread" << std::endl;
+            return;
+        }
 
-    // 启动服务器
-    try {
-        std::cout << "服务器已启动，监听端口: " << port << std::endl;
-        m_server.run();
-    } catch (websocketpp::exception const& e) {
-        std::cerr << "服务器异常: " << e.what() << std::endl;
-    } catch (...) {
-        std::cerr << "未知异常" << std::endl;
+        typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ip::tcp::acceptor>
+            acceptor_ptr;
+        m_server.set_tcp_pre_bind_handler([this](acceptor_ptr acceptor) {
+            websocketpp::lib::asio::error_code ec;
+            // 多个工作进程绑定同一端口，由内核在它们之间分配新连接
+            if (m_reuse_port) {
+#ifdef SO_REUSEPORT
+                typedef websocketpp::lib::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                                              SO_REUSEPORT>
+                    reuse_port;
+                acceptor->set_option(reuse_port(true), ec);
+#else
+                std::cerr << "SO_REUSEPORT is not supported on this platform" << std::endl;
+#endif
+            }
+            // 接收缓冲在监听前设置，新连接继承该值并据此协商TCP窗口缩放
+            if (!ec && m_socket_options.receiveBuffer > 0) {
+                acceptor->set_option(websocketpp::lib::asio::socket_base::receive_buffer_size(
+                                         m_socket_options.receiveBuffer),
+                                     ec);
+            }
+            return ec;
+        });
+
+#ifndef _WIN32
+        // 重启时上次的连接可能仍处于TIME_WAIT，不设置时绑定失败（Windows上该选项允许抢占端口）
+        m_server.set_reuse_addr(true);
+#endif
+        // 设置服务器监听端口
+        m_server.listen(port);
+
+        // 开始接收连接
+        m_server.start_accept();
+
+        // 启动服务器
+        try {
+            std::cout << "服务器已启动，监听端口: " << port << std::endl;
+            m_server.run();
+        } catch (websocketpp::exception const& e) {
+            std::cerr << "服务器异常: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "未知异常" << std::endl;
+        }
+        m_io_running = false;
+    } else {
+        // 进程内传输没有监听端口，连接由调用方通过endpoint()创建
+        std::cerr << "run() requires an asio transport, port " << port << " ignored" << std::endl;
     }
 }
 
-void DeviceServer::onOpen(connection_hdl hdl) {
+template <typename Config>
+void BasicDeviceServer<Config>::onOpen(connection_hdl hdl) {
     std::cout << "Connection opened" << std::endl;
-    m_connections.insert(hdl);
+    auto session = std::make_shared<Session>();
+    session->sessionId = m_next_session_id++;
+    session->hdl = hdl;
+    session->opened = std::chrono::steady_clock::now();
+    session->sender = std::make_shared<SendScheduler<server_type>>(m_server, hdl);
+    session->device = deviceForResource(m_server.get_con_from_hdl(hdl)->get_resource());
+    if (!session->device) {
+        session->device = m_devices.front().get();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(m_session_mutex);
+        m_sessions.insert(sessionKey(hdl), std::move(session));
+    }
+    m_metrics.connectionOpened();
+}
+
+template <typename Config>
+std::shared_ptr<typename BasicDeviceServer<Config>::Session>
+BasicDeviceServer<Config>::findSession(connection_hdl hdl) {
+    const void* key = sessionKey(hdl);
+    if (!key) {
+        return nullptr;
+    }
+    std::shared_lock<std::shared_mutex> lock(m_session_mutex);
+    return m_sessions.get(key);
 }
 
-void DeviceServer::onClose(connection_hdl hdl) {
+template <typename Config>
+void BasicDeviceServer<Config>::onClose(connection_hdl hdl) {
     std::cout << "Connection closed" << std::endl;
-    m_connections.erase(hdl);
+    m_metrics.connectionClosed();
+
+    // 连接关闭时取消其在各设备上的视频流与事件订阅，尚未完成的请求随会话一起释放
+    const void* key = sessionKey(hdl);
+    std::shared_ptr<Session> session;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_session_mutex);
+        session = m_sessions.erase(key);
+    }
+    if (session) {
+        session->sender->close();
+    }
+    for (const std::unique_ptr<Device>& entry : m_devices) {
+        Device& device = *entry;
+        bool streamed = false;
+        {
+            std::lock_guard<std::mutex> lock(device.streamMutex);
+            streamed = device.streamSubscribers.erase(key) != nullptr;
+            device.isStreaming = !device.streamSubscribers.empty();
+        }
+        {
+            std::lock_guard<std::mutex> lock(device.eventMutex);
+            device.eventSubscribers.erase(key);
+        }
+        if (streamed) {
+            publishStatus(device);
+        }
+    }
 }
 
-void DeviceServer::onMessage(connection_hdl hdl, message_ptr msg) {
+template <typename Config>
+bool BasicDeviceServer<Config>::onValidate(connection_hdl hdl) {
+    typename server_type::connection_ptr con = m_server.get_con_from_hdl(hdl);
+    if (!deviceForResource(con->get_resource())) {
+        con->set_status(websocketpp::http::status_code::not_found);
+        return false;
+    }
+    return true;
+}
+
+template <typename Config>
+typename BasicDeviceServer<Config>::Device* BasicDeviceServer<Config>::deviceForResource(
+    const std::string& resource) {
+    const std::string prefix = "/devices/";
+    if (resource.compare(0, prefix.size(), prefix) != 0) {
+        return m_devices.front().get();
+    }
+    // 去掉查询参数
+    std::string deviceId = resource.substr(prefix.size());
+    deviceId = deviceId.substr(0, deviceId.find('?'));
+    auto it = m_device_index.find(deviceId);
+    return it == m_device_index.end() ? nullptr : it->second;
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::onHttp(connection_hdl hdl) {
+    typename server_type::connection_ptr con = m_server.get_con_from_hdl(hdl);
+
+    if (con->get_resource() == "/metrics") {
+        con->set_status(websocketpp::http::status_code::ok);
+        con->append_header("Content-Type", "text/plain; version=0.0.4");
+        con->set_body(m_metrics.toPrometheus());
+    } else {
+        con->set_status(websocketpp::http::status_code::not_found);
+        con->set_body("Not found");
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sendJson(connection_hdl hdl, const json& response) {
+    sendPayload(hdl,
+                response.value("command", ""),
+                response.value("requestId", ""),
+                response.value("status", ""),
+                response.dump());
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sendPayload(connection_hdl hdl,
+                                            const std::string& command,
+                                            const std::string& requestId,
+                                            const std::string& status,
+                                            const std::string& payload) {
+    TraceRecorder& tracer = TraceRecorder::instance();
+    // pending等中间状态不算请求结束
+    bool isFinal = status == "success" || status == "error" || status == "timeout";
+
+    tracer.mark(requestId, "responseQueued");
+    std::shared_ptr<Session> session = findSession(hdl);
+    if (session &&
+        session->sender->send(SendPriority::Control, payload, websocketpp::frame::opcode::text)) {
+        m_metrics.addBytesOut(payload.size());
+        session->messagesSent.fetch_add(1, std::memory_order_relaxed);
+        session->bytesSent.fetch_add(payload.size(), std::memory_order_relaxed);
+    }
+
+    // 命令响应不受发送窗口限制，send返回时已交给传输层写出
+    if (!isFinal) {
+        tracer.mark(requestId, "responseWritten");
+        return;
+    }
+    tracer.finish(requestId, "responseWritten");
+    if (session) {
+        session->responses.complete(requestId, command, payload);
+    }
+
+    CommandType type = stringToCommandType(command);
+    std::chrono::steady_clock::time_point received;
+    bool found = false;
+    if (session) {
+        std::lock_guard<std::mutex> lock(session->inflightMutex);
+        auto it = session->inflight.find(requestId);
+        if (it != session->inflight.end()) {
+            type = it->second.type;
+            received = it->second.received;
+            found = true;
+            session->inflight.erase(it);
+        }
+    }
+
+    if (status == "error") {
+        m_metrics.recordError(type);
+    } else if (status == "timeout") {
+        m_metrics.recordTimeout(type);
+    }
+    if (found) {
+        m_metrics.recordLatency(type, std::chrono::steady_clock::now() - received);
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::onMessage(connection_hdl hdl, message_ptr msg) {
     try {
+        auto received = std::chrono::steady_clock::now();
+
         // 解析JSON消息
         std::string payload = msg->get_payload();
+        m_metrics.addBytesIn(payload.size());
         json message = json::parse(payload);
+        auto parsed = std::chrono::steady_clock::now();
 
         // 检查消息格式
         if (!message.contains("command") || !message.contains("requestId")) {
@@ -74,27 +518,109 @@ void DeviceServer::onMessage(connection_hdl hdl, message_ptr msg) {
         std::cout << "收到请求: [" << command << "], ID: " << requestId << " (" << readableTime
                   << ")" << std::endl;
 
+        TraceRecorder& tracer = TraceRecorder::instance();
+        tracer.mark(requestId, "frameReceived", received);
+        tracer.mark(requestId, "parsed", parsed);
+
+        // 记录请求，等待最终响应时统计延迟
+        CommandType type = stringToCommandType(command);
+        m_metrics.recordRequest(type);
+        std::shared_ptr<Session> session = findSession(hdl);
+
+        // 客户端等待超时后重发的请求：返回已有的最终响应，仍在处理时返回pending，
+        // 原请求的最终响应发出时客户端会收到，不重复执行
+        std::string cached;
+        ResponseCache::Lookup lookup = ResponseCache::Lookup::Miss;
+        if (session && isReplayable(type)) {
+            lookup = session->responses.begin(requestId, command, cached);
+        }
+        if (lookup != ResponseCache::Lookup::Miss) {
+            json replay = lookup == ResponseCache::Lookup::Done
+                              ? json::parse(cached)
+                              : json{{"command", command},
+                                     {"requestId", requestId},
+                                     {"status", "pending"}};
+            replay["replayed"] = true;
+            std::string replayPayload = replay.dump();
+            if (session->sender->send(
+                    SendPriority::Control, replayPayload, websocketpp::frame::opcode::text)) {
+                m_metrics.addBytesOut(replayPayload.size());
+                session->messagesSent.fetch_add(1, std::memory_order_relaxed);
+                session->bytesSent.fetch_add(replayPayload.size(), std::memory_order_relaxed);
+            }
+            m_metrics.recordRequestReplayed();
+            if (lookup == ResponseCache::Lookup::Done) {
+                tracer.finish(requestId, "replayed");  // 仍在处理时由原请求的最终响应结束
+            }
+            std::cout << "重发的请求: [" << command << "], ID: " << requestId
+                      << (lookup == ResponseCache::Lookup::Done ? "，返回缓存的响应" : "，仍在处理")
+                      << std::endl;
+            return;
+        }
+        if (session) {
+            std::lock_guard<std::mutex> lock(session->inflightMutex);
+            session->inflight[requestId] = {type, received};
+        }
+
+        // 路由到设备：信封中的deviceId优先，其次是连接路径绑定的设备，否则为默认设备
+        Device* target = session ? session->device : m_devices.front().get();
+        if (message.contains("deviceId")) {
+            const json& value = message["deviceId"];
+            std::string deviceId = value.is_string() ? value.get<std::string>() : value.dump();
+            auto it = value.is_string() ? m_device_index.find(deviceId) : m_device_index.end();
+            if (it == m_device_index.end()) {
+                json response = {{"command", command},
+                                 {"requestId", requestId},
+                                 {"status", "error"},
+                                 {"errorMessage", "Unknown deviceId: " + deviceId}};
+
+                sendJson(hdl, response);
+                return;
+            }
+            target = it->second;
+        }
+        Device& device = *target;
+
+        tracer.mark(requestId, "dispatched");
+
         // 根据命令类型分发处理
         if (command == "setAlignViewMode") {
             json params = message.value("params", json());
-            handleSetStreamMode(hdl, requestId, params);
+            handleSetStreamMode(device, hdl, requestId, params);
         } else if (command == "getAlignViewMode") {
-            handleGetStreamMode(hdl, requestId);
+            handleGetStreamMode(device, hdl, requestId);
         } else if (command == "startStream") {
             json params = message.value("params", json());
-            handleStartStream(hdl, requestId, params);
+            handleStartStream(device, hdl, requestId, params);
         } else if (command == "stopStream") {
-            handleStopStream(hdl, requestId);
+            handleStopStream(device, hdl, requestId);
         } else if (command == "executeMeasure") {
             json params = message.value("params", json());
-            handleMeasureRequest(hdl, requestId, params);
+            handleMeasureRequest(device, hdl, requestId, params);
         } else if (command == "stopMeasure") {
-            handleStopMeasure(hdl, requestId);
+            handleStopMeasure(device, hdl, requestId);
         } else if (command == "getMeasureStatus") {
-            handleMeasureStatus(hdl, requestId);
-        } else if (command == "getSufaceData") {
-            // 处理获取设备状态请求
-            handleMeasureStatus(hdl, requestId);
+            json params = message.value("params", json());
+            handleMeasureStatus(device, hdl, requestId, params);
+        } else if (command == "getSurfaceData") {
+            json params = message.value("params", json());
+            handleGetSurfaceData(device, hdl, requestId, params);
+        } else if (command == "getServerMetrics") {
+            handleServerMetrics(device, hdl, requestId);
+        } else if (command == "requestKeyframe") {
+            handleRequestKeyframe(device, hdl, requestId);
+        } else if (command == "getSnapshot") {
+            json params = message.value("params", json());
+            handleGetSnapshot(device, hdl, requestId, params);
+        } else if (command == "getSurfaceSummary") {
+            json params = message.value("params", json());
+            handleGetSurfaceSummary(device, hdl, requestId, params);
+        } else if (command == "subscribe") {
+            json params = message.value("params", json());
+            handleSubscribe(device, hdl, requestId, params);
+        } else if (command == "unsubscribe") {
+            json params = message.value("params", json());
+            handleUnsubscribe(device, hdl, requestId, params);
         } else {
             // 未知命令类型
             json response = {{"command", command},
@@ -102,7 +628,7 @@ void DeviceServer::onMessage(connection_hdl hdl, message_ptr msg) {
                              {"status", "error"},
                              {"errorMessage", "Unknown command: " + command}};
 
-            m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+            sendJson(hdl, response);
         }
     } catch (json::parse_error& e) {
         std::cerr << "JSON parse error: " << e.what() << std::endl;
@@ -112,23 +638,39 @@ void DeviceServer::onMessage(connection_hdl hdl, message_ptr msg) {
 }
 
 // 处理测量请求
-void DeviceServer::handleMeasureRequest(connection_hdl hdl,
-                                        const std::string& requestId,
-                                        const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleMeasureRequest(Device& device,
+                                                     connection_hdl hdl,
+                                                     const std::string& requestId,
+                                                     const json& params) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理测量请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
+    SurfaceParams surface;
+    std::string error;
+    if (!parseSurfaceParams(params, surface, error)) {
+        json response = {{"command", "executeMeasure"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", error}};
+
+        sendJson(hdl, response);
+        return;
+    }
+
     // 立即回复"正在测量"状态
     sendMeasuringStatus(hdl, requestId);
 
     // 启动模拟测量任务
-    startMeasurement(hdl, requestId, params);
+    startMeasurement(device, hdl, requestId, surface);
 }
 
 // 处理设置取流模式请求
-void DeviceServer::handleSetStreamMode(connection_hdl hdl,
-                                       const std::string& requestId,
-                                       const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleSetStreamMode(Device& device,
+                                                    connection_hdl hdl,
+                                                    const std::string& requestId,
+                                                    const json& params) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理设置观察模式请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
@@ -139,7 +681,7 @@ void DeviceServer::handleSetStreamMode(connection_hdl hdl,
                          {"status", "error"},
                          {"errorMessage", "Missing alignViewMode parameter"}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         return;
     }
 
@@ -154,7 +696,13 @@ void DeviceServer::handleSetStreamMode(connection_hdl hdl,
 
     if (valid_mode) {
         // 设置新的观察模式
-        m_current_stream_mode = mode;
+        {
+            std::lock_guard<std::mutex> lock(device.streamMutex);
+            device.currentStreamMode = mode;
+        }
+        // 离开trigger/snapshot模式时生产线程可能正在等待，唤醒它恢复连续取流
+        device.streamCv.notify_all();
+        publishStatus(device);
 
         // 发送成功响应
         json response = {{"command", "setAlignViewMode"},
@@ -162,7 +710,7 @@ void DeviceServer::handleSetStreamMode(connection_hdl hdl,
                          {"status", "success"},
                          {"data", {{"currentMode", mode}}}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         std::cout << "观察模式已设置为: " << mode << std::endl;
     } else {
         // 发送错误响应
@@ -173,12 +721,15 @@ void DeviceServer::handleSetStreamMode(connection_hdl hdl,
             {"errorMessage", "Invalid mode: " + mode +
                                  ". Valid modes are: align, view, continuous, trigger, snapshot"}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
     }
 }
 
 // 处理获取观察模式请求
-void DeviceServer::handleGetStreamMode(connection_hdl hdl, const std::string& requestId) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleGetStreamMode(Device& device,
+                                                    connection_hdl hdl,
+                                                    const std::string& requestId) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理获取观察模式请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
@@ -186,40 +737,55 @@ void DeviceServer::handleGetStreamMode(connection_hdl hdl, const std::string& re
     json response = {{"command", "getAlignViewMode"},
                      {"requestId", requestId},
                      {"status", "success"},
-                     {"data", {{"mode", m_current_stream_mode}}}};
+                     {"data", {{"mode", deviceState(device)->alignViewMode}}}};
 
-    m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+    sendJson(hdl, response);
 }
 
 // 处理获取设备状态请求
-void DeviceServer::handleMeasureStatus(connection_hdl hdl, const std::string& requestId) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleMeasureStatus(Device& device,
+                                                    connection_hdl hdl,
+                                                    const std::string& requestId,
+                                                    const json& params) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理获取设备状态请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
-    // 模拟设备状态信息
-    json deviceStatus = {{"deviceId", "DEV12345"},
-                         {"firmwareVersion", "2.5.1"},
-                         {"temperature", 36.7},
-                         {"uptime", 12345},
-                         {"alignViewMode", m_current_stream_mode},
-                         {"isCalibrated", static_cast<bool>(m_is_calibrated)},
-                         {"isStreaming", static_cast<bool>(m_is_streaming)},
-                         {"isMeasuring", static_cast<bool>(m_is_measuring)},
-                         {"battery", 85}};
+    bool conditional = params.is_object() && params.contains("ifVersionNewerThan");
+    if (conditional && !params["ifVersionNewerThan"].is_number_unsigned()) {
+        json response = {{"command", "getMeasureStatus"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", "Invalid ifVersionNewerThan"}};
 
-    // 发送设备状态响应
-    json response = {{"command", "getMeasureStatus"},
-                     {"requestId", requestId},
-                     {"status", "success"},
-                     {"data", {{"deviceStatus", deviceStatus}}}};
+        sendJson(hdl, response);
+        return;
+    }
+
+    // 快照内的状态彼此一致，读取无需加锁
+    std::shared_ptr<const DeviceState> state = deviceState(device);
+    std::string version = std::to_string(state->version);
+    std::string data;
+    if (conditional && state->version <= params["ifVersionNewerThan"].get<uint64_t>()) {
+        // 客户端已有该版本，不重复发送状态内容
+        data = "{\"unchanged\":true,\"version\":" + version + "}";
+    } else {
+        // deviceStatus在发布快照时已序列化，这里只做字符串拼接
+        data = "{\"deviceStatus\":" + state->deviceStatusText + ",\"version\":" + version + "}";
+    }
+    std::string payload = "{\"command\":\"getMeasureStatus\",\"data\":" + data +
+                          ",\"requestId\":" + json(requestId).dump() +
+                          ",\"status\":\"success\"}";
 
-    m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+    sendPayload(hdl, "getMeasureStatus", requestId, "success", payload);
 }
 
 // 处理校准请求 (这里我们将其作为一种特殊的测量请求处理)
-void DeviceServer::handleCalibrate(connection_hdl hdl,
-                                   const std::string& requestId,
-                                   const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleCalibrate(Device& device,
+                                                connection_hdl hdl,
+                                                const std::string& requestId,
+                                                const json& params) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理校准请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
@@ -229,15 +795,16 @@ void DeviceServer::handleCalibrate(connection_hdl hdl,
                            {"status", "pending"},
                            {"data", {{"progress", 0}, {"calibration", true}}}};
 
-    m_server.send(hdl, start_response.dump(), websocketpp::frame::opcode::text);
+    sendJson(hdl, start_response);
 
-    // 启动校准任务
-    std::thread([this, hdl, requestId, params]() {
+    // 校准任务放入设备任务队列，与测量按顺序执行
+    postJob(device, sessionKey(hdl), [this, &device, hdl, requestId, params]() {
         // 模拟校准过程
         std::string calibrationType = params.value("type", "standard");
         int steps = (calibrationType == "full") ? 5 : 3;
 
-        m_is_calibrated = false;
+        device.isCalibrated = false;
+        publishStatus(device);
 
         for (int i = 1; i <= steps; i++) {
             // 每步暂停一段时间
@@ -245,16 +812,23 @@ void DeviceServer::handleCalibrate(connection_hdl hdl,
 
             // 发送进度更新
             int progress = (i * 100) / steps;
+            publishEvent(device, "progress",
+                         {{"requestId", requestId},
+                          {"kind", "calibrate"},
+                          {"progress", progress},
+                          {"completed", i},
+                          {"total", steps}});
             json progress_response = {{"command", "executeMeasure"},
                                       {"requestId", requestId},
                                       {"status", "pending"},
                                       {"data", {{"progress", progress}, {"calibration", true}}}};
 
-            m_server.send(hdl, progress_response.dump(), websocketpp::frame::opcode::text);
+            sendJson(hdl, progress_response);
         }
 
         // 校准完成
-        m_is_calibrated = true;
+        device.isCalibrated = true;
+        publishStatus(device);
 
         json result = {{"calibrationType", calibrationType},
                        {"timestamp", std::chrono::system_clock::now().time_since_epoch().count()},
@@ -266,110 +840,453 @@ void DeviceServer::handleCalibrate(connection_hdl hdl,
                                   {"status", "success"},
                                   {"data", result}};
 
-        m_server.send(hdl, complete_response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, complete_response);
         std::cout << "校准完成: " << requestId << std::endl;
-    }).detach();
+    });
 }
 
 // 处理开始取流请求
-void DeviceServer::handleStartStream(connection_hdl hdl,
-                                     const std::string& requestId,
-                                     const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleStartStream(Device& device,
+                                                  connection_hdl hdl,
+                                                  const std::string& requestId,
+                                                  const json& params) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理开始取流请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
-    if (m_is_streaming) {
-        // 如果已经在取流中，返回错误
+    // 构建取流格式、ROI、抽样倍率与最大帧率
+    bool hasParams = params.is_object();
+    std::string format = hasParams ? params.value("format", "raw") : "raw";
+    StreamView view;
+    std::string error;
+    double maxFps = kStreamFps;
+    std::string encoding = hasParams ? params.value("encoding", "none") : "none";
+    if (parseStreamView(params, view, error) && hasParams && params.contains("maxFps")) {
+        const json& value = params["maxFps"];
+        if (!value.is_number() || value.get<double>() <= 0) {
+            error = "Invalid maxFps";
+        } else {
+            maxFps = std::min<double>(value.get<double>(), kStreamFps);
+        }
+    }
+    if (error.empty() && encoding != "none" && encoding != "delta") {
+        error = "Unsupported encoding: " + encoding;
+    }
+    // 共享内存传输：帧不经过套接字，差分编码没有意义
+    std::string transport = hasParams ? params.value("transport", "websocket") : "websocket";
+    if (error.empty() && transport != "websocket" && transport != "shm") {
+        error = "Unsupported transport: " + transport;
+    } else if (error.empty() && transport == "shm" && encoding != "none") {
+        error = "shm transport does not support encoding: " + encoding;
+    } else if (error.empty() && transport == "shm" && !isLocalConnection(hdl)) {
+        error = "shm transport requires a local connection";
+    }
+    if (!error.empty()) {
+        json response = {{"command", "startStream"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", error}};
+
+        sendJson(hdl, response);
+        return;
+    }
+
+    std::shared_ptr<Session> session = findSession(hdl);
+    if (!session) {
+        return;
+    }
+    uint32_t streamId = kStreamIdPrefix | m_next_stream_id++;
+    char streamIdText[16];
+    std::snprintf(streamIdText, sizeof(streamIdText), "0x%08X", streamId);
+
+    // 槽位按两种分辨率下该视图的最大帧分配，取流期间切换观察模式无需重建
+    std::shared_ptr<FrameRing> ring;
+    if (transport == "shm") {
+        size_t slotSize = 0;
+        for (bool alignMode : {true, false}) {
+            unsigned width, height;
+            view.outputSize(alignMode ? kAlignWidth : kViewWidth,
+                            alignMode ? kAlignHeight : kViewHeight,
+                            width,
+                            height);
+            BinaryFormat source = alignMode ? BinaryFormat::Rgb24 : BinaryFormat::Gray8;
+            unsigned bits = view.pixelFormat ? view.pixelFormat : static_cast<unsigned>(source);
+            slotSize = std::max<size_t>(
+                slotSize, BinaryHeader::kEncodedSize + size_t(width) * height * (bits / 8));
+        }
+#ifndef _WIN32
+        std::string name = "/device_stream_" + std::to_string(getpid()) + "_" + streamIdText;
+#else
+        std::string name;
+#endif
+        ring = FrameRing::create(name, FrameRing::kDefaultSlotCount, slotSize);
+        if (!ring) {
+            json response = {{"command", "startStream"},
+                             {"requestId", requestId},
+                             {"status", "error"},
+                             {"errorMessage", "Failed to create shared memory"}};
+
+            sendJson(hdl, response);
+            return;
+        }
+    }
+
+    std::string mode;
+    bool alreadyStreaming = false;
+    {
+        std::lock_guard<std::mutex> lock(device.streamMutex);
+        if (device.streamSubscribers.contains(sessionKey(hdl))) {
+            alreadyStreaming = true;
+        } else {
+            auto subscription = std::make_shared<StreamSubscription>();
+            subscription->session = session;
+            subscription->stream = {streamId, view, maxFps, encoding == "delta", 0, ring};
+            device.streamSubscribers.insert(sessionKey(hdl), std::move(subscription));
+            device.isStreaming = true;
+        }
+        mode = device.currentStreamMode;
+    }
+
+    if (alreadyStreaming) {
+        // 如果该连接已经在取流中，返回错误
         json response = {{"command", "startStream"},
                          {"requestId", requestId},
                          {"status", "error"},
                          {"errorMessage", "Stream already running"}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         return;
     }
 
-    // 设置取流状态
-    m_is_streaming = true;
+    bool align = mode == "align";
 
-    // 构建取流格式
-    std::string format = params.value("format", "raw");
+    // 返回实际发送的图像尺寸（ROI裁剪与抽样之后）
+    unsigned sourceWidth = align ? kAlignWidth : kViewWidth;
+    unsigned sourceHeight = align ? kAlignHeight : kViewHeight;
+    unsigned roiX, roiY, roiWidth, roiHeight, decimation, width, height;
+    view.resolve(sourceWidth, sourceHeight, roiX, roiY, roiWidth, roiHeight, decimation);
+    view.outputSize(sourceWidth, sourceHeight, width, height);
 
     // 返回成功响应
     json response = {{"command", "startStream"},
                      {"requestId", requestId},
                      {"status", "success"},
                      {"data",
-                      {{"streamId", generateTimestampId()},
+                      {{"streamId", streamIdText},
                        {"format", format},
-                       {"mode", m_current_stream_mode}}}};
+                       {"mode", mode},
+                       {"roi",
+                        {{"x", roiX}, {"y", roiY}, {"width", roiWidth}, {"height", roiHeight}}},
+                       {"decimation", decimation},
+                       {"encoding", encoding},
+                       {"width", width},
+                       {"height", height},
+                       {"fps", maxFps},
+                       {"transport", transport}}}};
+    if (ring) {
+        response["data"]["shm"] = {{"name", ring->name()},
+                                   {"slotCount", ring->slotCount()},
+                                   {"slotSize", ring->slotSize()}};
+    }
+
+    sendJson(hdl, response);
 
-    m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+    // 唤醒视频流生产线程
+    device.streamCv.notify_all();
+    publishStatus(device);
+    std::cout << "开始取流，格式: " << format << ", 模式: " << mode << std::endl;
+}
 
-    // 在真实实现中，这里会开启一个线程持续发送数据流
-    // 为了演示，我们不实际发送数据
-    std::cout << "开始取流，格式: " << format << ", 模式: " << m_current_stream_mode << std::endl;
+template <typename Config>
+bool BasicDeviceServer<Config>::isLocalConnection(connection_hdl hdl) {
+    if constexpr (uses_asio_transport<Config>::value) {
+        websocketpp::lib::error_code ec;
+        typename server_type::connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+        if (ec) {
+            return false;
+        }
+        websocketpp::lib::asio::error_code socketError;
+        auto address = con->get_raw_socket().remote_endpoint(socketError).address();
+        if (socketError) {
+            return false;
+        }
+        // 双栈监听时IPv4客户端的地址为::ffff:127.0.0.1
+        if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+            return websocketpp::lib::asio::ip::make_address_v4(
+                       websocketpp::lib::asio::ip::v4_mapped, address.to_v6())
+                .is_loopback();
+        }
+        return address.is_loopback();
+    } else {
+        // 进程内传输总在同一进程中
+        (void)hdl;
+        return true;
+    }
 }
 
 // 处理停止取流请求
-void DeviceServer::handleStopStream(connection_hdl hdl, const std::string& requestId) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleStopStream(Device& device,
+                                                 connection_hdl hdl,
+                                                 const std::string& requestId) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理停止取流请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
-    if (!m_is_streaming) {
+    bool subscribed = false;
+    {
+        std::lock_guard<std::mutex> lock(device.streamMutex);
+        subscribed = device.streamSubscribers.erase(sessionKey(hdl)) != nullptr;
+        device.isStreaming = !device.streamSubscribers.empty();
+    }
+
+    if (!subscribed) {
         // 如果没有在取流，返回错误
         json response = {{"command", "stopStream"},
                          {"requestId", requestId},
                          {"status", "error"},
                          {"errorMessage", "No active stream"}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         return;
     }
 
-    // 停止取流
-    m_is_streaming = false;
-
     // 返回成功响应
     json response = {{"command", "stopStream"}, {"requestId", requestId}, {"status", "success"}};
 
-    m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+    sendJson(hdl, response);
+    publishStatus(device);
     std::cout << "取流已停止" << std::endl;
 }
 
 // 处理停止测量请求
-void DeviceServer::handleStopMeasure(connection_hdl hdl, const std::string& requestId) {
+template <typename Config>
+void BasicDeviceServer<Config>::handleStopMeasure(Device& device,
+                                                  connection_hdl hdl,
+                                                  const std::string& requestId) {
     std::string readableTime = parseTimestampId(requestId);
     std::cout << "处理停止测量请求: " << requestId << " (" << readableTime << ")" << std::endl;
 
-    if (!m_is_measuring) {
+    if (!device.isMeasuring) {
         // 如果没有在测量，返回错误
         json response = {{"command", "stopMeasure"},
                          {"requestId", requestId},
                          {"status", "error"},
                          {"errorMessage", "No active measurement"}};
 
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         return;
     }
 
     // 停止测量
-    m_is_measuring = false;
+    device.isMeasuring = false;
+    publishStatus(device);
 
     // 返回成功响应
     json response = {{"command", "stopMeasure"}, {"requestId", requestId}, {"status", "success"}};
 
-    m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+    sendJson(hdl, response);
     std::cout << "测量已停止" << std::endl;
 }
 
-void DeviceServer::sendMeasuringStatus(connection_hdl hdl, const std::string& requestId) {
+// 处理请求关键帧请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleRequestKeyframe(Device& device,
+                                                      connection_hdl hdl,
+                                                      const std::string& requestId) {
+    bool subscribed = false;
+    {
+        std::lock_guard<std::mutex> lock(device.streamMutex);
+        if (StreamSubscription* subscription = device.streamSubscribers.find(sessionKey(hdl))) {
+            subscription->stream.keyframeRequests++;
+            subscribed = true;
+        }
+    }
+
+    if (!subscribed) {
+        json response = {{"command", "requestKeyframe"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", "No active stream"}};
+
+        sendJson(hdl, response);
+        return;
+    }
+
+    json response = {
+        {"command", "requestKeyframe"}, {"requestId", requestId}, {"status", "success"}};
+
+    sendJson(hdl, response);
+}
+
+// 处理获取单帧快照请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleGetSnapshot(Device& device,
+                                                  connection_hdl hdl,
+                                                  const std::string& requestId,
+                                                  const json& params) {
+    SnapshotRequest request;
+    std::string error;
+    if (!parseStreamView(params, request.view, error) ||
+        !parseChunkSize(params, request.chunkSize, error)) {
+        json response = {{"command", "getSnapshot"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", error}};
+
+        sendJson(hdl, response);
+        return;
+    }
+    request.hdl = hdl;
+    request.requestId = requestId;
+
+    {
+        std::lock_guard<std::mutex> lock(device.streamMutex);
+        request.mode = device.currentStreamMode;
+        // 快照请求后一段时间内保持采集，连续取单帧时最新帧总是现成的
+        device.snapshotDeadline = std::chrono::steady_clock::now() + kSnapshotKeepAlive;
+        if (request.mode == "trigger") {
+            // trigger模式每次快照触发采集新的一帧
+            device.triggerPending++;
+            request.target = device.publishedSequence.load() + 1;
+        }
+        device.streamCv.notify_all();
+
+        // 先登记再检查发布序号，与生产线程先发布再检查登记数相对，两者至少有一方看到对方
+        device.snapshotRequests.push_back(request);
+        device.snapshotWaiters.store(device.snapshotRequests.size());
+        if (device.publishedSequence.load() < request.target) {
+            // 网络线程不等待，生产线程发布新帧后回复
+            return;
+        }
+        device.snapshotRequests.pop_back();
+        device.snapshotWaiters.store(device.snapshotRequests.size());
+    }
+
+    sendSnapshot(device, request);
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sendSnapshot(Device& device, const SnapshotRequest& request) {
+    std::shared_ptr<Session> session = findSession(request.hdl);
+    if (!session) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(device.snapshotMutex);
+    // 读取端持有的缓冲不会被生产线程覆盖，直接从中发送
+    LatestFrame& latest = device.latestFrame.acquire();
+    device.snapshotViews.reset(&latest.frame);
+    std::string& output = device.snapshotViews.get(request.view);
+    BinaryHeader header;
+    decodeBinaryHeader(reinterpret_cast<const uint8_t*>(output.data()), output.size(), header);
+    header.contexId = kSnapshotContexId;
+    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&output[0]));
+
+    char contexIdText[16];
+    std::snprintf(contexIdText, sizeof(contexIdText), "0x%08X", kSnapshotContexId);
+    auto ageUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - latest.captured)
+                     .count();
+
+    // 与getSurfaceData相同，响应先于二进制数据到达，客户端按contexId等待图像
+    json response = {{"command", "getSnapshot"},
+                     {"requestId", request.requestId},
+                     {"status", "success"},
+                     {"data",
+                      {{"contexId", contexIdText},
+                       {"sequence", latest.sequence},
+                       {"mode", request.mode},
+                       {"format", pixelFormatName(header.format)},
+                       {"width", header.width},
+                       {"height", header.height},
+                       {"ageUs", ageUs}}}};
+
+    sendJson(request.hdl, response);
+
+    // 图像按视频流优先级受发送窗口限制，由调度器预先组帧；分段时命令响应可以插在段与段之间
+    // 三缓冲的读缓冲之后还会被覆盖，整帧只在切段（或不分段时放入消息）时拷贝一次
+    if (session->sender->send(SendPriority::Stream,
+                              splitIntoChunks(output, request.chunkSize),
+                              websocketpp::frame::opcode::binary)) {
+        m_metrics.addBytesOut(output.size());
+    }
+}
+
+// 处理获取服务器指标请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleServerMetrics(Device& device,
+                                                    connection_hdl hdl,
+                                                    const std::string& requestId) {
+    json data = m_metrics.toJson();
+    {
+        std::shared_lock<std::shared_mutex> lock(m_session_mutex);
+        data["sessions"] = m_sessions.size();
+    }
+    json devices = json::array();
+    for (const std::unique_ptr<Device>& entry : m_devices) {
+        devices.push_back(entry->deviceId);
+    }
+    data["devices"] = devices;
+    if (m_shared_state) {
+        data["workerIndex"] = m_worker_index;
+    }
+
+    // 请求方所在会话的发送统计与订阅情况
+    if (std::shared_ptr<Session> session = findSession(hdl)) {
+        const void* key = sessionKey(hdl);
+        size_t inflight = 0;
+        {
+            std::lock_guard<std::mutex> lock(session->inflightMutex);
+            inflight = session->inflight.size();
+        }
+        bool streaming = false;
+        {
+            std::lock_guard<std::mutex> lock(device.streamMutex);
+            streaming = device.streamSubscribers.contains(key);
+        }
+        json topics = json::array();
+        {
+            std::lock_guard<std::mutex> lock(device.eventMutex);
+            if (EventSubscription* subscription = device.eventSubscribers.find(key)) {
+                for (const std::string& topic : subscription->events.topics) {
+                    topics.push_back(topic);
+                }
+            }
+        }
+        auto age = std::chrono::steady_clock::now() - session->opened;
+        data["session"] = {
+            {"sessionId", session->sessionId},
+            {"deviceId", device.deviceId},
+            {"connectedMs",
+             std::chrono::duration_cast<std::chrono::milliseconds>(age).count()},
+            {"messagesSent", session->messagesSent.load(std::memory_order_relaxed)},
+            {"bytesSent", session->bytesSent.load(std::memory_order_relaxed)},
+            {"framesSent", session->framesSent.load(std::memory_order_relaxed)},
+            {"framesDropped", session->framesDropped.load(std::memory_order_relaxed)},
+            {"sendQueueBytes", session->sender->queuedBytes()},
+            {"inflightRequests", inflight},
+            {"cachedResponses", session->responses.size()},
+            {"streaming", streaming},
+            {"topics", topics}};
+    }
+
+    json response = {{"command", "getServerMetrics"},
+                     {"requestId", requestId},
+                     {"status", "success"},
+                     {"data", data}};
+
+    sendJson(hdl, response);
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sendMeasuringStatus(connection_hdl hdl,
+                                                    const std::string& requestId) {
     std::string readableTime = parseTimestampId(requestId);
     json response = {
         {"command", "executeMeasure"}, {"requestId", requestId}, {"status", "pending"}};
 
     try {
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         std::cout << "发送'正在测量'状态: " << requestId << " (" << readableTime << ")"
                   << std::endl;
     } catch (std::exception& e) {
@@ -377,68 +1294,1182 @@ void DeviceServer::sendMeasuringStatus(connection_hdl hdl, const std::string& re
     }
 }
 
-void DeviceServer::sendMeasurementComplete(connection_hdl hdl,
-                                           const std::string& requestId,
-                                           const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::sendMeasurementComplete(Device& device,
+                                                        connection_hdl hdl,
+                                                        const std::string& requestId,
+                                                        const json& data) {
     std::string readableTime = parseTimestampId(requestId);
 
     json response = {{"command", "executeMeasure"},
                      {"requestId", requestId},
                      {"status", "success"},
-                     };
+                     {"data", data}};
 
     try {
-        m_server.send(hdl, response.dump(), websocketpp::frame::opcode::text);
+        sendJson(hdl, response);
         std::cout << "发送'测量完成'状态: " << requestId << " (" << readableTime << ")"
                   << std::endl;
 
         // 重置测量状态
-        m_is_measuring = false;
+        device.isMeasuring = false;
     } catch (std::exception& e) {
         std::cerr << "Error sending measurement complete: " << e.what() << std::endl;
     }
+    publishStatus(device);
 }
 
-void DeviceServer::startMeasurement(connection_hdl hdl,
-                                    const std::string& requestId,
-                                    const json& params) {
+template <typename Config>
+void BasicDeviceServer<Config>::startMeasurement(Device& device,
+                                                 connection_hdl hdl,
+                                                 const std::string& requestId,
+                                                 const SurfaceParams& surface) {
     std::string readableTime = parseTimestampId(requestId);
-    // 启动一个新线程来模拟测量过程
-    std::thread([this, hdl, requestId, params, readableTime]() {
-        // 设置测量状态
-        m_is_measuring = true;
+    TraceRecorder& tracer = TraceRecorder::instance();
+    auto measurement = std::make_shared<Measurement>();
+    {
+        // 参数相同、尚未开始或刚开始的测量直接加入等待，不单独采集
+        std::lock_guard<std::mutex> lock(device.jobMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (const std::shared_ptr<Measurement>& pending : device.measurements) {
+            if (pending->finished || !sameSurfaceParams(pending->surface, surface) ||
+                (pending->started && now - pending->startedAt > kMeasureCoalesceWindow)) {
+                continue;
+            }
+            pending->waiters.push_back({hdl, requestId});
+            if (pending->started) {
+                tracer.mark(requestId, "workerStarted");
+            }
+            m_metrics.recordMeasurementCoalesced();
+            std::cout << "测量请求并入: " << requestId << " (" << readableTime << ") -> "
+                      << pending->waiters.front().requestId << std::endl;
+            return;
+        }
+        measurement->surface = surface;
+        measurement->waiters.push_back({hdl, requestId});
+        device.measurements.push_back(measurement);
+    }
 
-        int delay_seconds = 2;  // 默认延迟
+    // 测量任务放入设备任务队列，同一设备的测量依次进行
+    postJob(device, sessionKey(hdl), [this, &device, measurement, requestId, readableTime]() {
+        TraceRecorder& tracer = TraceRecorder::instance();
+        const SurfaceParams& surface = measurement->surface;
+        {
+            std::lock_guard<std::mutex> lock(device.jobMutex);
+            measurement->started = true;
+            measurement->startedAt = std::chrono::steady_clock::now();
+            for (const auto& waiter : measurement->waiters) {
+                tracer.mark(waiter.requestId, "workerStarted");
+            }
+        }
+        // 结束测量并取走等待的请求，之后到达的相同请求重新排队测量
+        auto finish = [&device, &measurement, &tracer]() {
+            std::lock_guard<std::mutex> lock(device.jobMutex);
+            measurement->finished = true;
+            auto& pending = device.measurements;
+            pending.erase(std::remove(pending.begin(), pending.end(), measurement),
+                          pending.end());
+            for (const auto& waiter : measurement->waiters) {
+                tracer.mark(waiter.requestId, "workerFinished");
+            }
+            return std::move(measurement->waiters);
+        };
+        auto jobStart = std::chrono::steady_clock::now();
+
+        // 设置测量状态
+        device.isMeasuring = true;
+        publishStatus(device);
+        // 合并的请求都在等待这次测量，事件列出全部requestId；测量开始后仍可能有请求并入
+        auto waiterIds = [&device, &measurement]() {
+            std::lock_guard<std::mutex> lock(device.jobMutex);
+            json ids = json::array();
+            for (const auto& waiter : measurement->waiters) {
+                ids.push_back(waiter.requestId);
+            }
+            return ids;
+        };
+        auto publishProgress = [this, &device, &requestId, &surface, &waiterIds](
+                                   unsigned completed) {
+            publishEvent(device, "progress",
+                         {{"requestId", requestId},
+                          {"requestIds", waiterIds()},
+                          {"kind", "measure"},
+                          {"progress", completed * 100 / surface.averageCount},
+                          {"completed", completed},
+                          {"total", surface.averageCount}});
+        };
+        publishProgress(0);
 
         std::cout << "处理测量请求: " << requestId << " (" << readableTime << "), "
-                  << "延迟: " << delay_seconds << "秒" << std::endl;
+                  << "面形: " << surface.width << "x" << surface.height << ", "
+                  << static_cast<int>(surface.steps) << "步相移, "
+                  << static_cast<int>(surface.averageCount) << "次平均" << std::endl;
+
+        // 回放模式按录制顺序循环使用该设备的数据集，不模拟超时，结果可以重现
+        const std::vector<CaptureRecord>* replayDatasets =
+            m_replay && !m_replay->datasets(device.shard).empty()
+                ? &m_replay->datasets(device.shard)
+                : nullptr;
 
         // 模拟一个随机概率的超时情况（用于测试）
-        bool simulate_timeout = (rand() % 100) < 5;  // 5%的概率模拟超时
+        bool simulate_timeout = !replayDatasets && (rand() % 100) < 5;  // 5%的概率模拟超时
 
         if (simulate_timeout) {
             // 模拟超时
             std::this_thread::sleep_for(std::chrono::seconds(2));  // 短暂延迟
 
             // 发送超时状态
-            json timeout_response = {{"command", "executeMeasure"},
-                                     {"requestId", requestId},
-                                     {"status", "timeout"},
-                                     {"errorMessage", "Measurement operation timed out"}};
+            for (const auto& waiter : finish()) {
+                json timeout_response = {{"command", "executeMeasure"},
+                                         {"requestId", waiter.requestId},
+                                         {"status", "timeout"},
+                                         {"errorMessage", "Measurement operation timed out"}};
 
-            m_server.send(hdl, timeout_response.dump(), websocketpp::frame::opcode::text);
-            std::cout << "发送'测量超时'状态: " << requestId << " (" << readableTime << ")"
-                      << std::endl;
+                sendJson(waiter.hdl, timeout_response);
+                std::cout << "发送'测量超时'状态: " << waiter.requestId << std::endl;
+            }
 
             // 重置测量状态
-            m_is_measuring = false;
+            device.isMeasuring = false;
+            publishStatus(device);
+            return;
+        }
+
+        // 生成相移干涉图并重建面形
+        auto dataset = std::make_shared<SurfaceDataset>();
+        uint32_t sequence = m_next_dataset_id++;
+        dataset->datasetId = kDatasetIdPrefix | sequence;
+        SurfaceTimings timings;
+        unsigned averaged = 1;
+        double averageMs = 0;
+        if (replayDatasets) {
+            // 忽略请求的尺寸与平均次数，按录制时的测量耗时除以回放速度等待
+            const CaptureRecord& record =
+                (*replayDatasets)[device.replayDataset++ % replayDatasets->size()];
+            CaptureReader::decodeDataset(record, dataset->map, dataset->variance);
+            if (m_replay_speed > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(
+                    static_cast<int64_t>(record.durationUs / m_replay_speed)));
+            }
+            publishProgress(surface.averageCount);
+        } else if (surface.averageCount == 1) {
+            device.engine.measure(surface, sequence, dataset->map, &timings);
+            publishProgress(1);
+        } else {
+            // 每次测量的结果直接累加进均值/方差缓冲，不保存N幅面形
+            device.accumulator.reset(surface.width, surface.height);
+            for (unsigned i = 0; i < surface.averageCount; i++) {
+                // 收到stopMeasure时用已完成的测量计算平均
+                if (i > 0 && !device.isMeasuring) {
+                    break;
+                }
+                SurfaceTimings single;
+                uint32_t seed = sequence * SurfaceParams::kMaxAverageCount + i;
+                device.engine.measure(surface, seed, device.singleMap, &single);
+                timings.synthesizeMs += single.synthesizeMs;
+                timings.phaseMs += single.phaseMs;
+                timings.unwrapMs += single.unwrapMs;
+
+                auto averageStart = std::chrono::steady_clock::now();
+                device.accumulator.add(device.singleMap);
+                averageMs += std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - averageStart)
+                                 .count();
+                publishProgress(i + 1);
+            }
+            averaged = device.accumulator.samples();
+            device.accumulator.mean(dataset->map);
+            if (surface.variance) {
+                device.accumulator.variance(dataset->variance);
+            }
+        }
+        auto pyramidStart = std::chrono::steady_clock::now();
+        buildSurfacePyramid(dataset->map, dataset->pyramid);
+        double pyramidMs = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - pyramidStart)
+                               .count();
+        std::vector<typename Measurement::Waiter> waiters = finish();
+        if (m_recorder) {
+            auto durationUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - jobStart);
+            m_recorder->writeDataset(device.shard,
+                                     static_cast<uint32_t>(durationUs.count()),
+                                     dataset->map,
+                                     dataset->variance.heights.empty() ? nullptr
+                                                                       : &dataset->variance);
+        }
+
+        json data = {{"datasetId", datasetIdText(dataset->datasetId)},
+                     {"width", dataset->map.width},
+                     {"height", dataset->map.height},
+                     {"steps", surface.steps},
+                     {"averageCount", averaged},
+                     {"validPixels", dataset->map.validPixels},
+                     {"timings",
+                      {{"synthesizeMs", timings.synthesizeMs},
+                       {"phaseMs", timings.phaseMs},
+                       {"unwrapMs", timings.unwrapMs},
+                       {"averageMs", averageMs},
+                       {"pyramidMs", pyramidMs}}}};
+        if (surface.variance) {
+            data["varianceValidPixels"] = dataset->variance.validPixels;
+        }
+        if (replayDatasets) {
+            data["replay"] = true;
+        }
+        if (waiters.size() > 1) {
+            data["coalescedRequests"] = waiters.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(device.datasetMutex);
+            device.lastDataset = dataset;
+        }
+        json ready = data;
+        ready["requestId"] = requestId;
+        ready["requestIds"] = json::array();
+        for (const auto& waiter : waiters) {
+            ready["requestIds"].push_back(waiter.requestId);
+        }
+        publishEvent(device, "dataset", ready);
+
+        // 测量完成，向每个请求发送完成状态，数据集相同
+        for (const auto& waiter : waiters) {
+            sendMeasurementComplete(device, waiter.hdl, waiter.requestId, data);
+        }
+    });
+}
+
+// 处理获取面形数据请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleGetSurfaceData(Device& device,
+                                                     connection_hdl hdl,
+                                                     const std::string& requestId,
+                                                     const json& params) {
+    std::string readableTime = parseTimestampId(requestId);
+    std::cout << "处理获取面形数据请求: " << requestId << " (" << readableTime << ")" << std::endl;
+
+    auto sendError = [this, hdl, requestId](const std::string& message) {
+        json response = {{"command", "getSurfaceData"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", message}};
+
+        sendJson(hdl, response);
+    };
+
+    std::shared_ptr<const SurfaceDataset> dataset;
+    {
+        std::lock_guard<std::mutex> lock(device.datasetMutex);
+        dataset = device.lastDataset;
+    }
+
+    if (!dataset) {
+        sendError("No surface data");
+        return;
+    }
+
+    // level: 0为完整面形，k为第k级金字塔；progressive: 由最粗一级到完整面形依次发送
+    size_t level = 0;
+    bool progressive = false;
+    bool variance = false;
+    size_t chunkSize = 0;
+    if (params.is_object()) {
+        if (params.contains("level")) {
+            const json& value = params["level"];
+            if (!value.is_number_integer() || value.get<int64_t>() < 0 ||
+                value.get<int64_t>() > static_cast<int64_t>(dataset->pyramid.size())) {
+                sendError("Invalid level");
+                return;
+            }
+            level = static_cast<size_t>(value.get<int64_t>());
+        }
+        if (params.contains("progressive")) {
+            if (!params["progressive"].is_boolean()) {
+                sendError("Invalid progressive");
+                return;
+            }
+            progressive = params["progressive"].get<bool>();
+        }
+        if (params.contains("variance")) {
+            if (!params["variance"].is_boolean()) {
+                sendError("Invalid variance");
+                return;
+            }
+            variance = params["variance"].get<bool>();
+        }
+    }
+    // 分段发送面形，段与段之间可以插入命令响应
+    std::string error;
+    if (!parseChunkSize(params, chunkSize, error)) {
+        sendError(error);
+        return;
+    }
+
+    // 方差只有完整分辨率一级
+    if (variance) {
+        if (dataset->variance.heights.empty()) {
+            sendError("No variance data");
+            return;
+        }
+        if (level != 0 || progressive) {
+            sendError("Variance is only available at level 0");
+            return;
+        }
+        const SurfaceMap& map = dataset->variance;
+        json response = {{"command", "getSurfaceData"},
+                         {"requestId", requestId},
+                         {"status", "success"},
+                         {"data",
+                          {{"datasetId", datasetIdText(dataset->datasetId)},
+                           {"width", map.width},
+                           {"height", map.height},
+                           {"format", "double64"},
+                           {"unit", "nm^2"},
+                           {"content", "variance"},
+                           {"validPixels", map.validPixels}}}};
+
+        sendJson(hdl, response);
+        sendSurfaceFrame(hdl, dataset->datasetId, map, chunkSize);
+        return;
+    }
+
+    auto levelMap = [&dataset](size_t index) -> const SurfaceMap& {
+        return index == 0 ? dataset->map : dataset->pyramid[index - 1];
+    };
+    json levels = json::array();
+    for (size_t index = 0; index <= dataset->pyramid.size(); index++) {
+        const SurfaceMap& map = levelMap(index);
+        levels.push_back({{"level", index},
+                          {"width", map.width},
+                          {"height", map.height},
+                          {"validPixels", map.validPixels}});
+    }
+
+    const SurfaceMap& map = levelMap(progressive ? 0 : level);
+    json data = {{"datasetId", datasetIdText(dataset->datasetId)},
+                 {"width", map.width},
+                 {"height", map.height},
+                 {"format", "double64"},
+                 {"unit", "nm"},
+                 {"validPixels", map.validPixels},
+                 {"levels", levels}};
+    if (progressive) {
+        data["progressive"] = true;
+    } else {
+        data["level"] = level;
+    }
+    json response = {{"command", "getSurfaceData"},
+                     {"requestId", requestId},
+                     {"status", "success"},
+                     {"data", data}};
+
+    sendJson(hdl, response);
+
+    if (!progressive) {
+        sendSurfaceFrame(hdl, dataset->datasetId, map, chunkSize);
+        return;
+    }
+    // 最粗一级只有完整面形的几百分之一，客户端几乎立即可以显示预览
+    for (size_t index = dataset->pyramid.size() + 1; index-- > 0;) {
+        sendSurfaceFrame(hdl, dataset->datasetId, levelMap(index), chunkSize);
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sendSurfaceFrame(connection_hdl hdl,
+                                                 uint32_t datasetId,
+                                                 const SurfaceMap& map,
+                                                 size_t chunkSize) {
+    // 二进制数据：按行排列的double，无效像素为NaN；支持的平台均为小端，按主机字节序直接拷贝
+    BinaryHeader header;
+    header.messageType = static_cast<uint8_t>(BinaryMessageType::MeasureResult);
+    header.contexId = datasetId;
+    header.format = static_cast<uint8_t>(BinaryFormat::Double64);
+    header.width = map.width;
+    header.height = map.height;
+    header.payloadLength = static_cast<uint32_t>(map.heights.size() * sizeof(double));
+
+    std::string frame(BinaryHeader::kEncodedSize + header.payloadLength, '\0');
+    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&frame[0]));
+    std::memcpy(&frame[BinaryHeader::kEncodedSize], map.heights.data(), header.payloadLength);
+
+    // 大块数据优先级最低，发送窗口有空余时才交给传输层
+    std::shared_ptr<Session> session = findSession(hdl);
+    if (session && session->sender->send(SendPriority::Bulk,
+                                         splitIntoChunks(frame, chunkSize),
+                                         websocketpp::frame::opcode::binary)) {
+        m_metrics.addBytesOut(frame.size());
+    }
+}
+
+// 处理获取面形汇总请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleGetSurfaceSummary(Device& device,
+                                                        connection_hdl hdl,
+                                                        const std::string& requestId,
+                                                        const json& params) {
+    std::string readableTime = parseTimestampId(requestId);
+    std::cout << "处理获取面形汇总请求: " << requestId << " (" << readableTime << ")" << std::endl;
+
+    auto sendError = [this, hdl, requestId](const std::string& message) {
+        json response = {{"command", "getSurfaceSummary"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", message}};
+
+        sendJson(hdl, response);
+    };
+
+    SurfaceSummaryOptions options;
+    std::string error;
+    if (!parseSurfaceSummaryOptions(params, options, error)) {
+        sendError(error);
+        return;
+    }
+
+    std::shared_ptr<const SurfaceDataset> dataset;
+    {
+        std::lock_guard<std::mutex> lock(device.datasetMutex);
+        dataset = device.lastDataset;
+    }
+    if (!dataset) {
+        sendError("No surface data");
+        return;
+    }
+    // 指定datasetId时必须是最近一次测量，避免客户端把新数据集的结果当作旧数据集的
+    if (params.is_object() && params.contains("datasetId") &&
+        params["datasetId"] != datasetIdText(dataset->datasetId)) {
+        sendError("Dataset not found");
+        return;
+    }
+
+    // 拟合整幅面形需要数百毫秒，放入设备任务队列计算，不阻塞消息处理；
+    // 与测量共用该设备的任务线程，各会话轮流执行，服务器停止时随任务线程结束
+    postJob(device, sessionKey(hdl), [this, hdl, requestId, options, dataset, sendError]() {
+        auto start = std::chrono::steady_clock::now();
+        json data;
+        bool cached = false;
+        {
+            std::lock_guard<std::mutex> lock(dataset->summaryMutex);
+            auto it = dataset->summaries.find(options.cacheKey());
+            if (it != dataset->summaries.end()) {
+                data = it->second;
+                cached = true;
+            } else {
+                SurfaceSummary summary;
+                if (!summarizeSurface(dataset->map, options, summary)) {
+                    sendError("Not enough valid pixels");
+                    return;
+                }
+
+                json removed = json::array();
+                if (options.removePiston) {
+                    removed.push_back("piston");
+                }
+                if (options.removeTilt) {
+                    removed.push_back("tilt");
+                }
+                if (options.removePower) {
+                    removed.push_back("power");
+                }
+                // 实际拟合的项数可能多于请求的项数（需要去除的项），只返回请求的部分
+                std::vector<double> zernike(summary.zernike.begin(),
+                                            summary.zernike.begin() + options.zernikeTerms);
+                data = {{"datasetId", datasetIdText(dataset->datasetId)},
+                        {"unit", "nm"},
+                        {"validPixels", summary.validPixels},
+                        {"pv", summary.pv},
+                        {"rms", summary.rms},
+                        {"removed", removed},
+                        {"residualPv", summary.residualPv},
+                        {"residualRms", summary.residualRms},
+                        {"zernike", zernike},
+                        {"pupil",
+                         {{"centerX", summary.pupil.centerX},
+                          {"centerY", summary.pupil.centerY},
+                          {"radius", summary.pupil.radius}}}};
+                // 倾斜与离焦为Z2、Z3与Z4，拟合项数不足时不返回
+                if (summary.zernike.size() > 2) {
+                    data["tilt"] = {{"x", summary.zernike[1]}, {"y", summary.zernike[2]}};
+                }
+                if (summary.zernike.size() > 3) {
+                    data["power"] = summary.zernike[3];
+                }
+                dataset->summaries[options.cacheKey()] = data;
+            }
+        }
+
+        data["cached"] = cached;
+        data["computeMs"] = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+        json response = {{"command", "getSurfaceSummary"},
+                         {"requestId", requestId},
+                         {"status", "success"},
+                         {"data", data}};
+
+        sendJson(hdl, response);
+    });
+}
+
+// 处理订阅设备事件请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleSubscribe(Device& device,
+                                                connection_hdl hdl,
+                                                const std::string& requestId,
+                                                const json& params) {
+    std::set<std::string> topics;
+    std::string error;
+    if (!parseEventTopics(params, topics, error)) {
+        json response = {{"command", "subscribe"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", error}};
+
+        sendJson(hdl, response);
+        return;
+    }
+
+    std::shared_ptr<Session> session = findSession(hdl);
+    if (!session) {
+        return;
+    }
+    std::shared_ptr<const DeviceState> state = deviceState(device);
+    json subscribed = json::array();
+    {
+        std::lock_guard<std::mutex> lock(device.eventMutex);
+        const void* key = sessionKey(hdl);
+        std::shared_ptr<EventSubscription> subscription = device.eventSubscribers.get(key);
+        if (!subscription) {
+            subscription = std::make_shared<EventSubscription>();
+            subscription->session = session;
+            device.eventSubscribers.insert(key, subscription);
+        }
+        EventSubscriber& subscriber = subscription->events;
+        bool newStatus = topics.count("status") && !subscriber.topics.count("status");
+        subscriber.topics.insert(topics.begin(), topics.end());
+        for (const std::string& topic : subscriber.topics) {
+            subscribed.push_back(topic);
+        }
+
+        // 新订阅status时先发送一次当前状态作为基准，之后只在变化时推送
+        if (newStatus) {
+            uint64_t sequence = ++device.eventSequence;
+            json event = {{"command", "event"},
+                          {"deviceId", device.deviceId},
+                          {"topic", "status"},
+                          {"sequence", sequence},
+                          {"data", state->status}};
+            subscriber.pending["status"] = {sequence, event.dump()};
+        }
+    }
+
+    // 先回复订阅结果，基准状态由事件线程随后发送
+    json response = {{"command", "subscribe"},
+                     {"requestId", requestId},
+                     {"status", "success"},
+                     {"data", {{"topics", subscribed}}}};
+
+    sendJson(hdl, response);
+    device.eventCv.notify_one();
+}
+
+// 处理取消订阅设备事件请求
+template <typename Config>
+void BasicDeviceServer<Config>::handleUnsubscribe(Device& device,
+                                                  connection_hdl hdl,
+                                                  const std::string& requestId,
+                                                  const json& params) {
+    std::set<std::string> topics;
+    std::string error;
+    if (!parseEventTopics(params, topics, error)) {
+        json response = {{"command", "unsubscribe"},
+                         {"requestId", requestId},
+                         {"status", "error"},
+                         {"errorMessage", error}};
+
+        sendJson(hdl, response);
+        return;
+    }
+
+    json remaining = json::array();
+    {
+        std::lock_guard<std::mutex> lock(device.eventMutex);
+        if (EventSubscription* subscription = device.eventSubscribers.find(sessionKey(hdl))) {
+            EventSubscriber& subscriber = subscription->events;
+            for (const std::string& topic : topics) {
+                subscriber.topics.erase(topic);
+                subscriber.pending.erase(topic);
+            }
+            if (subscriber.topics.empty()) {
+                device.eventSubscribers.erase(sessionKey(hdl));
+            } else {
+                for (const std::string& topic : subscriber.topics) {
+                    remaining.push_back(topic);
+                }
+            }
+        }
+    }
+
+    json response = {{"command", "unsubscribe"},
+                     {"requestId", requestId},
+                     {"status", "success"},
+                     {"data", {{"topics", remaining}}}};
+
+    sendJson(hdl, response);
+}
+
+template <typename Config>
+std::shared_ptr<const typename BasicDeviceServer<Config>::DeviceState>
+BasicDeviceServer<Config>::deviceState(const Device& device) const {
+    return std::atomic_load(&device.state);
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::queueEvent(Device& device,
+                                           const std::string& topic,
+                                           const json& data) {
+    std::string payload;
+    uint64_t sequence = 0;
+    for (const std::shared_ptr<EventSubscription>& subscription : device.eventSubscribers) {
+        EventSubscriber& subscriber = subscription->events;
+        if (!subscriber.topics.count(topic)) {
+            continue;
+        }
+        // 序号与消息只在有订阅者时生成一次，所有订阅者共享
+        if (payload.empty()) {
+            sequence = ++device.eventSequence;
+            json event = {{"command", "event"},
+                          {"deviceId", device.deviceId},
+                          {"topic", topic},
+                          {"sequence", sequence},
+                          {"data", data}};
+            payload = event.dump();
+        }
+        if (subscriber.pending.count(topic)) {
+            m_metrics.recordEventCoalesced();
+        }
+        subscriber.pending[topic] = {sequence, payload};
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::publishEvent(Device& device,
+                                             const std::string& topic,
+                                             const json& data) {
+    {
+        std::lock_guard<std::mutex> lock(device.eventMutex);
+        if (device.eventSubscribers.empty()) {
+            return;
+        }
+        queueEvent(device, topic, data);
+    }
+    device.eventCv.notify_one();
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::publishStatus(Device& device) {
+    // 写入方串行化，并发调用时后发布的总是较新的状态
+    std::lock_guard<std::mutex> stateLock(device.stateMutex);
+    auto state = std::make_shared<DeviceState>();
+    {
+        std::lock_guard<std::mutex> lock(device.streamMutex);
+        state->alignViewMode = device.currentStreamMode;
+    }
+    state->isCalibrated = device.isCalibrated;
+    state->isStreaming = device.isStreaming;
+    state->isMeasuring = device.isMeasuring;
+
+    std::shared_ptr<const DeviceState> current = std::atomic_load(&device.state);
+    if (m_shared_state && device.shard < m_shared_state->deviceCount()) {
+        syncSharedState(device, current.get(), *state);
+    }
+    if (current && current->alignViewMode == state->alignViewMode &&
+        current->isCalibrated == state->isCalibrated &&
+        current->isStreaming == state->isStreaming &&
+        current->isMeasuring == state->isMeasuring) {
+        return;
+    }
+    state->version = current ? current->version + 1 : 1;
+    state->status = {{"version", state->version},
+                     {"alignViewMode", state->alignViewMode},
+                     {"isCalibrated", state->isCalibrated},
+                     {"isStreaming", state->isStreaming},
+                     {"isMeasuring", state->isMeasuring}};
+
+    // 模拟设备状态信息，其中固定的字段与快照一起序列化
+    json deviceStatus = {{"deviceId", device.deviceId},
+                         {"firmwareVersion", "2.5.1"},
+                         {"temperature", 36.7},
+                         {"uptime", 12345},
+                         {"alignViewMode", state->alignViewMode},
+                         {"isCalibrated", state->isCalibrated},
+                         {"isStreaming", state->isStreaming},
+                         {"isMeasuring", state->isMeasuring},
+                         {"battery", 85}};
+    state->deviceStatusText = deviceStatus.dump();
+    std::shared_ptr<const DeviceState> published = std::move(state);
+    std::atomic_store(&device.state, published);
+
+    {
+        std::lock_guard<std::mutex> lock(device.eventMutex);
+        queueEvent(device, "status", published->status);
+    }
+    device.eventCv.notify_one();
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::syncSharedState(Device& device,
+                                                const DeviceState* current,
+                                                DeviceState& state) {
+    // 与上一个快照不同的字段是本进程的修改；第一次同步时全部采用共享段中的值，
+    // 重启的工作进程因此继承其他工作进程设置的观察模式与校准状态
+    bool modeChanged = current && current->alignViewMode != state.alignViewMode;
+    bool calibratedChanged = current && current->isCalibrated != state.isCalibrated;
+    SharedDeviceStatus shared;
+    m_shared_state->update(device.shard,
+                           m_worker_index,
+                           modeChanged ? &state.alignViewMode : nullptr,
+                           calibratedChanged ? &state.isCalibrated : nullptr,
+                           device.isStreaming,
+                           device.isMeasuring,
+                           shared);
+    device.sharedVersion = shared.version;
+
+    // 采用其他工作进程的修改，本进程的视频流随之切换模式
+    if (shared.alignViewMode != state.alignViewMode) {
+        {
+            std::lock_guard<std::mutex> lock(device.streamMutex);
+            device.currentStreamMode = shared.alignViewMode;
+        }
+        device.streamCv.notify_all();
+    }
+    device.isCalibrated = shared.isCalibrated;
+    state.alignViewMode = shared.alignViewMode;
+    state.isCalibrated = shared.isCalibrated;
+    state.isStreaming = shared.isStreaming;
+    state.isMeasuring = shared.isMeasuring;
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::sharedStateLoop() {
+    while (m_running) {
+        std::this_thread::sleep_for(kSharedStatePollInterval);
+        for (const std::unique_ptr<Device>& entry : m_devices) {
+            Device& device = *entry;
+            if (device.shard < m_shared_state->deviceCount() &&
+                m_shared_state->version(device.shard) != device.sharedVersion) {
+                publishStatus(device);
+            }
+        }
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::eventLoop(Device& device) {
+    typedef std::pair<std::shared_ptr<Session>, typename EventSubscriber::PendingEvent> ReadyEvent;
+    std::vector<ReadyEvent> ready;
+    std::unique_lock<std::mutex> lock(device.eventMutex);
+    while (m_running) {
+        bool blocked = false;
+        for (const std::shared_ptr<EventSubscription>& subscription : device.eventSubscribers) {
+            EventSubscriber& subscriber = subscription->events;
+            const std::shared_ptr<Session>& session = subscription->session;
+            if (subscriber.pending.empty()) {
+                continue;
+            }
+            // 积压时事件留在pending中，期间的新事件直接替换，恢复后只发送每个主题的最新状态
+            if (session->sender->backlog(SendPriority::Event) > kMaxEventBacklog) {
+                blocked = true;
+                continue;
+            }
+            for (auto& pending : subscriber.pending) {
+                ready.emplace_back(session, std::move(pending.second));
+            }
+            subscriber.pending.clear();
+        }
+
+        if (ready.empty()) {
+            if (blocked) {
+                device.eventCv.wait_for(lock, kEventRetryInterval);
+            } else {
+                device.eventCv.wait(lock);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        // 同一连接的事件按发布顺序发送
+        std::stable_sort(ready.begin(), ready.end(), [](const ReadyEvent& a, const ReadyEvent& b) {
+            return a.second.sequence < b.second.sequence;
+        });
+        for (const ReadyEvent& event : ready) {
+            const std::string& payload = event.second.payload;
+            if (event.first->sender->send(
+                    SendPriority::Event, payload, websocketpp::frame::opcode::text)) {
+                m_metrics.addBytesOut(payload.size());
+                m_metrics.recordEventSent();
+                event.first->messagesSent.fetch_add(1, std::memory_order_relaxed);
+                event.first->bytesSent.fetch_add(payload.size(), std::memory_order_relaxed);
+            }
+        }
+        ready.clear();
+        lock.lock();
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::postJob(Device& device,
+                                        const void* owner,
+                                        std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(device.jobMutex);
+        // 会话的新任务排在它上一个排队任务的下一轮，没有排队任务时排在下一轮；
+        // 一个会话连续提交多个测量时，其他会话的任务插在它们之间，不必等它们全部完成
+        uint64_t& last = device.ownerRounds[owner];
+        DeviceJob entry;
+        entry.owner = owner;
+        entry.round = std::max(last, device.jobRound) + 1;
+        entry.run = std::move(job);
+        last = entry.round;
+        auto position = std::upper_bound(
+            device.jobs.begin(), device.jobs.end(), entry.round,
+            [](uint64_t round, const DeviceJob& queued) { return round < queued.round; });
+        device.jobs.insert(position, std::move(entry));
+    }
+    device.jobCv.notify_one();
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::jobLoop(Device& device) {
+    std::unique_lock<std::mutex> lock(device.jobMutex);
+    while (m_running) {
+        if (device.jobs.empty()) {
+            device.jobCv.wait(lock);
+            continue;
+        }
+        DeviceJob job = std::move(device.jobs.front());
+        device.jobs.pop_front();
+        device.jobRound = job.round;
+        auto owner = device.ownerRounds.find(job.owner);
+        if (owner != device.ownerRounds.end() && owner->second == job.round) {
+            device.ownerRounds.erase(owner);  // 该会话已没有排队的任务
+        }
+        lock.unlock();
+        try {
+            job.run();
+        } catch (std::exception& e) {
+            std::cerr << "Device job failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+template <typename Config>
+void BasicDeviceServer<Config>::streamLoop(Device& device) {
+    const auto period = std::chrono::microseconds(1000000 / kStreamFps);
+    auto next = std::chrono::steady_clock::now();
+    uint64_t frameIndex = 0;
+    std::string frame;
+    StreamViewCache views;
+    // 本帧的订阅者及其参数副本，参数在m_stream_mutex内复制，发送时无需持锁
+    std::vector<std::pair<std::shared_ptr<Session>, StreamSubscriber>> subscribers;
+
+    // 差分编码：视图与帧率相同的订阅者收到相同的帧序列，共享同一个编码器
+    struct EncoderSlot {
+        StreamEncoder encoder;
+        bool used = false;
+    };
+    std::map<std::pair<StreamView, double>, EncoderSlot> encoders;
+    // 每个订阅者（按streamId）已收到的最后一帧，只有它等于编码器的上一帧时才能发送差分帧
+    struct DeltaState {
+        bool hasFrame = false;
+        uint64_t lastIndex = 0;
+        uint32_t keyframeRequests = 0;
+    };
+    std::map<uint32_t, DeltaState> deltaStates;
+
+    // 回放模式按录制顺序循环使用该设备的帧，帧间隔为录制时的间隔除以回放速度
+    const std::vector<CaptureRecord>* replayFrames =
+        m_replay && !m_replay->frames(device.shard).empty() ? &m_replay->frames(device.shard)
+                                                             : nullptr;
+    size_t replayCursor = 0;
+
+    while (m_running) {
+        std::string mode;
+        {
+            std::unique_lock<std::mutex> lock(device.streamMutex);
+            // 有订阅者或近期有快照请求时按帧率连续采集，trigger模式只在收到触发时采集一帧
+            auto ready = [this, &device]() {
+                if (!m_running || device.triggerPending > 0) {
+                    return true;
+                }
+                if (device.currentStreamMode == "trigger") {
+                    return false;
+                }
+                bool streaming =
+                    device.currentStreamMode != "snapshot" && !device.streamSubscribers.empty();
+                return streaming || std::chrono::steady_clock::now() < device.snapshotDeadline;
+            };
+            // 等待前释放上一帧的订阅者副本，已停止的订阅的共享内存随之删除
+            subscribers.clear();
+            if (!ready()) {
+                device.streamCv.wait(lock, ready);
+                next = std::chrono::steady_clock::now();
+            }
+            if (!m_running) {
+                break;
+            }
+            device.triggerPending = 0;
+            for (const std::shared_ptr<StreamSubscription>& subscription :
+                 device.streamSubscribers) {
+                subscribers.emplace_back(subscription->session, subscription->stream);
+            }
+            mode = device.currentStreamMode;
+        }
+
+        // 直接渲染到三缓冲的写缓冲并发布，快照读取无需拷贝
+        uint64_t index = frameIndex++;
+        LatestFrame& latest = device.latestFrame.writeBuffer();
+        std::chrono::microseconds replayDelay = period;
+        if (replayFrames) {
+            const CaptureRecord& record = (*replayFrames)[replayCursor];
+            latest.frame.assign(reinterpret_cast<const char*>(record.data), record.size);
+            size_t nextCursor = (replayCursor + 1) % replayFrames->size();
+            if (nextCursor > replayCursor) {
+                uint64_t gapUs = (*replayFrames)[nextCursor].timestampUs - record.timestampUs;
+                replayDelay = std::chrono::microseconds(
+                    m_replay_speed > 0 ? static_cast<int64_t>(gapUs / m_replay_speed) : 0);
+            } else if (m_replay_speed <= 0) {
+                replayDelay = std::chrono::microseconds(0);
+            }
+            replayCursor = nextCursor;
         } else {
-            // 正常执行测量
-            // 模拟测量过程需要一些时间
-            std::this_thread::sleep_for(std::chrono::seconds(delay_seconds));
+            renderFrame(mode, index, latest.frame);
+        }
+        if (m_recorder) {
+            m_recorder->writeFrame(device.shard, latest.frame);
+        }
+        latest.sequence = index + 1;
+        latest.captured = std::chrono::steady_clock::now();
+        // snapshot模式只采集不推流；发布后写缓冲归读取端所有，推流使用副本
+        bool push = mode != "snapshot" && !subscribers.empty();
+        if (push) {
+            frame = latest.frame;
+        }
+        device.publishedSequence.store(latest.sequence, std::memory_order_release);
+        device.latestFrame.publish();
+        if (device.snapshotWaiters.load() > 0) {
+            // 回复新帧满足的快照请求；trigger模式下之后登记的请求等待下一次触发
+            uint64_t published = device.publishedSequence.load();
+            std::vector<SnapshotRequest> ready;
+            {
+                std::lock_guard<std::mutex> lock(device.streamMutex);
+                std::vector<SnapshotRequest>& requests = device.snapshotRequests;
+                auto pending = std::stable_partition(
+                    requests.begin(), requests.end(), [published](const SnapshotRequest& request) {
+                        return request.target > published;
+                    });
+                ready.assign(std::make_move_iterator(pending),
+                             std::make_move_iterator(requests.end()));
+                requests.erase(pending, requests.end());
+                device.snapshotWaiters.store(requests.size());
+            }
+            for (const SnapshotRequest& request : ready) {
+                sendSnapshot(device, request);
+            }
+        }
 
-            // 测量完成，发送完成状态
-            sendMeasurementComplete(hdl, requestId, params);
+        if (push) {
+            views.reset(&frame);
+            for (auto& slot : encoders) {
+                slot.second.used = false;
+            }
+            for (auto it = deltaStates.begin(); it != deltaStates.end();) {
+                bool active = false;
+                for (const auto& subscriber : subscribers) {
+                    active = active || subscriber.second.streamId == it->first;
+                }
+                it = active ? std::next(it) : deltaStates.erase(it);
+            }
+
+            for (auto& subscriber : subscribers) {
+                // 按订阅者的最大帧率均匀抽帧：累计帧数跨过整数时发送
+                double maxFps = subscriber.second.maxFps;
+                if (static_cast<uint64_t>((index + 1) * maxFps / kStreamFps) ==
+                    static_cast<uint64_t>(index * maxFps / kStreamFps)) {
+                    continue;
+                }
+
+                SendScheduler<server_type>& sender = *subscriber.first->sender;
+                std::string& output = views.get(subscriber.second.view);
+
+                // 共享内存传输：改写数据头后整帧写入槽位，连接上只发送槽位通知
+                // 客户端尚未释放全部槽位时丢帧，与发送缓冲积压时相同
+                if (subscriber.second.ring) {
+                    BinaryHeader header;
+                    decodeBinaryHeader(
+                        reinterpret_cast<const uint8_t*>(output.data()), output.size(), header);
+                    header.contexId = subscriber.second.streamId;
+                    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&output[0]));
+
+                    const uint8_t* data = reinterpret_cast<const uint8_t*>(output.data());
+                    uint64_t sequence = 0;
+                    uint32_t slot = 0;
+                    if (!subscriber.second.ring->write(data, output.size(), sequence, slot)) {
+                        m_metrics.recordFrameDropped();
+                        subscriber.first->framesDropped.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    uint8_t notice[BinaryHeader::kEncodedSize + FrameRing::kNoticeSize];
+                    header.messageType = static_cast<uint8_t>(BinaryMessageType::StreamSlot);
+                    header.payloadLength = FrameRing::kNoticeSize;
+                    encodeBinaryHeader(header, notice);
+                    encodeSlotNotice(sequence, slot, notice + BinaryHeader::kEncodedSize);
+                    if (sender.send(SendPriority::Stream,
+                                    std::string(reinterpret_cast<const char*>(notice),
+                                                sizeof(notice)),
+                                    websocketpp::frame::opcode::binary)) {
+                        m_metrics.recordFrameSent();
+                        m_metrics.addBytesOut(sizeof(notice));
+                        subscriber.first->framesSent.fetch_add(1, std::memory_order_relaxed);
+                        subscriber.first->bytesSent.fetch_add(sizeof(notice),
+                                                              std::memory_order_relaxed);
+                    }
+                    continue;
+                }
+
+                // 订阅者来不及接收时丢帧，避免发送队列无限增长
+                if (sender.backlog(SendPriority::Stream) > kMaxBufferedFrames * output.size()) {
+                    m_metrics.recordFrameDropped();
+                    subscriber.first->framesDropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                std::string* payload = &output;
+                DeltaState* state = nullptr;
+                if (subscriber.second.deltaEncoding) {
+                    EncoderSlot& slot = encoders[std::make_pair(subscriber.second.view, maxFps)];
+                    slot.used = true;
+                    StreamEncoder& encoder = slot.encoder;
+                    if (!encoder.hasFrame() || encoder.currentIndex() != index) {
+                        encoder.push(output, index);
+                    }
+
+                    // 丢帧、刚订阅、客户端请求重新同步或到达关键帧周期时发送关键帧
+                    state = &deltaStates[subscriber.second.streamId];
+                    bool useDelta =
+                        encoder.hasPrevious() && !encoder.periodicKeyframe() && state->hasFrame &&
+                        state->lastIndex == encoder.previousIndex() &&
+                        state->keyframeRequests == subscriber.second.keyframeRequests;
+                    payload = useDelta ? &encoder.delta() : &encoder.keyframe();
+                }
+
+                // 每个订阅者的streamId不同，发送前改写数据头中的contexId
+                BinaryHeader header;
+                decodeBinaryHeader(
+                    reinterpret_cast<const uint8_t*>(payload->data()), payload->size(), header);
+                header.contexId = subscriber.second.streamId;
+                encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&(*payload)[0]));
+
+                if (sender.send(
+                        SendPriority::Stream, *payload, websocketpp::frame::opcode::binary)) {
+                    m_metrics.recordFrameSent();
+                    m_metrics.addBytesOut(payload->size());
+                    subscriber.first->framesSent.fetch_add(1, std::memory_order_relaxed);
+                    subscriber.first->bytesSent.fetch_add(payload->size(),
+                                                          std::memory_order_relaxed);
+                    if (state) {
+                        state->hasFrame = true;
+                        state->lastIndex = index;
+                        state->keyframeRequests = subscriber.second.keyframeRequests;
+                    }
+                }
+            }
+
+            for (auto it = encoders.begin(); it != encoders.end();) {
+                it = it->second.used ? std::next(it) : encoders.erase(it);
+            }
         }
-    }).detach();
+
+        // trigger模式按触发采集，不按节拍等待
+        if (mode == "trigger") {
+            next = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // 按固定周期节拍发送，落后超过一个周期时重新对齐
+        next += replayFrames ? replayDelay : period;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) {
+            next = now;
+        } else {
+            std::this_thread::sleep_until(next);
+        }
+    }
 }
+
+template <typename Config>
+void BasicDeviceServer<Config>::renderFrame(const std::string& mode,
+                                            uint64_t frameIndex,
+                                            std::string& frame) {
+    // 干涉条纹查找表，避免逐像素计算三角函数
+    static const std::vector<uint8_t> fringeLut = []() {
+        std::vector<uint8_t> lut(256);
+        for (int i = 0; i < 256; i++) {
+            lut[i] = static_cast<uint8_t>(127.5 + 127.5 * std::cos(2.0 * kPi * i / 256.0));
+        }
+        return lut;
+    }();
+
+    BinaryHeader header;
+    header.messageType = static_cast<uint8_t>(BinaryMessageType::StreamImage);
+
+    if (mode == "align") {
+        // 监视对准视频流：静止的彩色渐变背景加移动的十字线
+        header.format = static_cast<uint8_t>(BinaryFormat::Rgb24);
+        header.width = kAlignWidth;
+        header.height = kAlignHeight;
+    } else {
+        // 干涉视频流：随时间移动的灰度干涉条纹
+        header.format = static_cast<uint8_t>(BinaryFormat::Gray8);
+        header.width = kViewWidth;
+        header.height = kViewHeight;
+    }
+
+    size_t channels = header.format / 8;
+    header.payloadLength = static_cast<uint32_t>(header.width * header.height * channels);
+    frame.resize(BinaryHeader::kEncodedSize + header.payloadLength);
+    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&frame[0]));
+
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(&frame[BinaryHeader::kEncodedSize]);
+    unsigned phase = static_cast<unsigned>(frameIndex * 8);
+
+    if (header.format == static_cast<uint8_t>(BinaryFormat::Rgb24)) {
+        unsigned crossX = static_cast<unsigned>(frameIndex * 4 % header.width);
+        unsigned crossY = header.height / 2;
+        for (unsigned y = 0; y < header.height; y++) {
+            uint8_t* row = pixels + y * header.width * 3;
+            uint8_t green = static_cast<uint8_t>(y * 255 / header.height);
+            for (unsigned x = 0; x < header.width; x++) {
+                bool cross = x == crossX || y == crossY;
+                row[x * 3 + 0] = cross ? 255 : static_cast<uint8_t>(x * 255 / header.width);
+                row[x * 3 + 1] = cross ? 255 : green;
+                row[x * 3 + 2] = cross ? 255 : 128;
+            }
+        }
+    } else {
+        for (unsigned y = 0; y < header.height; y++) {
+            uint8_t* row = pixels + y * header.width;
+            unsigned offset = y * 2 + phase;
+            for (unsigned x = 0; x < header.width; x++) {
+                row[x] = fringeLut[(x * 3 + offset) & 0xFF];
+            }
+        }
+    }
+}
+
+// 显式实例化：TCP服务器与进程内（iostream传输）服务器
+template class BasicDeviceServer<DeviceServerConfig>;
+template class BasicDeviceServer<websocketpp::config::core>;
@@ -0,0 +1,177 @@
+#include "in_process_server.h"
+#include <stdexcept>
+
+namespace {
+
+// 握手请求（请求行之后的部分），Sec-WebSocket-Key取自RFC 6455示例
+const char kHandshakeHeaders[] =
+    "Host: localhost\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+// 客户端帧必须加掩码，掩码值本身不影响服务器处理
+const uint8_t kMaskKey[4] = {0x12, 0x34, 0x56, 0x78};
+
+}  // namespace
+
+struct InProcessServer::Connection {
+    server_type::server_type::connection_ptr con;
+    std::mutex mutex;
+    std::string output;  // 服务器写出的原始字节
+    bool handshakeDone = false;
+};
+
+InProcessServer::InProcessServer(const DeviceServerOptions& options) : m_server(options) {
+    m_server.endpoint().clear_access_channels(websocketpp::log::alevel::all);
+    m_server.endpoint().clear_error_channels(websocketpp::log::elevel::all);
+}
+
+InProcessServer::~InProcessServer() {
+    for (size_t i = 0; i < m_connections.size(); i++) {
+        disconnect(i);
+    }
+}
+
+size_t InProcessServer::connect(const std::string& resource) {
+    std::unique_ptr<Connection> connection(new Connection());
+    Connection* state = connection.get();
+
+    connection->con = m_server.endpoint().get_connection();
+    connection->con->set_write_handler(
+        [state](connection_hdl, char const* data, size_t size) -> websocketpp::lib::error_code {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->output.append(data, size);
+            return websocketpp::lib::error_code();
+        });
+    connection->con->start();
+
+    m_connections.push_back(std::move(connection));
+    size_t index = m_connections.size() - 1;
+    feed(index, "GET " + resource + " HTTP/1.1\r\n" + kHandshakeHeaders);
+    return index;
+}
+
+void InProcessServer::disconnect(size_t connection) {
+    Connection& state = connectionAt(connection);
+    if (state.con) {
+        state.con->eof();
+        state.con.reset();
+    }
+}
+
+void InProcessServer::sendText(size_t connection, const std::string& payload) {
+    feed(connection, encodeClientFrame(payload));
+}
+
+void InProcessServer::feed(size_t connection, const std::string& bytes) {
+    Connection& state = connectionAt(connection);
+    if (!state.con) {
+        throw std::logic_error("connection closed");
+    }
+    state.con->read_all(bytes.data(), bytes.size());
+}
+
+std::vector<InProcessMessage> InProcessServer::receive(size_t connection) {
+    Connection& state = connectionAt(connection);
+    std::vector<InProcessMessage> messages;
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::string& output = state.output;
+
+    // 跳过握手响应
+    if (!state.handshakeDone) {
+        size_t end = output.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return messages;
+        }
+        output.erase(0, end + 4);
+        state.handshakeDone = true;
+    }
+
+    // 服务器帧不加掩码，且不会分片
+    size_t pos = 0;
+    while (output.size() - pos >= 2) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(output.data() + pos);
+        uint64_t length = data[1] & 0x7F;
+        size_t headerSize = 2;
+        if (length == 126) {
+            headerSize = 4;
+        } else if (length == 127) {
+            headerSize = 10;
+        }
+        if (output.size() - pos < headerSize) {
+            break;
+        }
+        if (length == 126) {
+            length = (static_cast<uint64_t>(data[2]) << 8) | data[3];
+        } else if (length == 127) {
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | data[2 + i];
+            }
+        }
+        if (output.size() - pos - headerSize < length) {
+            break;
+        }
+
+        InProcessMessage message;
+        message.opcode = static_cast<websocketpp::frame::opcode::value>(data[0] & 0x0F);
+        message.payload = output.substr(pos + headerSize, static_cast<size_t>(length));
+        messages.push_back(std::move(message));
+        pos += headerSize + static_cast<size_t>(length);
+    }
+    output.erase(0, pos);
+    return messages;
+}
+
+size_t InProcessServer::discard(size_t connection) {
+    Connection& state = connectionAt(connection);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    size_t size = state.output.size();
+    if (!state.handshakeDone) {
+        size_t end = state.output.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return 0;
+        }
+        state.handshakeDone = true;
+    }
+    state.output.clear();
+    return size;
+}
+
+std::string InProcessServer::encodeClientFrame(const std::string& payload,
+                                               websocketpp::frame::opcode::value opcode) {
+    std::string frame;
+    frame.reserve(payload.size() + 14);
+    frame.push_back(static_cast<char>(0x80 | opcode));
+
+    uint64_t length = payload.size();
+    if (length < 126) {
+        frame.push_back(static_cast<char>(0x80 | length));
+    } else if (length <= 0xFFFF) {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(length >> 8));
+        frame.push_back(static_cast<char>(length));
+    } else {
+        frame.push_back(static_cast<char>(0x80 | 127));
+        for (int i = 7; i >= 0; i--) {
+            frame.push_back(static_cast<char>(length >> (i * 8)));
+        }
+    }
+
+    frame.append(reinterpret_cast<const char*>(kMaskKey), 4);
+    for (size_t i = 0; i < payload.size(); i++) {
+        frame.push_back(static_cast<char>(payload[i] ^ kMaskKey[i & 3]));
+    }
+    return frame;
+}
+
+InProcessServer::Connection& InProcessServer::connectionAt(size_t connection) {
+    if (connection >= m_connections.size()) {
+        throw std::out_of_range("invalid connection index");
+    }
+    return *m_connections[connection];
+}
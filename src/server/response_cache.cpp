@@ -0,0 +1,59 @@
+#include "response_cache.h"
+
+ResponseCache::ResponseCache(size_t capacity, std::chrono::steady_clock::duration ttl)
+    : m_capacity(capacity), m_ttl(ttl) {}
+
+ResponseCache::Lookup ResponseCache::begin(const std::string& requestId,
+                                           const std::string& command,
+                                           std::string& response) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evict(now);
+    auto it = m_entries.find(requestId);
+    if (it != m_entries.end()) {
+        if (it->second.command != command) {
+            return Lookup::Miss;
+        }
+        if (!it->second.done) {
+            return Lookup::InProgress;
+        }
+        response = it->second.response;
+        return Lookup::Done;
+    }
+
+    Entry entry;
+    entry.command = command;
+    entry.received = now;
+    m_entries.emplace(requestId, std::move(entry));
+    m_order.push_back(requestId);
+    evict(now);
+    return Lookup::Miss;
+}
+
+void ResponseCache::complete(const std::string& requestId,
+                             const std::string& command,
+                             const std::string& response) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(requestId);
+    if (it == m_entries.end() || it->second.done || it->second.command != command) {
+        return;
+    }
+    it->second.response = response;
+    it->second.done = true;
+}
+
+size_t ResponseCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void ResponseCache::evict(std::chrono::steady_clock::time_point now) {
+    while (!m_order.empty()) {
+        auto it = m_entries.find(m_order.front());
+        if (m_order.size() <= m_capacity && now - it->second.received < m_ttl) {
+            break;
+        }
+        m_entries.erase(it);
+        m_order.pop_front();
+    }
+}
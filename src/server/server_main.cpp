@@ -1,11 +1,18 @@
 #include "device_server.h"
+#include "shared_device_state.h"
+#include "trace_recorder.h"
+#include "worker_supervisor.h"
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <locale>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-int main() {
+int main(int argc, char* argv[]) {
     // 设置控制台编码，以支持中文显示
 #ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);
@@ -13,7 +20,150 @@ int main() {
     std::locale::global(std::locale(""));
 #endif
     
-    DeviceServer server;
+    // 解析命令行参数
+    std::string traceFile;
+    std::string recordFile;
+    std::string replayFile;
+    DeviceServerOptions options;
+    size_t workerCount = 0;
+    uint16_t port = 9002;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string error;
+        if (parseSocketOption(argc, argv, i, options.socket, options.maxMessageSize, error)) {
+            if (!error.empty()) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--devices" && i + 1 < argc) {
+            // 逗号分隔的设备ID列表，第一个为默认设备
+            std::vector<std::string> deviceIds;
+            std::stringstream list(argv[++i]);
+            std::string deviceId;
+            while (std::getline(list, deviceId, ',')) {
+                if (!deviceId.empty()) {
+                    deviceIds.push_back(deviceId);
+                }
+            }
+            if (!deviceIds.empty()) {
+                options.deviceIds = deviceIds;
+            }
+        } else if (arg == "--port" && i + 1 < argc) {
+            unsigned long value = std::strtoul(argv[++i], nullptr, 10);
+            if (value == 0 || value > 65535) {
+                std::cerr << "端口必须在1到65535之间" << std::endl;
+                return 1;
+            }
+            port = static_cast<uint16_t>(value);
+        } else if (arg == "--pin-devices") {
+            options.pinDevices = true;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            // 多个工作进程通过SO_REUSEPORT共享监听端口
+            workerCount = std::strtoul(argv[++i], nullptr, 10);
+            if (workerCount == 0 || workerCount > SharedDeviceState::kMaxWorkers) {
+                std::cerr << "工作进程数量必须在1到" << SharedDeviceState::kMaxWorkers << "之间"
+                          << std::endl;
+                return 1;
+            }
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            // 倍数，max为不等待
+            std::string speed = argv[++i];
+            options.replaySpeed = speed == "max" ? 0 : std::strtod(speed.c_str(), nullptr);
+            if (speed != "max" && options.replaySpeed <= 0) {
+                std::cerr << "回放速度必须为正数或max" << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "用法: " << argv[0]
+                      << " [--port <端口>] [--trace <trace.json>] [--devices <id1,id2,...>]"
+                         " [--pin-devices] [--workers <n>] [--record <capture.bin>]"
+                         " [--replay <capture.bin>]"
+                         " [--replay-speed <倍数|max>] [套接字选项]\n"
+                      << kSocketOptionsUsage;
+            return 1;
+        }
+    }
+
+    // 大量空闲监控连接时每个连接占一个文件描述符
+    raiseOpenFileLimit();
+
+    // 回放文件只读映射，工作进程模式下在fork之前打开，各工作进程共享同一份映射
+    if (!replayFile.empty()) {
+        std::string error;
+        options.replay = CaptureReader::open(replayFile, error);
+        if (!options.replay) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "回放录制文件: " << replayFile << std::endl;
+    }
+
+    // 工作进程模式：共享段必须在fork之前创建，每个工作进程写各自的追踪文件与录制文件
+    if (workerCount > 0) {
+        options.reusePort = true;
+        options.sharedState = SharedDeviceState::create(options.deviceIds.size());
+        if (!options.sharedState) {
+            std::cerr << "无法创建共享设备状态" << std::endl;
+            return 1;
+        }
+        std::cout << "===== 设备服务器 (" << workerCount << "个工作进程) =====" << std::endl;
+        std::cout << "Prometheus指标: http://<host>:" << port
+                  << "/metrics (每个连接只看到所在工作进程的指标)" << std::endl;
+        auto worker = [&](size_t index) {
+            if (!traceFile.empty()) {
+                std::string workerTraceFile = traceFile + "." + std::to_string(index);
+                if (!TraceRecorder::instance().enable(workerTraceFile, "device_server")) {
+                    std::cerr << "无法创建追踪文件: " << workerTraceFile << std::endl;
+                    return 1;
+                }
+            }
+            DeviceServerOptions workerOptions = options;
+            workerOptions.workerIndex = index;
+            if (!recordFile.empty()) {
+                std::string workerRecordFile = recordFile + "." + std::to_string(index);
+                workerOptions.recorder = CaptureWriter::create(workerRecordFile);
+                if (!workerOptions.recorder) {
+                    std::cerr << "无法创建录制文件: " << workerRecordFile << std::endl;
+                    return 1;
+                }
+            }
+            DeviceServer server(workerOptions);
+            std::cout << "工作进程" << index << "已启动" << std::endl;
+            server.run(port);
+            return 0;
+        };
+        auto onExit = [&](size_t index, int pid) {
+            options.sharedState->releaseWorker(index, pid);
+        };
+        return runWorkerSupervisor(workerCount, worker, onExit);
+    }
+
+    // 开启请求生命周期追踪（Chrome/Perfetto trace-event格式）
+    if (!traceFile.empty()) {
+        if (!TraceRecorder::instance().enable(traceFile, "device_server")) {
+            std::cerr << "无法创建追踪文件: " << traceFile << std::endl;
+            return 1;
+        }
+        std::cout << "请求追踪已开启: " << traceFile << std::endl;
+    }
+
+    // 录制生产的视频帧与测量数据集
+    if (!recordFile.empty()) {
+        options.recorder = CaptureWriter::create(recordFile);
+        if (!options.recorder) {
+            std::cerr << "无法创建录制文件: " << recordFile << std::endl;
+            return 1;
+        }
+        std::cout << "录制到: " << recordFile << std::endl;
+    }
+
+    DeviceServer server(options);
     
     std::cout << "===== 设备服务器 =====" << std::endl;
     std::cout << "支持的命令类型:" << std::endl;
@@ -24,8 +174,19 @@ int main() {
     std::cout << "5. 开始取流 (startStream)" << std::endl;
     std::cout << "6. 停止取流 (stopStream)" << std::endl;
     std::cout << "7. 停止测量 (stopMeasure)" << std::endl;
+    std::cout << "8. 获取服务器指标 (getServerMetrics)" << std::endl;
+    std::cout << "9. 请求关键帧 (requestKeyframe)" << std::endl;
+    std::cout << "10. 获取单帧快照 (getSnapshot)" << std::endl;
+    std::cout << "11. 获取面形汇总 (getSurfaceSummary)" << std::endl;
+    std::cout << "12. 订阅设备事件 (subscribe/unsubscribe)" << std::endl;
+    std::cout << "设备:";
+    for (const std::string& deviceId : options.deviceIds) {
+        std::cout << " " << deviceId;
+    }
+    std::cout << " (请求中的deviceId或连接路径/devices/<id>选择设备)" << std::endl;
+    std::cout << "Prometheus指标: http://<host>:" << port << "/metrics" << std::endl;
     std::cout << "============================" << std::endl;
     
-    server.run(9002);  // 在9002端口启动服务器
+    server.run(port);  // 默认在9002端口启动服务器
     return 0;
 }
@@ -0,0 +1,357 @@
+#include "server_metrics.h"
+#include <algorithm>
+#include <locale>
+#include <sstream>
+#ifdef __linux__
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 单写者计数器自增：只有所属线程写入，因此用load+store代替原子读改写
+inline void bump(std::atomic<uint64_t>& counter, uint64_t delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+inline int highestBit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+// Prometheus导出使用的固定桶边界（微秒）
+const uint64_t kPrometheusBoundsUs[] = {100,    250,    500,     1000,    2500,    5000,
+                                        10000,  25000,  50000,   100000,  250000,  500000,
+                                        1000000, 2500000, 5000000, 10000000, 30000000};
+
+std::atomic<uint64_t> g_next_pool_id{1};
+
+// 进程当前的常驻内存字节数（仅Linux，读取/proc/self/statm），其他平台返回0
+uint64_t residentBytes() {
+#ifdef __linux__
+    std::FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+    int fields = std::fscanf(file, "%llu %llu", &size, &resident);
+    std::fclose(file);
+    return fields == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+}  // namespace
+
+// ---------------- LatencyHistogram ----------------
+
+size_t LatencyHistogram::bucketIndex(uint64_t micros) {
+    if (micros < kSubBucketCount) {
+        return static_cast<size_t>(micros);
+    }
+    int shift = highestBit(micros) - kSubBucketBits;
+    if (shift > kMaxShift) {
+        return kBucketCount - 1;
+    }
+    uint64_t mantissa = micros >> shift;  // 位于 [32, 64)
+    return static_cast<size_t>((shift + 1) * kSubBucketCount + (mantissa - kSubBucketCount));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < kSubBucketCount) {
+        return index;
+    }
+    uint64_t shift = index / kSubBucketCount - 1;
+    uint64_t mantissa = kSubBucketCount + index % kSubBucketCount;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    bump(m_buckets[bucketIndex(micros)]);
+    bump(m_count);
+    bump(m_sum, micros);
+    if (micros > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(micros, std::memory_order_relaxed);
+    }
+}
+
+// ---------------- LatencySnapshot ----------------
+
+void LatencySnapshot::merge(const LatencyHistogram& histogram) {
+    uint64_t count = histogram.m_count.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount; i++) {
+        buckets[i] += histogram.m_buckets[i].load(std::memory_order_relaxed);
+    }
+    this->count += count;
+    sum += histogram.m_sum.load(std::memory_order_relaxed);
+    max = std::max(max, histogram.m_max.load(std::memory_order_relaxed));
+}
+
+uint64_t LatencySnapshot::percentile(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count));
+    target = std::max<uint64_t>(1, std::min(target, count));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return std::min(LatencyHistogram::bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+uint64_t LatencySnapshot::countAtOrBelow(uint64_t bound) const {
+    // 与percentile()一致，桶内样本按桶上界（不超过max）计：跨越bound的桶整体计入更大的边界，
+    // 因此各边界的计数最多少算bound附近约3%区间内的样本；bound不小于max时等于count，与+Inf一致
+    uint64_t total = 0;
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount; i++) {
+        if (std::min(LatencyHistogram::bucketUpperBound(i), max) > bound) {
+            break;
+        }
+        total += buckets[i];
+    }
+    return total;
+}
+
+json LatencySnapshot::toJson() const {
+    return {{"count", count},
+            {"meanUs", count ? sum / count : 0},
+            {"p50Us", percentile(50.0)},
+            {"p90Us", percentile(90.0)},
+            {"p99Us", percentile(99.0)},
+            {"p999Us", percentile(99.9)},
+            {"maxUs", max}};
+}
+
+// ---------------- ServerMetrics ----------------
+
+// 线程持有的分片租约，线程退出时把分片归还给分片池
+struct ServerMetrics::ShardLease {
+    uint64_t poolId = 0;
+    std::weak_ptr<ShardPool> pool;
+    Shard* shard = nullptr;
+
+    ~ShardLease() {
+        if (auto owner = pool.lock()) {
+            std::lock_guard<std::mutex> lock(owner->mutex);
+            owner->freeShards.push_back(shard);
+        }
+    }
+};
+
+ServerMetrics::ServerMetrics()
+    : m_pool(std::make_shared<ShardPool>()),
+      m_start_time(std::chrono::steady_clock::now()) {
+    m_pool->id = g_next_pool_id.fetch_add(1);
+}
+
+ServerMetrics::Shard& ServerMetrics::localShard() {
+    thread_local std::vector<std::unique_ptr<ShardLease>> leases;
+
+    // 快速路径：本线程已持有该池子的分片
+    uint64_t poolId = m_pool->id;
+    for (auto& lease : leases) {
+        if (lease->poolId == poolId) {
+            return *lease->shard;
+        }
+    }
+
+    // 顺便清理已销毁池子的租约
+    leases.erase(std::remove_if(leases.begin(),
+                                leases.end(),
+                                [](const std::unique_ptr<ShardLease>& lease) {
+                                    return lease->pool.expired();
+                                }),
+                 leases.end());
+
+    std::unique_ptr<ShardLease> lease(new ShardLease());
+    lease->poolId = poolId;
+    lease->pool = m_pool;
+    {
+        std::lock_guard<std::mutex> lock(m_pool->mutex);
+        if (!m_pool->freeShards.empty()) {
+            lease->shard = m_pool->freeShards.back();
+            m_pool->freeShards.pop_back();
+        } else {
+            m_pool->shards.emplace_back(new Shard());
+            lease->shard = m_pool->shards.back().get();
+        }
+    }
+    leases.push_back(std::move(lease));
+    return *leases.back()->shard;
+}
+
+void ServerMetrics::recordRequest(CommandType type) {
+    bump(localShard().requests[static_cast<size_t>(type)]);
+}
+
+void ServerMetrics::recordError(CommandType type) {
+    bump(localShard().errors[static_cast<size_t>(type)]);
+}
+
+void ServerMetrics::recordTimeout(CommandType type) {
+    bump(localShard().timeouts[static_cast<size_t>(type)]);
+}
+
+void ServerMetrics::recordLatency(CommandType type, std::chrono::steady_clock::duration latency) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    localShard().latency[static_cast<size_t>(type)].record(
+        static_cast<uint64_t>(std::max<int64_t>(0, micros)));
+}
+
+void ServerMetrics::addBytesIn(size_t bytes) { bump(localShard().bytesIn, bytes); }
+
+void ServerMetrics::addBytesOut(size_t bytes) { bump(localShard().bytesOut, bytes); }
+
+void ServerMetrics::connectionOpened() { m_active_connections.fetch_add(1); }
+
+void ServerMetrics::connectionClosed() { m_active_connections.fetch_sub(1); }
+
+void ServerMetrics::recordFrameSent() { bump(localShard().framesSent); }
+
+void ServerMetrics::recordFrameDropped() { bump(localShard().framesDropped); }
+
+void ServerMetrics::recordEventSent() { bump(localShard().eventsSent); }
+
+void ServerMetrics::recordEventCoalesced() { bump(localShard().eventsCoalesced); }
+
+void ServerMetrics::recordMeasurementCoalesced() { bump(localShard().measurementsCoalesced); }
+
+void ServerMetrics::recordRequestReplayed() { bump(localShard().requestsReplayed); }
+
+ServerMetrics::Totals ServerMetrics::collect() const {
+    Totals totals;
+    std::lock_guard<std::mutex> lock(m_pool->mutex);
+    for (const auto& shard : m_pool->shards) {
+        for (size_t i = 0; i < kCommandCount; i++) {
+            totals.requests[i] += shard->requests[i].load(std::memory_order_relaxed);
+            totals.errors[i] += shard->errors[i].load(std::memory_order_relaxed);
+            totals.timeouts[i] += shard->timeouts[i].load(std::memory_order_relaxed);
+            totals.latency[i].merge(shard->latency[i]);
+        }
+        totals.bytesIn += shard->bytesIn.load(std::memory_order_relaxed);
+        totals.bytesOut += shard->bytesOut.load(std::memory_order_relaxed);
+        totals.framesSent += shard->framesSent.load(std::memory_order_relaxed);
+        totals.framesDropped += shard->framesDropped.load(std::memory_order_relaxed);
+        totals.eventsSent += shard->eventsSent.load(std::memory_order_relaxed);
+        totals.eventsCoalesced += shard->eventsCoalesced.load(std::memory_order_relaxed);
+        totals.measurementsCoalesced +=
+            shard->measurementsCoalesced.load(std::memory_order_relaxed);
+        totals.requestsReplayed += shard->requestsReplayed.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+json ServerMetrics::toJson() const {
+    Totals totals = collect();
+
+    json commands = json::object();
+    for (size_t i = 0; i < kCommandCount; i++) {
+        if (totals.requests[i] == 0 && totals.latency[i].count == 0) {
+            continue;
+        }
+        commands[commandTypeToString(static_cast<CommandType>(i))] = {
+            {"requests", totals.requests[i]},
+            {"errors", totals.errors[i]},
+            {"timeouts", totals.timeouts[i]},
+            {"latency", totals.latency[i].toJson()}};
+    }
+
+    auto uptime = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now() - m_start_time)
+                      .count();
+
+    return {{"uptimeSec", uptime},
+            {"activeConnections", m_active_connections.load()},
+            {"residentBytes", residentBytes()},
+            {"bytesIn", totals.bytesIn},
+            {"bytesOut", totals.bytesOut},
+            {"streamFramesSent", totals.framesSent},
+            {"streamFramesDropped", totals.framesDropped},
+            {"eventsSent", totals.eventsSent},
+            {"eventsCoalesced", totals.eventsCoalesced},
+            {"measurementsCoalesced", totals.measurementsCoalesced},
+            {"requestsReplayed", totals.requestsReplayed},
+            {"commands", commands}};
+}
+
+std::string ServerMetrics::toPrometheus() const {
+    Totals totals = collect();
+    std::ostringstream out;
+    // 全局locale可能带千分位分隔符，Prometheus格式要求使用C locale
+    out.imbue(std::locale::classic());
+    out.precision(12);
+
+    auto writeCounter = [&](const char* name, const char* help, const uint64_t* values) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " counter\n";
+        for (size_t i = 0; i < kCommandCount; i++) {
+            out << name << "{command=\"" << commandTypeToString(static_cast<CommandType>(i))
+                << "\"} " << values[i] << "\n";
+        }
+    };
+
+    writeCounter("device_server_requests_total", "Requests received per command.", totals.requests);
+    writeCounter("device_server_errors_total", "Error responses per command.", totals.errors);
+    writeCounter("device_server_timeouts_total", "Timeout responses per command.", totals.timeouts);
+
+    const char* latencyName = "device_server_request_latency_seconds";
+    out << "# HELP " << latencyName << " Time from request receipt to final response send.\n";
+    out << "# TYPE " << latencyName << " histogram\n";
+    for (size_t i = 0; i < kCommandCount; i++) {
+        const LatencySnapshot& snapshot = totals.latency[i];
+        std::string label = commandTypeToString(static_cast<CommandType>(i));
+        for (uint64_t bound : kPrometheusBoundsUs) {
+            out << latencyName << "_bucket{command=\"" << label << "\",le=\"" << bound / 1e6
+                << "\"} " << snapshot.countAtOrBelow(bound) << "\n";
+        }
+        out << latencyName << "_bucket{command=\"" << label << "\",le=\"+Inf\"} "
+            << snapshot.count << "\n";
+        out << latencyName << "_sum{command=\"" << label << "\"} " << snapshot.sum / 1e6 << "\n";
+        out << latencyName << "_count{command=\"" << label << "\"} " << snapshot.count << "\n";
+    }
+
+    auto writeScalar = [&](const char* name, const char* type, const char* help, double value) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+        out << name << " " << value << "\n";
+    };
+
+    writeScalar("device_server_bytes_in_total", "counter", "Websocket payload bytes received.",
+                static_cast<double>(totals.bytesIn));
+    writeScalar("device_server_bytes_out_total", "counter", "Websocket payload bytes sent.",
+                static_cast<double>(totals.bytesOut));
+    writeScalar("device_server_active_connections", "gauge", "Currently open connections.",
+                static_cast<double>(m_active_connections.load()));
+    writeScalar("process_resident_memory_bytes", "gauge", "Resident memory size in bytes.",
+                static_cast<double>(residentBytes()));
+    writeScalar("device_server_stream_frames_sent_total", "counter", "Stream frames sent.",
+                static_cast<double>(totals.framesSent));
+    writeScalar("device_server_stream_frames_dropped_total", "counter",
+                "Stream frames dropped because a subscriber was too slow.",
+                static_cast<double>(totals.framesDropped));
+    writeScalar("device_server_events_sent_total", "counter", "Device events sent.",
+                static_cast<double>(totals.eventsSent));
+    writeScalar("device_server_events_coalesced_total", "counter",
+                "Device events replaced by a newer event of the same topic before sending.",
+                static_cast<double>(totals.eventsCoalesced));
+    writeScalar("device_server_measurements_coalesced_total", "counter",
+                "Measurement requests served by an acquisition started for another request.",
+                static_cast<double>(totals.measurementsCoalesced));
+    writeScalar("device_server_requests_replayed_total", "counter",
+                "Retried requests answered from the response cache instead of re-executing.",
+                static_cast<double>(totals.requestsReplayed));
+    return out.str();
+}
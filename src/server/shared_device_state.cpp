@@ -0,0 +1,156 @@
+#include "shared_device_state.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <thread>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// 共享段中的槽位，只包含无锁原子量与普通数据，不同进程中地址不同也能使用
+struct SharedDeviceState::Slot {
+    std::atomic<int32_t> lock;  // 0为空闲，否则为持有者的pid
+    std::atomic<uint64_t> version;
+    char mode[kModeLength];
+    uint8_t calibrated;
+    uint8_t streaming[kMaxWorkers];
+    uint8_t measuring[kMaxWorkers];
+};
+
+static_assert(std::atomic<int32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory slots need lock-free atomics");
+
+namespace {
+
+#ifndef _WIN32
+// 槽位锁，临界区只有几十字节的拷贝，自旋等待即可
+class SlotLock {
+public:
+    explicit SlotLock(std::atomic<int32_t>& word) : m_word(word) {
+        int32_t self = static_cast<int32_t>(getpid());
+        for (unsigned spins = 0;; spins++) {
+            int32_t expected = 0;
+            if (m_word.compare_exchange_weak(expected, self, std::memory_order_acquire)) {
+                return;
+            }
+            if (spins > 64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    ~SlotLock() { m_word.store(0, std::memory_order_release); }
+
+private:
+    std::atomic<int32_t>& m_word;
+};
+#endif
+
+}  // namespace
+
+std::shared_ptr<SharedDeviceState> SharedDeviceState::create(size_t deviceCount) {
+#ifndef _WIN32
+    if (deviceCount == 0) {
+        return nullptr;
+    }
+    size_t bytes = deviceCount * sizeof(Slot);
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::shared_ptr<SharedDeviceState>(new SharedDeviceState(memory, bytes, deviceCount));
+#else
+    (void)deviceCount;
+    return nullptr;
+#endif
+}
+
+SharedDeviceState::SharedDeviceState(void* memory, size_t bytes, size_t deviceCount)
+    : m_memory(memory), m_bytes(bytes), m_device_count(deviceCount) {
+    // 匿名映射初始为全零，只需设置初始观察模式
+    for (size_t i = 0; i < deviceCount; i++) {
+        Slot* entry = new (static_cast<char*>(memory) + i * sizeof(Slot)) Slot();
+        std::strncpy(entry->mode, "continuous", kModeLength - 1);
+    }
+}
+
+SharedDeviceState::~SharedDeviceState() {
+#ifndef _WIN32
+    munmap(m_memory, m_bytes);
+#endif
+}
+
+SharedDeviceState::Slot& SharedDeviceState::slot(size_t device) const {
+    return static_cast<Slot*>(m_memory)[device];
+}
+
+uint64_t SharedDeviceState::version(size_t device) const {
+    return slot(device).version.load(std::memory_order_acquire);
+}
+
+void SharedDeviceState::update(size_t device,
+                               size_t worker,
+                               const std::string* mode,
+                               const bool* calibrated,
+                               bool streaming,
+                               bool measuring,
+                               SharedDeviceStatus& status) {
+#ifndef _WIN32
+    Slot& entry = slot(device);
+    worker = std::min(worker, kMaxWorkers - 1);
+    SlotLock lock(entry.lock);
+
+    bool changed = false;
+    if (mode && mode->compare(0, kModeLength - 1, entry.mode) != 0) {
+        std::memset(entry.mode, 0, kModeLength);
+        mode->copy(entry.mode, kModeLength - 1);
+        changed = true;
+    }
+    if (calibrated && *calibrated != (entry.calibrated != 0)) {
+        entry.calibrated = *calibrated;
+        changed = true;
+    }
+    if (streaming != (entry.streaming[worker] != 0) ||
+        measuring != (entry.measuring[worker] != 0)) {
+        entry.streaming[worker] = streaming;
+        entry.measuring[worker] = measuring;
+        changed = true;
+    }
+    if (changed) {
+        entry.version.fetch_add(1, std::memory_order_release);
+    }
+
+    status.alignViewMode = entry.mode;
+    status.isCalibrated = entry.calibrated != 0;
+    status.isStreaming = false;
+    status.isMeasuring = false;
+    for (size_t i = 0; i < kMaxWorkers; i++) {
+        status.isStreaming = status.isStreaming || entry.streaming[i];
+        status.isMeasuring = status.isMeasuring || entry.measuring[i];
+    }
+    status.version = entry.version.load(std::memory_order_relaxed);
+#else
+    (void)device, (void)worker, (void)mode, (void)calibrated, (void)streaming, (void)measuring;
+    (void)status;
+#endif
+}
+
+void SharedDeviceState::releaseWorker(size_t worker, int pid) {
+    worker = std::min(worker, kMaxWorkers - 1);
+    for (size_t i = 0; i < m_device_count; i++) {
+        Slot& entry = slot(i);
+        // 工作进程在临界区内崩溃时锁仍被它持有，先释放再清除标志
+        int32_t owner = pid;
+        entry.lock.compare_exchange_strong(owner, 0, std::memory_order_acq_rel);
+#ifndef _WIN32
+        SlotLock lock(entry.lock);
+        if (entry.streaming[worker] || entry.measuring[worker]) {
+            entry.streaming[worker] = 0;
+            entry.measuring[worker] = 0;
+            entry.version.fetch_add(1, std::memory_order_release);
+        }
+#endif
+    }
+}
@@ -0,0 +1,232 @@
+#include "stream_view.h"
+#include "binary_header.h"
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace {
+
+// format参数，raw表示按取流模式的原始格式发送
+bool parseStreamFormat(const std::string& name, uint8_t& pixelFormat) {
+    if (name == "raw") {
+        pixelFormat = 0;
+    } else if (name == "gray8") {
+        pixelFormat = static_cast<uint8_t>(BinaryFormat::Gray8);
+    } else if (name == "gray16") {
+        pixelFormat = static_cast<uint8_t>(BinaryFormat::Gray16);
+    } else if (name == "rgb24") {
+        pixelFormat = static_cast<uint8_t>(BinaryFormat::Rgb24);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readUint16(const json& value, uint16_t& out) {
+    if (!value.is_number_integer()) {
+        return false;
+    }
+    int64_t number = value.get<int64_t>();
+    if (number < 0 || number > 0xFFFF) {
+        return false;
+    }
+    out = static_cast<uint16_t>(number);
+    return true;
+}
+
+// roi支持对象 {"x","y","width","height"} 或数组 [x, y, width, height]
+bool parseRoi(const json& roi, StreamView& view) {
+    bool ok = false;
+    if (roi.is_object()) {
+        ok = roi.contains("x") && roi.contains("y") && roi.contains("width") &&
+             roi.contains("height") && readUint16(roi["x"], view.roiX) &&
+             readUint16(roi["y"], view.roiY) && readUint16(roi["width"], view.roiWidth) &&
+             readUint16(roi["height"], view.roiHeight);
+    } else if (roi.is_array() && roi.size() == 4) {
+        ok = readUint16(roi[0], view.roiX) && readUint16(roi[1], view.roiY) &&
+             readUint16(roi[2], view.roiWidth) && readUint16(roi[3], view.roiHeight);
+    }
+    return ok && view.roiWidth > 0 && view.roiHeight > 0;
+}
+
+}  // namespace
+
+// ---------------- StreamView ----------------
+
+bool StreamView::operator<(const StreamView& other) const {
+    return std::tie(pixelFormat, roiX, roiY, roiWidth, roiHeight, decimation) <
+           std::tie(other.pixelFormat,
+                    other.roiX,
+                    other.roiY,
+                    other.roiWidth,
+                    other.roiHeight,
+                    other.decimation);
+}
+
+void StreamView::resolve(unsigned sourceWidth,
+                         unsigned sourceHeight,
+                         unsigned& x,
+                         unsigned& y,
+                         unsigned& width,
+                         unsigned& height,
+                         unsigned& factor) const {
+    x = std::min<unsigned>(roiX, sourceWidth - 1);
+    y = std::min<unsigned>(roiY, sourceHeight - 1);
+    width = roiWidth ? std::min<unsigned>(roiWidth, sourceWidth - x) : sourceWidth - x;
+    height = roiHeight ? std::min<unsigned>(roiHeight, sourceHeight - y) : sourceHeight - y;
+    // 区域小于抽样倍率时至少输出1个像素
+    factor = std::max(1u, std::min({static_cast<unsigned>(decimation), width, height}));
+}
+
+void StreamView::outputSize(unsigned sourceWidth,
+                            unsigned sourceHeight,
+                            unsigned& width,
+                            unsigned& height) const {
+    unsigned x, y, roiW, roiH, factor;
+    resolve(sourceWidth, sourceHeight, x, y, roiW, roiH, factor);
+    width = roiW / factor;
+    height = roiH / factor;
+}
+
+bool parseStreamView(const json& params, StreamView& view, std::string& error) {
+    view = StreamView();
+    if (!params.is_object()) {
+        return true;
+    }
+
+    std::string format = params.value("format", "raw");
+    if (!parseStreamFormat(format, view.pixelFormat)) {
+        error = "Unsupported format: " + format;
+        return false;
+    }
+
+    if (params.contains("roi") && !params["roi"].is_null() && !parseRoi(params["roi"], view)) {
+        error = "Invalid roi";
+        return false;
+    }
+
+    if (params.contains("decimation")) {
+        const json& decimation = params["decimation"];
+        if (!decimation.is_number_integer() || decimation.get<int64_t>() < 1 ||
+            decimation.get<int64_t>() > static_cast<int64_t>(StreamView::kMaxDecimation)) {
+            error = "Invalid decimation";
+            return false;
+        }
+        view.decimation = static_cast<uint8_t>(decimation.get<int64_t>());
+    }
+    return true;
+}
+
+// ---------------- StreamViewCache ----------------
+
+void StreamViewCache::reset(std::string* source) {
+    m_source = source;
+    // 上一帧没有订阅者使用的视图不再保留缓冲
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->second.valid) {
+            it = m_entries.erase(it);
+        } else {
+            it->second.valid = false;
+            ++it;
+        }
+    }
+}
+
+std::string& StreamViewCache::get(const StreamView& view) {
+    BinaryHeader header;
+    decodeBinaryHeader(
+        reinterpret_cast<const uint8_t*>(m_source->data()), m_source->size(), header);
+
+    const uint8_t sourceFormat = header.format;
+    const uint8_t targetFormat = view.pixelFormat ? view.pixelFormat : sourceFormat;
+    unsigned x, y, width, height, factor;
+    view.resolve(header.width, header.height, x, y, width, height, factor);
+    if (targetFormat == sourceFormat && x == 0 && y == 0 && width == header.width &&
+        height == header.height && factor == 1) {
+        return *m_source;
+    }
+
+    Entry& entry = m_entries[view];
+    if (entry.valid) {
+        return entry.frame;
+    }
+
+    const unsigned outWidth = width / factor;
+    const unsigned outHeight = height / factor;
+    const unsigned sourceWidth = header.width;
+    header.format = targetFormat;
+    header.width = static_cast<uint16_t>(outWidth);
+    header.height = static_cast<uint16_t>(outHeight);
+    header.payloadLength = outWidth * outHeight * targetFormat / 8;
+    entry.frame.resize(BinaryHeader::kEncodedSize + header.payloadLength);
+    encodeBinaryHeader(header, reinterpret_cast<uint8_t*>(&entry.frame[0]));
+    uint8_t* payload = reinterpret_cast<uint8_t*>(&entry.frame[BinaryHeader::kEncodedSize]);
+
+    // 原始帧只有Gray8与Rgb24两种格式
+    // 目标为灰度时在8位灰度上抽样，目标为RGB时在RGB上抽样，16位灰度最后扩展
+    const unsigned sourceChannels = sourceFormat / 8;
+    const unsigned baseChannels =
+        targetFormat == static_cast<uint8_t>(BinaryFormat::Rgb24) ? 3 : 1;
+    const bool convert = baseChannels != sourceChannels;
+    const bool decimate = factor > 1;
+    const bool widen = targetFormat == static_cast<uint8_t>(BinaryFormat::Gray16);
+
+    // 当前图像，初始为原始帧中的ROI区域
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_source->data()) +
+                          BinaryHeader::kEncodedSize +
+                          (static_cast<size_t>(y) * sourceWidth + x) * sourceChannels;
+    size_t stride = static_cast<size_t>(sourceWidth) * sourceChannels;
+
+    // 最后一步直接写入帧载荷，中间结果在两个缓冲间交替
+    int step = 0;
+    auto output = [&](bool last, size_t bytes) -> uint8_t* {
+        if (last) {
+            return payload;
+        }
+        std::vector<uint8_t>& scratch = m_scratch[step++ & 1];
+        scratch.resize(bytes);
+        return scratch.data();
+    };
+
+    if (convert) {
+        size_t bytes = static_cast<size_t>(width) * height * baseChannels;
+        uint8_t* out = output(!decimate && !widen, bytes);
+        for (unsigned row = 0; row < height; row++) {
+            if (sourceChannels == 3) {
+                rgb24ToGray8(data + row * stride, out + row * width, width);
+            } else {
+                gray8ToRgb24(data + row * stride, out + row * width * 3, width);
+            }
+        }
+        data = out;
+        stride = static_cast<size_t>(width) * baseChannels;
+    }
+
+    if (decimate) {
+        size_t bytes = static_cast<size_t>(outWidth) * outHeight * baseChannels;
+        uint8_t* out = output(!widen, bytes);
+        if (baseChannels == 1) {
+            downsampleBoxGray8(data, width, height, stride, factor, out);
+        } else {
+            downsampleBoxRgb24(data, width, height, stride, factor, out);
+        }
+        data = out;
+        stride = static_cast<size_t>(outWidth) * baseChannels;
+    }
+
+    if (widen) {
+        for (unsigned row = 0; row < outHeight; row++) {
+            gray8ToGray16(data + row * stride, payload + row * outWidth * 2, outWidth);
+        }
+    } else if (!convert && !decimate) {
+        // 只裁剪ROI
+        size_t rowBytes = static_cast<size_t>(outWidth) * baseChannels;
+        for (unsigned row = 0; row < outHeight; row++) {
+            std::memcpy(payload + row * rowBytes, data + row * stride, rowBytes);
+        }
+    }
+
+    entry.valid = true;
+    return entry.frame;
+}
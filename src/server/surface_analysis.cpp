@@ -0,0 +1,529 @@
+#include "surface_analysis.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// 并行分块的行数
+const size_t kRowGrain = 16;
+// 法方程按该像素数成批累加
+const size_t kFitBatch = 64;
+// 前36项Fringe Zernike的最高径向阶数与角向阶数
+const unsigned kMaxRadialPower = 5;  // (n - m) / 2
+const unsigned kMaxAzimuthal = 5;    // m
+
+// Fringe顺序的Zernike项: R_n^m(ρ)·cos(mθ)或R_n^m(ρ)·sin(mθ)
+struct FringeTerm {
+    unsigned n;
+    unsigned m;
+    bool sine;
+};
+
+const FringeTerm kFringeTerms[SurfaceSummaryOptions::kMaxZernikeTerms] = {
+    {0, 0, false}, {1, 1, false}, {1, 1, true},  {2, 0, false}, {2, 2, false}, {2, 2, true},
+    {3, 1, false}, {3, 1, true},  {4, 0, false}, {3, 3, false}, {3, 3, true},  {4, 2, false},
+    {4, 2, true},  {5, 1, false}, {5, 1, true},  {6, 0, false}, {4, 4, false}, {4, 4, true},
+    {5, 3, false}, {5, 3, true},  {6, 2, false}, {6, 2, true},  {7, 1, false}, {7, 1, true},
+    {8, 0, false}, {5, 5, false}, {5, 5, true},  {6, 4, false}, {6, 4, true},  {7, 3, false},
+    {7, 3, true},  {8, 2, false}, {8, 2, true},  {9, 1, false}, {9, 1, true},  {10, 0, false},
+};
+
+// 径向多项式R_n^m(ρ) / ρ^m按ρ²的幂展开的系数，角向部分由(x + iy)^m给出，整个求值没有三角函数与除法
+struct RadialTable {
+    double coefficients[SurfaceSummaryOptions::kMaxZernikeTerms][kMaxRadialPower + 1] = {};
+
+    RadialTable() {
+        auto factorial = [](unsigned value) {
+            double result = 1;
+            for (unsigned i = 2; i <= value; i++) {
+                result *= i;
+            }
+            return result;
+        };
+        for (unsigned j = 0; j < SurfaceSummaryOptions::kMaxZernikeTerms; j++) {
+            const FringeTerm& term = kFringeTerms[j];
+            unsigned half = (term.n - term.m) / 2;
+            for (unsigned k = 0; k <= half; k++) {
+                double value = factorial(term.n - k) /
+                               (factorial(k) * factorial((term.n + term.m) / 2 - k) *
+                                factorial(half - k));
+                // ρ^(n-2k) / ρ^m = (ρ²)^(half-k)
+                coefficients[j][half - k] = k % 2 ? -value : value;
+            }
+        }
+    }
+};
+
+const RadialTable& radialTable() {
+    static const RadialTable table;
+    return table;
+}
+
+// 前terms项在(x, y)处的值，第j项写入out[j * stride]
+inline void evaluateZernike(double x, double y, unsigned terms, double* out, size_t stride = 1) {
+    const RadialTable& table = radialTable();
+    double r2 = x * x + y * y;
+    double r2Power[kMaxRadialPower + 1];
+    r2Power[0] = 1;
+    for (unsigned p = 1; p <= kMaxRadialPower; p++) {
+        r2Power[p] = r2Power[p - 1] * r2;
+    }
+    // (x + iy)^m = ρ^m·(cos(mθ) + i·sin(mθ))
+    double cosine[kMaxAzimuthal + 1];
+    double sine[kMaxAzimuthal + 1];
+    cosine[0] = 1;
+    sine[0] = 0;
+    for (unsigned m = 1; m <= kMaxAzimuthal; m++) {
+        cosine[m] = cosine[m - 1] * x - sine[m - 1] * y;
+        sine[m] = cosine[m - 1] * y + sine[m - 1] * x;
+    }
+
+    for (unsigned j = 0; j < terms; j++) {
+        const FringeTerm& term = kFringeTerms[j];
+        const double* coefficients = table.coefficients[j];
+        double radial = 0;
+        for (unsigned p = 0; p <= (term.n - term.m) / 2; p++) {
+            radial += coefficients[p] * r2Power[p];
+        }
+        out[j * stride] = radial * (term.sine ? sine[term.m] : cosine[term.m]);
+    }
+}
+
+// 最小值、最大值、和与平方和，NaN被跳过
+struct Moments {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0;
+    double sumSquares = 0;
+    double count = 0;
+
+    void merge(const Moments& other) {
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        sumSquares += other.sumSquares;
+        count += other.count;
+    }
+
+    double rms() const {
+        if (count == 0) {
+            return 0;
+        }
+        double mean = sum / count;
+        return std::sqrt(std::max(0.0, sumSquares / count - mean * mean));
+    }
+
+    double pv() const { return count > 0 ? max - min : 0; }
+};
+
+// 4路独立累加器，循环体无分支，编译器可将其向量化
+void accumulateMoments(const double* values, size_t size, Moments& moments) {
+    const size_t kLanes = 4;
+    double min[kLanes], max[kLanes], sum[kLanes], sumSquares[kLanes], count[kLanes];
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        min[lane] = moments.min;
+        max[lane] = moments.max;
+        sum[lane] = sumSquares[lane] = count[lane] = 0;
+    }
+
+    size_t i = 0;
+    auto step = [&](size_t lane, double value) {
+        bool valid = value == value;
+        double masked = valid ? value : 0.0;
+        // 与NaN比较总是false，无需额外判断
+        min[lane] = value < min[lane] ? value : min[lane];
+        max[lane] = value > max[lane] ? value : max[lane];
+        sum[lane] += masked;
+        sumSquares[lane] += masked * masked;
+        count[lane] += valid ? 1.0 : 0.0;
+    };
+    for (; i + kLanes <= size; i += kLanes) {
+        for (size_t lane = 0; lane < kLanes; lane++) {
+            step(lane, values[i + lane]);
+        }
+    }
+    for (size_t lane = 0; i < size; i++, lane++) {
+        step(lane, values[i]);
+    }
+
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        moments.min = std::min(moments.min, min[lane]);
+        moments.max = std::max(moments.max, max[lane]);
+        moments.sum += sum[lane];
+        moments.sumSquares += sumSquares[lane];
+        moments.count += count[lane];
+    }
+}
+
+// 一批像素的基函数值（按项存放，第j项的count个值从basis + j * kFitBatch开始）对法方程的贡献
+// 像素维连续存放，点积用4路独立累加器，与accumulateMoments一样可被编译器向量化
+// 只累加上三角
+void accumulateNormal(const double* basis,
+                      const double* values,
+                      size_t count,
+                      unsigned terms,
+                      double* normal,
+                      double* rhs) {
+    const size_t kLanes = 4;
+    auto dot = [&](const double* a, const double* b) {
+        double sum[kLanes] = {0, 0, 0, 0};
+        size_t p = 0;
+        for (; p + kLanes <= count; p += kLanes) {
+            for (size_t lane = 0; lane < kLanes; lane++) {
+                sum[lane] += a[p + lane] * b[p + lane];
+            }
+        }
+        for (; p < count; p++) {
+            sum[0] += a[p] * b[p];
+        }
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    };
+    for (unsigned i = 0; i < terms; i++) {
+        const double* bi = basis + i * kFitBatch;
+        for (unsigned j = i; j < terms; j++) {
+            normal[i * terms + j] += dot(bi, basis + j * kFitBatch);
+        }
+        rhs[i] += dot(bi, values);
+    }
+}
+
+// 对称正定矩阵的Cholesky分解求解 A·x = b（A为n x n，按行存储，被分解结果覆盖）
+bool solveCholesky(std::vector<double>& a, std::vector<double>& b, unsigned n) {
+    for (unsigned j = 0; j < n; j++) {
+        double diagonal = a[j * n + j];
+        for (unsigned k = 0; k < j; k++) {
+            diagonal -= a[j * n + k] * a[j * n + k];
+        }
+        if (!(diagonal > 0)) {
+            return false;
+        }
+        diagonal = std::sqrt(diagonal);
+        a[j * n + j] = diagonal;
+        for (unsigned i = j + 1; i < n; i++) {
+            double value = a[i * n + j];
+            for (unsigned k = 0; k < j; k++) {
+                value -= a[i * n + k] * a[j * n + k];
+            }
+            a[i * n + j] = value / diagonal;
+        }
+    }
+    // L·y = b，再 Lᵀ·x = y
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned k = 0; k < i; k++) {
+            b[i] -= a[i * n + k] * b[k];
+        }
+        b[i] /= a[i * n + i];
+    }
+    for (unsigned i = n; i-- > 0;) {
+        for (unsigned k = i + 1; k < n; k++) {
+            b[i] -= a[k * n + i] * b[k];
+        }
+        b[i] /= a[i * n + i];
+    }
+    return true;
+}
+
+size_t chunkCount(size_t rows) { return (rows + kRowGrain - 1) / kRowGrain; }
+
+}  // namespace
+
+// ---------------- SurfaceSummaryOptions ----------------
+
+unsigned SurfaceSummaryOptions::fittedTerms() const {
+    unsigned required = removePower ? 4 : removeTilt ? 3 : 1;
+    return std::max(zernikeTerms, required);
+}
+
+std::string SurfaceSummaryOptions::cacheKey() const {
+    std::string key = "terms=" + std::to_string(zernikeTerms) + ";remove=";
+    key += removePiston ? "p" : "";
+    key += removeTilt ? "t" : "";
+    key += removePower ? "w" : "";
+    return key;
+}
+
+bool parseSurfaceSummaryOptions(const json& params,
+                                SurfaceSummaryOptions& options,
+                                std::string& error) {
+    options = SurfaceSummaryOptions();
+    if (!params.is_object()) {
+        return true;
+    }
+
+    if (params.contains("zernikeTerms")) {
+        const json& terms = params["zernikeTerms"];
+        if (!terms.is_number_integer() || terms.get<int64_t>() < 1 ||
+            terms.get<int64_t>() > SurfaceSummaryOptions::kMaxZernikeTerms) {
+            error = "Invalid zernikeTerms";
+            return false;
+        }
+        options.zernikeTerms = static_cast<unsigned>(terms.get<int64_t>());
+    }
+
+    // 指定remove时只去除列出的项
+    if (params.contains("remove")) {
+        const json& remove = params["remove"];
+        if (!remove.is_array()) {
+            error = "Invalid remove";
+            return false;
+        }
+        options.removePiston = options.removeTilt = options.removePower = false;
+        for (const json& term : remove) {
+            std::string name = term.is_string() ? term.get<std::string>() : term.dump();
+            if (name == "piston") {
+                options.removePiston = true;
+            } else if (name == "tilt") {
+                options.removeTilt = true;
+            } else if (name == "power") {
+                options.removePower = true;
+            } else {
+                error = "Unsupported remove term: " + name;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+double fringeZernike(unsigned index, double x, double y) {
+    double values[SurfaceSummaryOptions::kMaxZernikeTerms];
+    evaluateZernike(x, y, index, values);
+    return values[index - 1];
+}
+
+bool summarizeSurface(const SurfaceMap& map,
+                      const SurfaceSummaryOptions& options,
+                      SurfaceSummary& summary) {
+    const size_t width = map.width;
+    const size_t height = map.height;
+    const double* heights = map.heights.data();
+    const size_t chunks = chunkCount(height);
+    summary = SurfaceSummary();
+
+    // 第一遍：统计量与有效像素质心
+    struct RawPartial {
+        Moments moments;
+        double sumX = 0;
+        double sumY = 0;
+    };
+    std::vector<RawPartial> raw(chunks);
+    parallelFor(height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        RawPartial& partial = raw[rowBegin / kRowGrain];
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            const double* row = heights + y * width;
+            double rowCount = partial.moments.count;
+            accumulateMoments(row, width, partial.moments);
+            double sumX = 0;
+            for (size_t x = 0; x < width; x++) {
+                sumX += row[x] == row[x] ? static_cast<double>(x) : 0.0;
+            }
+            partial.sumX += sumX;
+            partial.sumY += (partial.moments.count - rowCount) * y;
+        }
+    });
+
+    Moments moments;
+    double sumX = 0;
+    double sumY = 0;
+    for (const RawPartial& partial : raw) {
+        moments.merge(partial.moments);
+        sumX += partial.sumX;
+        sumY += partial.sumY;
+    }
+    summary.validPixels = static_cast<size_t>(moments.count);
+    summary.pv = moments.pv();
+    summary.rms = moments.rms();
+
+    const unsigned terms = options.fittedTerms();
+    if (summary.validPixels < terms) {
+        return false;
+    }
+    SurfacePupil& pupil = summary.pupil;
+    pupil.centerX = sumX / moments.count;
+    pupil.centerY = sumY / moments.count;
+
+    // 第二遍：孔径半径
+    std::vector<double> radius2(chunks, 0.0);
+    parallelFor(height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        double farthest = 0;
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            const double* row = heights + y * width;
+            double dy2 = (y - pupil.centerY) * (y - pupil.centerY);
+            for (size_t x = 0; x < width; x++) {
+                double dx = x - pupil.centerX;
+                double distance2 = row[x] == row[x] ? dx * dx + dy2 : 0.0;
+                farthest = distance2 > farthest ? distance2 : farthest;
+            }
+        }
+        radius2[rowBegin / kRowGrain] = farthest;
+    });
+    pupil.radius = std::sqrt(*std::max_element(radius2.begin(), radius2.end()));
+    if (pupil.radius <= 0) {
+        pupil.radius = 1;
+    }
+
+    // 第三遍：最小二乘法方程 AᵀA·c = Aᵀh（只累加上三角）
+    struct FitPartial {
+        std::vector<double> normal;
+        std::vector<double> rhs;
+    };
+    std::vector<FitPartial> fit(chunks);
+    const double scale = 1.0 / pupil.radius;
+    parallelFor(height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        FitPartial& partial = fit[rowBegin / kRowGrain];
+        partial.normal.assign(terms * terms, 0.0);
+        partial.rhs.assign(terms, 0.0);
+        std::vector<double> basis(kFitBatch * terms);
+        std::vector<double> values(kFitBatch);
+        size_t count = 0;
+        auto flush = [&]() {
+            accumulateNormal(basis.data(),
+                             values.data(),
+                             count,
+                             terms,
+                             partial.normal.data(),
+                             partial.rhs.data());
+            count = 0;
+        };
+
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            const double* row = heights + y * width;
+            double ny = (y - pupil.centerY) * scale;
+            for (size_t x = 0; x < width; x++) {
+                if (std::isnan(row[x])) {
+                    continue;
+                }
+                evaluateZernike((x - pupil.centerX) * scale, ny, terms, &basis[count], kFitBatch);
+                values[count] = row[x];
+                if (++count == kFitBatch) {
+                    flush();
+                }
+            }
+        }
+        flush();
+    });
+
+    std::vector<double> normal(terms * terms, 0.0);
+    std::vector<double> coefficients(terms, 0.0);
+    for (const FitPartial& partial : fit) {
+        for (size_t i = 0; i < partial.normal.size(); i++) {
+            normal[i] += partial.normal[i];
+        }
+        for (unsigned i = 0; i < terms; i++) {
+            coefficients[i] += partial.rhs[i];
+        }
+    }
+    for (unsigned i = 0; i < terms; i++) {
+        for (unsigned j = 0; j < i; j++) {
+            normal[i * terms + j] = normal[j * terms + i];
+        }
+    }
+    if (!solveCholesky(normal, coefficients, terms)) {
+        return false;
+    }
+    summary.zernike = coefficients;
+
+    // 第四遍：去除指定项后的残差统计
+    const double piston = options.removePiston ? coefficients[0] : 0;
+    const double tiltX = options.removeTilt ? coefficients[1] : 0;
+    const double tiltY = options.removeTilt ? coefficients[2] : 0;
+    const double power = options.removePower ? coefficients[3] : 0;
+    std::vector<Moments> residual(chunks);
+    parallelFor(height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        Moments& partial = residual[rowBegin / kRowGrain];
+        std::vector<double> values(width);
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            const double* row = heights + y * width;
+            double ny = (y - pupil.centerY) * scale;
+            double rowTerms = piston + tiltY * ny;
+            for (size_t x = 0; x < width; x++) {
+                double nx = (x - pupil.centerX) * scale;
+                double removed = rowTerms + tiltX * nx + power * (2 * (nx * nx + ny * ny) - 1);
+                values[x] = row[x] - removed;
+            }
+            accumulateMoments(values.data(), width, partial);
+        }
+    });
+
+    Moments residualMoments;
+    for (const Moments& partial : residual) {
+        residualMoments.merge(partial);
+    }
+    summary.residualPv = residualMoments.pv();
+    summary.residualRms = residualMoments.rms();
+    return true;
+}
+
+void downsampleSurface(const SurfaceMap& source, unsigned factor, SurfaceMap& target) {
+    const size_t width = source.width;
+    const size_t height = source.height;
+    const size_t targetWidth = (width + factor - 1) / factor;
+    const size_t targetHeight = (height + factor - 1) / factor;
+    // 能整除的部分走无分支的快速路径，最后不完整的一列单独处理
+    const size_t fullBlocks = width / factor;
+    target.width = static_cast<uint16_t>(targetWidth);
+    target.height = static_cast<uint16_t>(targetHeight);
+    target.heights.assign(targetWidth * targetHeight, 0.0);
+
+    std::vector<size_t> valid(chunkCount(targetHeight), 0);
+    parallelFor(targetHeight, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        std::vector<double> sum(targetWidth);
+        std::vector<double> count(targetWidth);
+        size_t chunkValid = 0;
+        for (size_t ty = rowBegin; ty < rowEnd; ty++) {
+            std::fill(sum.begin(), sum.end(), 0.0);
+            std::fill(count.begin(), count.end(), 0.0);
+            const size_t yEnd = std::min(ty * factor + factor, height);
+            for (size_t y = ty * factor; y < yEnd; y++) {
+                const double* row = source.heights.data() + y * width;
+                for (size_t tx = 0; tx < fullBlocks; tx++) {
+                    const double* block = row + tx * factor;
+                    double blockSum = 0;
+                    double blockCount = 0;
+                    for (unsigned k = 0; k < factor; k++) {
+                        bool isValid = block[k] == block[k];
+                        blockSum += isValid ? block[k] : 0.0;
+                        blockCount += isValid ? 1.0 : 0.0;
+                    }
+                    sum[tx] += blockSum;
+                    count[tx] += blockCount;
+                }
+                for (size_t x = fullBlocks * factor; x < width; x++) {
+                    if (row[x] == row[x]) {
+                        sum[fullBlocks] += row[x];
+                        count[fullBlocks] += 1;
+                    }
+                }
+            }
+
+            double* out = target.heights.data() + ty * targetWidth;
+            for (size_t tx = 0; tx < targetWidth; tx++) {
+                out[tx] = count[tx] > 0 ? sum[tx] / count[tx]
+                                        : std::numeric_limits<double>::quiet_NaN();
+                chunkValid += count[tx] > 0;
+            }
+        }
+        valid[rowBegin / kRowGrain] = chunkValid;
+    });
+
+    target.validPixels = 0;
+    for (size_t chunkValid : valid) {
+        target.validPixels += chunkValid;
+    }
+}
+
+void buildSurfacePyramid(const SurfaceMap& map, std::vector<SurfaceMap>& levels) {
+    levels.clear();
+    for (;;) {
+        // 每级只依赖上一级，代价为上一级的1/kPyramidFactor²
+        const SurfaceMap& source = levels.empty() ? map : levels.back();
+        if (std::min(source.width, source.height) / kPyramidFactor < kPyramidMinSide) {
+            return;
+        }
+        SurfaceMap level;
+        downsampleSurface(source, kPyramidFactor, level);
+        levels.push_back(std::move(level));
+    }
+}
@@ -0,0 +1,511 @@
+#include "surface_engine.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+const float kPiF = 3.14159265f;
+const float kTwoPiF = 6.28318531f;
+
+// 模拟相机：12位灰度，背景强度与条纹调制幅度
+const float kIntensityMax = 4095.0f;
+const float kBackground = 2048.0f;
+const float kModulation = 1600.0f;
+// 调制度低于该值的像素视为无效（孔径外只有噪声）
+const float kMinModulation = 0.2f * kModulation;
+// 孔径半径相对于图像短边一半的比例
+const double kApertureFill = 0.95;
+// 并行分块的行数
+const size_t kRowGrain = 16;
+// 解包裹时按该行数分带，带内逐行对齐，带间再统一对齐
+const size_t kBandRows = 32;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool readNumber(const json& params, const char* name, double low, double high, double& out) {
+    if (!params.contains(name)) {
+        return true;
+    }
+    const json& value = params[name];
+    if (!value.is_number() || !(value.get<double>() >= low && value.get<double>() <= high)) {
+        return false;
+    }
+    out = value.get<double>();
+    return true;
+}
+
+bool readInteger(const json& params, const char* name, int64_t low, int64_t high, int64_t& out) {
+    if (!params.contains(name)) {
+        return true;
+    }
+    const json& value = params[name];
+    if (!value.is_number_integer() || value.get<int64_t>() < low || value.get<int64_t>() > high) {
+        return false;
+    }
+    out = value.get<int64_t>();
+    return true;
+}
+
+// 孔径圆心与半径（像素）
+void aperture(const SurfaceParams& params, double& cx, double& cy, double& radius) {
+    cx = (params.width - 1) * 0.5;
+    cy = (params.height - 1) * 0.5;
+    radius = kApertureFill * std::min(params.width, params.height) * 0.5;
+}
+
+// 单位圆内各项梯度的上界之和（波长/半径），用于检查条纹是否超过采样极限
+double maxGradient(const SurfaceParams& params) {
+    return std::fabs(params.tiltX) + std::fabs(params.tiltY) + 4 * std::fabs(params.power) +
+           2 * std::fabs(params.astigmatism) + 7 * std::fabs(params.coma) +
+           12 * std::fabs(params.spherical);
+}
+
+// 反正切近似，最大误差约1e-5弧度，无分支以便向量化
+inline float fastAtan2(float y, float x) {
+    float ax = std::fabs(x);
+    float ay = std::fabs(y);
+    float mx = std::max(ax, ay);
+    float mn = std::min(ax, ay);
+    float a = mn / (mx + std::numeric_limits<float>::min());
+    float s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    r = ay > ax ? 1.57079637f - r : r;
+    r = x < 0 ? kPiF - r : r;
+    return y < 0 ? -r : r;
+}
+
+// 由S、C求包裹相位φ = atan2(-S, C)，|(S, C)|低于threshold（调制度不足）的像素为NaN
+void wrappedPhaseRow(const float* sumSin,
+                     const float* sumCos,
+                     float* out,
+                     size_t width,
+                     float threshold) {
+    const float threshold2 = threshold * threshold;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (size_t x = 0; x < width; x++) {
+        float s = sumSin[x];
+        float c = sumCos[x];
+        float phase = fastAtan2(-s, c);
+        out[x] = s * s + c * c >= threshold2 ? phase : nan;
+    }
+}
+
+// 每行、每幅干涉图独立的噪声序列，保证并行生成的结果与线程数无关
+inline uint32_t noiseSeed(uint32_t seed, size_t row, size_t step) {
+    uint32_t state = seed * 0x9E3779B9u ^ static_cast<uint32_t>(row * 0x85EBCA6Bu) ^
+                     static_cast<uint32_t>(step * 0xC2B2AE35u);
+    return state ? state : 0x6D2B79F5u;
+}
+
+// 行内相位解包裹：相邻像素的相位差折回(-π, π]后累加，遇到无效像素重新开始一段
+void unwrapRow(const float* wrapped, float* diff, double* out, size_t width) {
+    diff[0] = 0;
+    for (size_t x = 1; x < width; x++) {
+        float d = wrapped[x] - wrapped[x - 1];
+        d = d > kPiF ? d - kTwoPiF : d;
+        diff[x] = d < -kPiF ? d + kTwoPiF : d;
+    }
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    bool inRun = false;
+    double phase = 0;
+    for (size_t x = 0; x < width; x++) {
+        if (std::isnan(wrapped[x])) {
+            out[x] = nan;
+            inRun = false;
+            continue;
+        }
+        phase = inRun ? phase + diff[x] : wrapped[x];
+        inRun = true;
+        out[x] = phase;
+    }
+}
+
+// 将当前行的每段连续有效像素按与上一行的平均差值对齐到同一个2π周期
+void alignRow(const double* previous, double* current, size_t width) {
+    size_t x = 0;
+    while (x < width) {
+        if (std::isnan(current[x])) {
+            x++;
+            continue;
+        }
+        size_t begin = x;
+        double sum = 0;
+        size_t overlap = 0;
+        for (; x < width && !std::isnan(current[x]); x++) {
+            if (!std::isnan(previous[x])) {
+                sum += previous[x] - current[x];
+                overlap++;
+            }
+        }
+        if (overlap == 0) {
+            continue;
+        }
+        double offset = 2 * kPi * std::round(sum / overlap / (2 * kPi));
+        if (offset != 0) {
+            for (size_t i = begin; i < x; i++) {
+                current[i] += offset;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+bool parseSurfaceParams(const json& params, SurfaceParams& surface, std::string& error) {
+    surface = SurfaceParams();
+    if (!params.is_object()) {
+        return true;
+    }
+
+    int64_t width = surface.width;
+    int64_t height = surface.height;
+    int64_t steps = surface.steps;
+    if (!readInteger(params, "width", SurfaceParams::kMinSize, SurfaceParams::kMaxSize, width) ||
+        !readInteger(params, "height", SurfaceParams::kMinSize, SurfaceParams::kMaxSize, height)) {
+        error = "Invalid surface size";
+        return false;
+    }
+    if (!readInteger(params, "steps", SurfaceParams::kMinSteps, SurfaceParams::kMaxSteps, steps)) {
+        error = "Invalid steps";
+        return false;
+    }
+    surface.width = static_cast<uint16_t>(width);
+    surface.height = static_cast<uint16_t>(height);
+    surface.steps = static_cast<uint8_t>(steps);
+
+    int64_t averageCount = surface.averageCount;
+    if (!readInteger(params, "averageCount", 1, SurfaceParams::kMaxAverageCount, averageCount)) {
+        error = "Invalid averageCount";
+        return false;
+    }
+    surface.averageCount = static_cast<uint8_t>(averageCount);
+    if (params.contains("variance")) {
+        if (!params["variance"].is_boolean()) {
+            error = "Invalid variance";
+            return false;
+        }
+        surface.variance = params["variance"].get<bool>();
+    }
+    if (surface.variance && surface.averageCount < 2) {
+        error = "Variance requires averageCount >= 2";
+        return false;
+    }
+
+    if (!readNumber(params, "wavelength", 100, 2000, surface.wavelength)) {
+        error = "Invalid wavelength";
+        return false;
+    }
+    if (!readNumber(params, "noise", 0, 0.5, surface.noise)) {
+        error = "Invalid noise";
+        return false;
+    }
+
+    if (params.contains("surface")) {
+        const json& terms = params["surface"];
+        const double limit = 100;
+        if (!terms.is_object() || !readNumber(terms, "tiltX", -limit, limit, surface.tiltX) ||
+            !readNumber(terms, "tiltY", -limit, limit, surface.tiltY) ||
+            !readNumber(terms, "power", -limit, limit, surface.power) ||
+            !readNumber(terms, "astigmatism", -limit, limit, surface.astigmatism) ||
+            !readNumber(terms, "coma", -limit, limit, surface.coma) ||
+            !readNumber(terms, "spherical", -limit, limit, surface.spherical)) {
+            error = "Invalid surface";
+            return false;
+        }
+    }
+
+    // 相邻像素的相位差超过半个周期时条纹无法分辨，解包裹结果没有意义
+    double cx, cy, radius;
+    aperture(surface, cx, cy, radius);
+    if (maxGradient(surface) / radius >= 0.5) {
+        error = "Surface too steep for sampling";
+        return false;
+    }
+    return true;
+}
+
+bool sameSurfaceParams(const SurfaceParams& a, const SurfaceParams& b) {
+    return a.width == b.width && a.height == b.height && a.steps == b.steps &&
+           a.wavelength == b.wavelength && a.noise == b.noise &&
+           a.averageCount == b.averageCount && a.variance == b.variance &&
+           a.tiltX == b.tiltX && a.tiltY == b.tiltY && a.power == b.power &&
+           a.astigmatism == b.astigmatism && a.coma == b.coma && a.spherical == b.spherical;
+}
+
+// ---------------- SurfaceAccumulator ----------------
+
+void SurfaceAccumulator::reset(uint16_t width, uint16_t height) {
+    const size_t pixels = static_cast<size_t>(width) * height;
+    m_width = width;
+    m_height = height;
+    m_samples = 0;
+    m_mean.assign(pixels, 0.0);
+    m_m2.assign(pixels, 0.0);
+    m_count.assign(pixels, 0.0);
+}
+
+void SurfaceAccumulator::add(const SurfaceMap& map) {
+    const size_t width = m_width;
+    parallelFor(m_height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        const size_t begin = rowBegin * width;
+        const size_t end = rowEnd * width;
+        const double* values = map.heights.data();
+        double* mean = m_mean.data();
+        double* m2 = m_m2.data();
+        double* count = m_count.data();
+        for (size_t i = begin; i < end; i++) {
+            // 无效样本的delta为0，均值与M2保持不变
+            const double value = values[i];
+            const bool valid = value == value;
+            const double n = count[i] + (valid ? 1.0 : 0.0);
+            const double delta = valid ? value - mean[i] : 0.0;
+            const double updated = mean[i] + delta / std::max(n, 1.0);
+            m2[i] += delta * (valid ? value - updated : 0.0);
+            mean[i] = updated;
+            count[i] = n;
+        }
+    });
+    m_samples++;
+}
+
+void SurfaceAccumulator::mean(SurfaceMap& map) const {
+    const size_t pixels = m_mean.size();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    map.width = m_width;
+    map.height = m_height;
+    map.heights.resize(pixels);
+    size_t valid = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        map.heights[i] = m_count[i] > 0 ? m_mean[i] : nan;
+        valid += m_count[i] > 0;
+    }
+    map.validPixels = valid;
+}
+
+void SurfaceAccumulator::variance(SurfaceMap& map) const {
+    const size_t pixels = m_m2.size();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    map.width = m_width;
+    map.height = m_height;
+    map.heights.resize(pixels);
+    size_t valid = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        map.heights[i] = m_count[i] > 1 ? m_m2[i] / (m_count[i] - 1) : nan;
+        valid += m_count[i] > 1;
+    }
+    map.validPixels = valid;
+}
+
+// ---------------- SurfaceEngine ----------------
+
+void SurfaceEngine::measure(const SurfaceParams& params,
+                            uint32_t seed,
+                            SurfaceMap& map,
+                            SurfaceTimings* timings) {
+    Clock::time_point start = Clock::now();
+    synthesize(params, seed);
+    double synthesizeMs = elapsedMs(start);
+
+    start = Clock::now();
+    extractPhase();
+    double phaseMs = elapsedMs(start);
+
+    start = Clock::now();
+    unwrap(map);
+    double unwrapMs = elapsedMs(start);
+
+    if (timings) {
+        timings->synthesizeMs = synthesizeMs;
+        timings->phaseMs = phaseMs;
+        timings->unwrapMs = unwrapMs;
+    }
+}
+
+void SurfaceEngine::synthesize(const SurfaceParams& params, uint32_t seed) {
+    m_params = params;
+    const size_t width = params.width;
+    const size_t height = params.height;
+    const size_t pixels = width * height;
+    const size_t steps = params.steps;
+    m_frames.resize(pixels * steps);
+
+    double cx, cy, radius;
+    aperture(params, cx, cy, radius);
+    const float noiseAmplitude = static_cast<float>(params.noise) * kModulation;
+
+    parallelFor(height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        // 每行的条纹分量B·cosφ、B·sinφ与噪声
+        std::vector<float> fringeCos(width);
+        std::vector<float> fringeSin(width);
+        std::vector<float> noise(width);
+
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            double ny = (y - cy) / radius;
+            for (size_t x = 0; x < width; x++) {
+                double nx = (x - cx) / radius;
+                double rho2 = nx * nx + ny * ny;
+                if (rho2 > 1) {
+                    fringeCos[x] = 0;
+                    fringeSin[x] = 0;
+                    continue;
+                }
+                double waves = params.tiltX * nx + params.tiltY * ny +
+                               params.power * (2 * rho2 - 1) +
+                               params.astigmatism * (nx * nx - ny * ny) +
+                               params.coma * (3 * rho2 - 2) * nx +
+                               params.spherical * (6 * rho2 * rho2 - 6 * rho2 + 1);
+                double phase = 2 * kPi * waves;
+                fringeCos[x] = static_cast<float>(kModulation * std::cos(phase));
+                fringeSin[x] = static_cast<float>(kModulation * std::sin(phase));
+            }
+
+            for (size_t k = 0; k < steps; k++) {
+                // I_k = A + B·cos(φ + δ_k) = A + B·cosφ·cosδ_k - B·sinφ·sinδ_k
+                const float shiftCos = static_cast<float>(std::cos(2 * kPi * k / steps));
+                const float shiftSin = static_cast<float>(std::sin(2 * kPi * k / steps));
+
+                // xorshift32，映射到[-1, 1)
+                uint32_t state = noiseSeed(seed, y, k);
+                for (size_t x = 0; x < width; x++) {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    noise[x] = static_cast<int32_t>(state) * (1.0f / 2147483648.0f);
+                }
+
+                uint16_t* out = &m_frames[k * pixels + y * width];
+                for (size_t x = 0; x < width; x++) {
+                    float value = kBackground + fringeCos[x] * shiftCos -
+                                  fringeSin[x] * shiftSin + noiseAmplitude * noise[x];
+                    value = std::min(std::max(value + 0.5f, 0.0f), kIntensityMax);
+                    out[x] = static_cast<uint16_t>(value);
+                }
+            }
+        }
+    });
+}
+
+void SurfaceEngine::extractPhase() {
+    const size_t width = m_params.width;
+    const size_t pixels = width * m_params.height;
+    const size_t steps = m_params.steps;
+    m_wrapped.resize(pixels);
+
+    // S = ΣI_k·sinδ_k = -(N/2)·B·sinφ，C = ΣI_k·cosδ_k = (N/2)·B·cosφ
+    std::vector<float> shiftCos(steps);
+    std::vector<float> shiftSin(steps);
+    for (size_t k = 0; k < steps; k++) {
+        shiftCos[k] = static_cast<float>(std::cos(2 * kPi * k / steps));
+        shiftSin[k] = static_cast<float>(std::sin(2 * kPi * k / steps));
+    }
+    const float threshold = kMinModulation * steps * 0.5f;
+
+    parallelFor(m_params.height, kRowGrain, [&](size_t rowBegin, size_t rowEnd) {
+        std::vector<float> sumSin(width);
+        std::vector<float> sumCos(width);
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            std::fill(sumSin.begin(), sumSin.end(), 0.0f);
+            std::fill(sumCos.begin(), sumCos.end(), 0.0f);
+            for (size_t k = 0; k < steps; k++) {
+                const uint16_t* frame = &m_frames[k * pixels + y * width];
+                const float sk = shiftSin[k];
+                const float ck = shiftCos[k];
+                for (size_t x = 0; x < width; x++) {
+                    float value = frame[x];
+                    sumSin[x] += value * sk;
+                    sumCos[x] += value * ck;
+                }
+            }
+
+            wrappedPhaseRow(sumSin.data(), sumCos.data(), &m_wrapped[y * width], width, threshold);
+        }
+    });
+}
+
+void SurfaceEngine::unwrap(SurfaceMap& map) {
+    const size_t width = m_params.width;
+    const size_t height = m_params.height;
+    map.width = m_params.width;
+    map.height = m_params.height;
+    map.heights.resize(width * height);
+    double* phase = map.heights.data();
+
+    const size_t bands = (height + kBandRows - 1) / kBandRows;
+    std::vector<double> bandSum(bands);
+    std::vector<size_t> bandCount(bands);
+
+    // 各带内并行：先逐行解包裹，再把每行对齐到上一行
+    parallelFor(bands, 1, [&](size_t bandBegin, size_t bandEnd) {
+        std::vector<float> diff(width);
+        for (size_t band = bandBegin; band < bandEnd; band++) {
+            size_t rowBegin = band * kBandRows;
+            size_t rowEnd = std::min(rowBegin + kBandRows, height);
+            double sum = 0;
+            size_t count = 0;
+            for (size_t y = rowBegin; y < rowEnd; y++) {
+                double* row = phase + y * width;
+                unwrapRow(&m_wrapped[y * width], diff.data(), row, width);
+                if (y > rowBegin) {
+                    alignRow(row - width, row, width);
+                }
+                for (size_t x = 0; x < width; x++) {
+                    if (!std::isnan(row[x])) {
+                        sum += row[x];
+                        count++;
+                    }
+                }
+            }
+            bandSum[band] = sum;
+            bandCount[band] = count;
+        }
+    });
+
+    // 带与带之间按交界两行的平均差值顺序对齐（孔径需为连通区域）
+    std::vector<double> bandOffset(bands, 0.0);
+    for (size_t band = 1; band < bands; band++) {
+        const double* previous = phase + (band * kBandRows - 1) * width;
+        const double* current = previous + width;
+        double sum = 0;
+        size_t overlap = 0;
+        for (size_t x = 0; x < width; x++) {
+            if (!std::isnan(previous[x]) && !std::isnan(current[x])) {
+                sum += previous[x] + bandOffset[band - 1] - current[x];
+                overlap++;
+            }
+        }
+        if (overlap > 0) {
+            bandOffset[band] = 2 * kPi * std::round(sum / overlap / (2 * kPi));
+        }
+    }
+
+    double total = 0;
+    size_t valid = 0;
+    for (size_t band = 0; band < bands; band++) {
+        total += bandSum[band] + bandOffset[band] * bandCount[band];
+        valid += bandCount[band];
+    }
+    map.validPixels = valid;
+
+    // 去除平均值（piston）并按反射式干涉换算为高度: h = φ·λ / (4π)
+    const double mean = valid ? total / valid : 0;
+    const double scale = m_params.wavelength / (4 * kPi);
+    parallelFor(bands, 1, [&](size_t bandBegin, size_t bandEnd) {
+        for (size_t band = bandBegin; band < bandEnd; band++) {
+            double shift = bandOffset[band] - mean;
+            double* begin = phase + band * kBandRows * width;
+            double* end = phase + std::min((band + 1) * kBandRows, height) * width;
+            for (double* value = begin; value < end; value++) {
+                *value = (*value + shift) * scale;
+            }
+        }
+    });
+}
@@ -0,0 +1,162 @@
+#include "worker_supervisor.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 轮询工作进程状态的间隔，同时决定收到退出信号后的响应时间
+const std::chrono::milliseconds kPollInterval(100);
+
+volatile std::sig_atomic_t g_stop_signal = 0;
+
+void onStopSignal(int signal) { g_stop_signal = signal; }
+
+struct Worker {
+    pid_t pid = 0;  // 0表示未运行
+    Clock::time_point started;
+    Clock::time_point restartAt;
+    std::chrono::milliseconds backoff{0};
+};
+
+pid_t spawn(size_t index, const std::function<int(size_t)>& worker) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // 子进程恢复默认信号处理，监管进程发送的SIGTERM直接结束工作进程
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        int code = 1;
+        try {
+            code = worker(index);
+        } catch (std::exception& e) {
+            std::cerr << "工作进程" << index << "异常: " << e.what() << std::endl;
+        }
+        std::cout.flush();
+        _exit(code);
+    }
+    return pid;
+}
+
+}  // namespace
+
+int runWorkerSupervisor(size_t count,
+                        const std::function<int(size_t)>& worker,
+                        const std::function<void(size_t, int)>& onExit,
+                        const WorkerSupervisorOptions& options) {
+    struct sigaction action = {};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::vector<Worker> workers(count);
+    for (size_t i = 0; i < count; i++) {
+        workers[i].pid = spawn(i, worker);
+        workers[i].started = Clock::now();
+        if (workers[i].pid < 0) {
+            std::cerr << "无法创建工作进程" << i << std::endl;
+            workers[i].pid = 0;
+            workers[i].restartAt = Clock::now() + options.initialBackoff;
+        }
+    }
+
+    int result = 0;
+    while (!g_stop_signal) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            auto it = std::find_if(workers.begin(), workers.end(), [pid](const Worker& entry) {
+                return entry.pid == pid;
+            });
+            if (it == workers.end()) {
+                continue;
+            }
+            size_t index = static_cast<size_t>(it - workers.begin());
+            it->pid = 0;
+            onExit(index, static_cast<int>(pid));
+
+            bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            if (clean) {
+                std::cout << "工作进程" << index << "已退出" << std::endl;
+                it->restartAt = Clock::time_point::max();
+                continue;
+            }
+            // 连续崩溃时退避时间加倍，稳定运行一段时间后重新从初始值开始
+            if (Clock::now() - it->started > options.stableAfter ||
+                it->backoff.count() == 0) {
+                it->backoff = options.initialBackoff;
+            } else {
+                it->backoff = std::min(it->backoff * 2, options.maxBackoff);
+            }
+            it->restartAt = Clock::now() + it->backoff;
+            if (WIFSIGNALED(status)) {
+                std::cerr << "工作进程" << index << "(pid " << pid << ")被信号"
+                          << WTERMSIG(status) << "终止，" << it->backoff.count() << "ms后重启"
+                          << std::endl;
+            } else {
+                std::cerr << "工作进程" << index << "(pid " << pid << ")退出码"
+                          << WEXITSTATUS(status) << "，" << it->backoff.count() << "ms后重启"
+                          << std::endl;
+            }
+            continue;
+        }
+        if (pid < 0 && errno != EINTR && errno != ECHILD) {
+            result = 1;
+            break;
+        }
+
+        bool running = false;
+        for (size_t i = 0; i < count; i++) {
+            Worker& entry = workers[i];
+            if (entry.pid == 0 && Clock::now() >= entry.restartAt) {
+                entry.pid = std::max<pid_t>(spawn(i, worker), 0);
+                entry.started = Clock::now();
+                entry.restartAt = Clock::now() + entry.backoff;
+            }
+            running = running || entry.pid != 0 || entry.restartAt != Clock::time_point::max();
+        }
+        // 所有工作进程都已正常退出
+        if (!running) {
+            return result;
+        }
+        std::this_thread::sleep_for(kPollInterval);
+    }
+
+    // 通知所有工作进程退出并回收
+    for (Worker& entry : workers) {
+        if (entry.pid > 0) {
+            kill(entry.pid, SIGTERM);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (workers[i].pid > 0) {
+            waitpid(workers[i].pid, nullptr, 0);
+            onExit(i, static_cast<int>(workers[i].pid));
+        }
+    }
+    return result;
+}
+
+#else
+
+int runWorkerSupervisor(size_t,
+                        const std::function<int(size_t)>&,
+                        const std::function<void(size_t, int)>&,
+                        const WorkerSupervisorOptions&) {
+    std::cerr << "工作进程模式仅支持POSIX平台" << std::endl;
+    return 1;
+}
+
+#endif
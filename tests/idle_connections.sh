@@ -0,0 +1,35 @@
+#!/bin/sh
+# 空闲连接内存回归测试：启动服务器，用bench_load --idle建立大量空闲连接，
+# 服务器每个连接的常驻内存超过上限或连接建立失败时返回非0，由ctest运行
+# 用法: idle_connections.sh <server> <bench_load> <端口> <空闲连接数> <每连接字节上限>
+set -u
+
+server=$1
+bench_load=$2
+port=$3
+idle=$4
+budget=$5
+
+"$server" --port "$port" >/dev/null 2>&1 &
+server_pid=$!
+trap 'kill "$server_pid" 2>/dev/null; wait "$server_pid" 2>/dev/null' EXIT
+
+# 等待服务器开始监听
+status=1
+for attempt in 1 2 3 4 5 6 7 8 9 10; do
+    sleep 0.5
+    if ! kill -0 "$server_pid" 2>/dev/null; then
+        echo "server exited during startup" >&2
+        exit 1
+    fi
+    "$bench_load" --uri "ws://localhost:$port" --connections 1 --duration 0.5 \
+        --idle "$idle" --max-idle-bytes "$budget" >idle_connections.json 2>/dev/null
+    status=$?
+    # 连接建立失败可能是服务器尚未监听，重试；其他失败（超出上限）直接返回
+    if [ $status -eq 0 ] || ! grep -q '"failed to establish connections"' idle_connections.json; then
+        break
+    fi
+done
+
+cat idle_connections.json
+exit $status
@@ -0,0 +1,349 @@
+// 协议回归测试
+// 经进程内传输（InProcessServer）驱动设备服务器，不经过套接字，结果确定且运行快
+// 覆盖查询与错误路径、快照、测量与面形数据、参数相同的测量合并（单次采集）以及重发请求的响应缓存
+// 任一检查失败时返回非0，由ctest运行
+#include "binary_header.h"
+#include "in_process_server.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #condition << std::endl; \
+            g_failures++;                                                                    \
+        }                                                                                    \
+    } while (0)
+
+// 测量最长约数秒（模拟超时固定等待2秒）
+const std::chrono::seconds kWaitTimeout(30);
+
+// 按连接收集服务器发来的消息，测量等异步响应通过轮询等待
+class Client {
+public:
+    Client(InProcessServer& server, const std::string& resource = "/")
+        : m_server(server), m_connection(server.connect(resource)) {}
+
+    void send(const json& request) { m_server.sendText(m_connection, request.dump()); }
+
+    // 等待requestId的一条status不为pending的响应（最终响应），超时返回空对象
+    json waitFinal(const std::string& requestId) {
+        return waitFor([&requestId](const json& message) {
+            return message.value("requestId", "") == requestId &&
+                   message.value("status", "") != "pending";
+        });
+    }
+
+    // 等待requestId的下一条响应（含pending）
+    json waitAny(const std::string& requestId) {
+        return waitFor([&requestId](const json& message) {
+            return message.value("requestId", "") == requestId;
+        });
+    }
+
+    // 发送请求并等待最终响应
+    json call(const std::string& command,
+              const std::string& requestId,
+              const json& params = json::object()) {
+        send({{"command", command}, {"requestId", requestId}, {"params", params}});
+        return waitFinal(requestId);
+    }
+
+    // 取出已收到的二进制消息
+    std::vector<std::string> takeBinary() {
+        poll();
+        std::vector<std::string> binary;
+        binary.swap(m_binary);
+        return binary;
+    }
+
+    // 等待topic主题的下一条事件，超时返回空对象
+    json waitEvent(const std::string& topic) {
+        auto deadline = std::chrono::steady_clock::now() + kWaitTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            poll();
+            for (size_t i = 0; i < m_events.size(); i++) {
+                if (m_events[i].value("topic", "") == topic) {
+                    json event = m_events[i];
+                    m_events.erase(m_events.begin() + static_cast<std::ptrdiff_t>(i));
+                    return event;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return json::object();
+    }
+
+    // 等待一条完整的二进制消息，分段消息拼接后返回，超时返回空串
+    std::string waitBinaryMessage() {
+        ChunkAssembler chunks;
+        auto deadline = std::chrono::steady_clock::now() + kWaitTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            poll();
+            while (!m_binary.empty()) {
+                std::string message = std::move(m_binary.front());
+                m_binary.erase(m_binary.begin());
+                BinaryHeader header;
+                const uint8_t* data = reinterpret_cast<const uint8_t*>(message.data());
+                if (!decodeBinaryHeader(data, message.size(), header) ||
+                    header.messageType != static_cast<uint8_t>(BinaryMessageType::Chunk)) {
+                    return message;
+                }
+                if (chunks.add(header, data + BinaryHeader::kEncodedSize)) {
+                    return chunks.take();
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return std::string();
+    }
+
+private:
+    template <typename Predicate>
+    json waitFor(Predicate predicate) {
+        auto deadline = std::chrono::steady_clock::now() + kWaitTimeout;
+        for (;;) {
+            poll();
+            for (size_t i = 0; i < m_text.size(); i++) {
+                if (predicate(m_text[i])) {
+                    json message = m_text[i];
+                    m_text.erase(m_text.begin() + static_cast<std::ptrdiff_t>(i));
+                    return message;
+                }
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                return json::object();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    void poll() {
+        for (InProcessMessage& message : m_server.receive(m_connection)) {
+            if (message.opcode == websocketpp::frame::opcode::text) {
+                json parsed = json::parse(message.payload);
+                if (parsed.value("command", "") == "event") {
+                    m_events.push_back(std::move(parsed));
+                } else {
+                    m_text.push_back(std::move(parsed));
+                }
+            } else {
+                m_binary.push_back(std::move(message.payload));
+            }
+        }
+    }
+
+    InProcessServer& m_server;
+    size_t m_connection;
+    std::vector<json> m_text;
+    std::vector<json> m_events;
+    std::vector<std::string> m_binary;
+};
+
+// 查询命令与错误路径
+void testStatusAndErrors(InProcessServer& server) {
+    Client client(server);
+
+    json status = client.call("getMeasureStatus", "status-1");
+    CHECK(status.value("status", "") == "success");
+    CHECK(status["data"].contains("deviceStatus"));
+    uint64_t version = status["data"].value("version", uint64_t(0));
+    CHECK(version > 0);
+
+    json unchanged = client.call("getMeasureStatus", "status-2", {{"ifVersionNewerThan", version}});
+    CHECK(unchanged.value("status", "") == "success");
+    CHECK(unchanged["data"].value("unchanged", false));
+
+    json mode = client.call("getAlignViewMode", "mode-1");
+    CHECK(mode.value("status", "") == "success");
+    CHECK(mode["data"].value("mode", "") == "continuous");
+
+    json unknown = client.call("noSuchCommand", "unknown-1");
+    CHECK(unknown.value("status", "") == "error");
+    CHECK(unknown.value("errorMessage", "") == "Unknown command: noSuchCommand");
+
+    client.send({{"command", "getMeasureStatus"}, {"requestId", "device-1"}, {"deviceId", "X"}});
+    json device = client.waitFinal("device-1");
+    CHECK(device.value("status", "") == "error");
+    CHECK(device.value("errorMessage", "") == "Unknown deviceId: X");
+
+    json badMode = client.call("setAlignViewMode", "mode-2", {{"alignViewMode", "fast"}});
+    CHECK(badMode.value("status", "") == "error");
+
+    json badSize = client.call("executeMeasure", "measure-bad", {{"width", 5}});
+    CHECK(badSize.value("status", "") == "error");
+    CHECK(badSize.value("errorMessage", "") == "Invalid surface size");
+
+    json noData = client.call("getSurfaceData", "surface-0");
+    CHECK(noData.value("status", "") == "error");
+    CHECK(noData.value("errorMessage", "") == "No surface data");
+}
+
+// 快照：先返回响应，图像随后以分段消息到达；第一次请求时尚无帧，由采集线程回复
+void testSnapshot(InProcessServer& server) {
+    Client client(server);
+
+    json badChunk = client.call("getSnapshot", "snapshot-0", {{"chunkSize", 100}});
+    CHECK(badChunk.value("status", "") == "error");
+    CHECK(badChunk.value("errorMessage", "") == "Invalid chunkSize");
+
+    for (int i = 1; i <= 2; i++) {
+        std::string requestId = "snapshot-" + std::to_string(i);
+        const json params = {{"format", "gray8"}, {"decimation", 2}, {"chunkSize", 4096}};
+        json snapshot = client.call("getSnapshot", requestId, params);
+        CHECK(snapshot.value("status", "") == "success");
+        if (snapshot.value("status", "") != "success") {
+            return;
+        }
+        CHECK(snapshot["data"].value("contexId", "") == "0x01000000");
+        CHECK(snapshot["data"].value("sequence", 0) >= 1);
+
+        std::string image = client.waitBinaryMessage();
+        BinaryHeader header;
+        CHECK(decodeBinaryHeader(
+            reinterpret_cast<const uint8_t*>(image.data()), image.size(), header));
+        CHECK(header.messageType == static_cast<uint8_t>(BinaryMessageType::StreamImage));
+        CHECK(header.contexId == 0x01000000u);
+        CHECK(header.width == snapshot["data"].value("width", 0));
+        CHECK(header.height == snapshot["data"].value("height", 0));
+        CHECK(header.payloadLength == static_cast<uint32_t>(header.width) * header.height);
+    }
+}
+
+// 测量与面形数据：pending之后是最终响应，成功时可以取回对应尺寸的面形
+void testMeasureAndSurface(InProcessServer& server) {
+    Client client(server);
+    const json params = {{"width", 128}, {"height", 96}};
+
+    // 模拟测量有5%的概率超时，重试几次直到成功
+    json result = json::object();
+    for (int attempt = 0; attempt < 5 && result.value("status", "") != "success"; attempt++) {
+        std::string requestId = "measure-" + std::to_string(attempt);
+        client.send({{"command", "executeMeasure"}, {"requestId", requestId}, {"params", params}});
+        CHECK(client.waitAny(requestId).value("status", "") == "pending");
+        result = client.waitFinal(requestId);
+        CHECK(result.value("status", "") == "success" || result.value("status", "") == "timeout");
+    }
+    CHECK(result.value("status", "") == "success");
+    if (result.value("status", "") != "success") {
+        return;
+    }
+    CHECK(result["data"].value("width", 0) == 128);
+    CHECK(result["data"].value("height", 0) == 96);
+    CHECK(!result["data"].contains("coalescedRequests"));
+
+    json surface = client.call("getSurfaceData", "surface-1");
+    CHECK(surface.value("status", "") == "success");
+    CHECK(surface["data"].value("datasetId", "") == result["data"].value("datasetId", ""));
+    std::vector<std::string> binary = client.takeBinary();
+    CHECK(binary.size() == 1);
+    if (binary.size() == 1) {
+        BinaryHeader header;
+        CHECK(decodeBinaryHeader(
+            reinterpret_cast<const uint8_t*>(binary[0].data()), binary[0].size(), header));
+        CHECK(header.messageType == static_cast<uint8_t>(BinaryMessageType::MeasureResult));
+        CHECK(header.width == 128 && header.height == 96);
+        CHECK(header.payloadLength == 128u * 96u * sizeof(double));
+    }
+
+    // 汇总在设备任务队列中计算，相同参数的第二次请求命中缓存
+    json summary = client.call("getSurfaceSummary", "summary-1");
+    CHECK(summary.value("status", "") == "success");
+    CHECK(summary["data"].value("datasetId", "") == result["data"].value("datasetId", ""));
+    CHECK(!summary["data"].value("cached", true));
+    json cachedSummary = client.call("getSurfaceSummary", "summary-2");
+    CHECK(cachedSummary["data"].value("cached", false));
+    CHECK(cachedSummary["data"]["zernike"] == summary["data"]["zernike"]);
+}
+
+// 两个连接同时提交参数相同的测量：只采集一次，两者得到相同的结果
+void testCoalescing(InProcessServer& server) {
+    Client first(server);
+    Client second(server);
+    // 多次平均让测量持续足够长，第二个请求到达时第一个测量尚未结束
+    const json params = {{"width", 256}, {"height", 256}, {"averageCount", 8}};
+    json subscribed = first.call("subscribe", "coalesce-events", {{"topics", {"dataset"}}});
+    CHECK(subscribed.value("status", "") == "success");
+    first.send({{"command", "executeMeasure"}, {"requestId", "coalesce-a"}, {"params", params}});
+    second.send({{"command", "executeMeasure"}, {"requestId", "coalesce-b"}, {"params", params}});
+
+    json a = first.waitFinal("coalesce-a");
+    json b = second.waitFinal("coalesce-b");
+    CHECK(!a.empty() && !b.empty());
+    CHECK(a.value("status", "") == b.value("status", ""));
+    if (a.value("status", "") == "success") {
+        CHECK(a["data"].value("datasetId", "") == b["data"].value("datasetId", ""));
+        CHECK(a["data"].value("coalescedRequests", 0) == 2);
+        // dataset事件列出共用这次测量的全部请求
+        json event = first.waitEvent("dataset");
+        CHECK(event["data"].value("requestId", "") == "coalesce-a");
+        CHECK(event["data"]["requestIds"] == json({"coalesce-a", "coalesce-b"}));
+    }
+}
+
+// 同一连接以同一requestId重发：处理中返回pending，完成后返回缓存的最终响应，只测量一次
+void testReplayCache(InProcessServer& server) {
+    Client client(server);
+    const json request = {{"command", "executeMeasure"},
+                          {"requestId", "replay-1"},
+                          {"params", {{"width", 256}, {"height", 256}, {"averageCount", 8}}}};
+    client.send(request);
+    CHECK(client.waitAny("replay-1").value("status", "") == "pending");
+
+    client.send(request);
+    json inProgress = client.waitAny("replay-1");
+    CHECK(inProgress.value("status", "") == "pending");
+    CHECK(inProgress.value("replayed", false));
+
+    json original = client.waitFinal("replay-1");
+    CHECK(!original.empty());
+    CHECK(!original.value("replayed", false));
+
+    client.send(request);
+    json cached = client.waitFinal("replay-1");
+    CHECK(cached.value("replayed", false));
+    CHECK(cached.value("status", "") == original.value("status", ""));
+    CHECK(cached["data"] == original["data"]);
+
+    // 查询命令不缓存，同一requestId重新执行
+    json first = client.call("getMeasureStatus", "replay-2");
+    json second = client.call("getMeasureStatus", "replay-2");
+    CHECK(first.value("status", "") == "success" && second.value("status", "") == "success");
+    CHECK(!second.value("replayed", false));
+
+    json metrics = client.call("getServerMetrics", "replay-metrics");
+    CHECK(metrics["data"].value("requestsReplayed", 0) == 2);
+    CHECK(metrics["data"]["session"].value("cachedResponses", 0) == 1);
+    CHECK(metrics["data"].value("measurementsCoalesced", 0) >= 1);
+}
+
+}  // namespace
+
+int main() {
+    // 服务器的处理日志输出到标准输出，测试只输出失败的检查
+    std::streambuf* saved = std::cout.rdbuf(nullptr);
+    {
+        InProcessServer server;
+        testStatusAndErrors(server);
+        testSnapshot(server);
+        testMeasureAndSurface(server);
+        testCoalescing(server);
+        testReplayCache(server);
+    }
+    std::cout.rdbuf(saved);
+
+    if (g_failures > 0) {
+        std::cerr << g_failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "全部检查通过" << std::endl;
+    return 0;
+}